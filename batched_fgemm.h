@@ -0,0 +1,231 @@
+#if !defined(H_BATCHED_FGEMM)
+#define H_BATCHED_FGEMM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// the batched kernel is used when none of the matrix dimensions exceeds this value,
+// above it FFLAS::fgemm (with its own blocking and packing) is faster per residue
+#if !defined(BATCHED_FGEMM_MAX_DIM)
+#define BATCHED_FGEMM_MAX_DIM 128
+#endif
+
+namespace SIM_RNS
+{
+
+// reduce x (0 <= x < 2^53) modulo p, inv_p is 1.0 / p
+inline double batched_reduce(double x, double p, double inv_p)
+{
+    double q = std::floor(x * inv_p);
+    double r = x - q * p;
+    if (r >= p)
+    {
+        r -= p;
+    }
+    else if (r < 0)
+    {
+        r += p;
+    }
+    return r;
+}
+
+/*
+    Strided-batched modular matrix product on residue slices stored as doubles.
+    For every slice s < num_slices computes
+
+        C_s = alpha[s] * A_s * B_s + beta[s] * C_s  (mod moduli[s])
+
+    where A_s = A + s * stride_a is dim_m x dim_n, B_s = B + s * stride_b is
+    dim_n x dim_k and C_s = C + s * stride_c is dim_m x dim_k, all row major
+    and contiguous. alpha == NULL stands for 1 and beta == NULL for 0.
+
+    All slices of A and B are packed once into an interleaved layout where the
+    slice index is the fastest moving one, so that the micro-kernel runs the
+    same multiply-add across all slices at once (each lane with its own
+    modulus). Accumulators are only reduced every k_block steps, k_block being
+    the number of products that fit in the 53 bits mantissa.
+
+    Entries of A (resp. B) may be left unreduced as long as they are in
+    [0, bound_a] (resp. [0, bound_b]); they are reduced while packing only if
+    the whole dot product would not fit in a double otherwise. When
+    reduce_output is false (and alpha, beta are trivial) the last reduction is
+    skipped and C is left unreduced. Returns a bound on the entries of C.
+*/
+inline double batched_fgemm(size_t num_slices, const double *moduli,
+                            size_t dim_m, size_t dim_n, size_t dim_k,
+                            const double *alpha,
+                            const double *A, size_t stride_a, double bound_a,
+                            const double *B, size_t stride_b, double bound_b,
+                            const double *beta,
+                            double *C, size_t stride_c,
+                            bool reduce_output)
+{
+    assert(num_slices && dim_m && dim_n && dim_k);
+    const size_t S = num_slices;
+    double max_modulus = 0;
+    std::vector<double> inv_moduli(S);
+    for (size_t s = 0; s < S; s++)
+    {
+        assert(moduli[s] > 1 && moduli[s] < (1 << 26) && "batched_fgemm only supports moduli of at most 26 bits");
+        inv_moduli[s] = 1.0 / moduli[s];
+        if (moduli[s] > max_modulus)
+        {
+            max_modulus = moduli[s];
+        }
+    }
+    bool scaled = (alpha || beta);
+    if (scaled)
+    {
+        reduce_output = true;
+    }
+    // accumulators stay below p after a reduction, each product adds at most bound_a * bound_b
+    const double mantissa_room = 9007199254740992.0 - max_modulus; // 2^53 - p
+    bool reduce_a = false;
+    bool reduce_b = false;
+    if (bound_a * bound_b * dim_n > mantissa_room)
+    {
+        // the dot products do not fit in one pass, reduce unreduced operands on the fly
+        if (bound_a > max_modulus - 1)
+        {
+            reduce_a = true;
+            bound_a = max_modulus - 1;
+        }
+        if (bound_b > max_modulus - 1)
+        {
+            reduce_b = true;
+            bound_b = max_modulus - 1;
+        }
+    }
+    size_t k_block = static_cast<size_t>(mantissa_room / (bound_a * bound_b));
+    assert(k_block >= 1);
+
+    // pack A and B with slices interleaved
+    std::vector<double> packed_a(dim_m * dim_n * S);
+    std::vector<double> packed_b(dim_n * dim_k * S);
+    for (size_t s = 0; s < S; s++)
+    {
+        const double *a = A + s * stride_a;
+        const double *b = B + s * stride_b;
+        if (reduce_a)
+        {
+            for (size_t i = 0; i < dim_m * dim_n; i++)
+            {
+                packed_a[i * S + s] = batched_reduce(a[i], moduli[s], inv_moduli[s]);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < dim_m * dim_n; i++)
+            {
+                packed_a[i * S + s] = a[i];
+            }
+        }
+        if (reduce_b)
+        {
+            for (size_t i = 0; i < dim_n * dim_k; i++)
+            {
+                packed_b[i * S + s] = batched_reduce(b[i], moduli[s], inv_moduli[s]);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < dim_n * dim_k; i++)
+            {
+                packed_b[i * S + s] = b[i];
+            }
+        }
+    }
+
+    // one row of C at a time, for all slices, the rows are spread over the OpenMP threads
+#pragma omp parallel
+    {
+        std::vector<double> acc(dim_k * S);
+#pragma omp for schedule(static)
+        for (long row = 0; row < long(dim_m); row++)
+        {
+            size_t r = row;
+            std::fill(acc.begin(), acc.end(), 0.0);
+            for (size_t c0 = 0; c0 < dim_n; c0 += k_block)
+            {
+                size_t c1 = (c0 + k_block < dim_n) ? c0 + k_block : dim_n;
+                for (size_t c = c0; c < c1; c++)
+                {
+                    const double *a = packed_a.data() + (r * dim_n + c) * S;
+                    const double *b_row = packed_b.data() + c * dim_k * S;
+                    for (size_t j = 0; j < dim_k; j++)
+                    {
+                        const double *b = b_row + j * S;
+                        double *acc_j = acc.data() + j * S;
+                        for (size_t s = 0; s < S; s++)
+                        {
+                            acc_j[s] += a[s] * b[s];
+                        }
+                    }
+                }
+                if (c1 == dim_n && !reduce_output)
+                {
+                    break;
+                }
+                for (size_t j = 0; j < dim_k; j++)
+                {
+                    double *acc_j = acc.data() + j * S;
+                    for (size_t s = 0; s < S; s++)
+                    {
+                        acc_j[s] = batched_reduce(acc_j[s], moduli[s], inv_moduli[s]);
+                    }
+                }
+            }
+            // scale by alpha, add beta * C and unpack
+            for (size_t s = 0; s < S; s++)
+            {
+                double *c_row = C + s * stride_c + r * dim_k;
+                const double p = moduli[s];
+                const double inv_p = inv_moduli[s];
+                const double al = alpha ? alpha[s] : 1;
+                const double be = beta ? beta[s] : 0;
+                for (size_t j = 0; j < dim_k; j++)
+                {
+                    double v = acc[j * S + s];
+                    if (al != 1)
+                    {
+                        v = batched_reduce(al * v, p, inv_p);
+                    }
+                    if (be != 0)
+                    {
+                        v = batched_reduce(v + be * c_row[j], p, inv_p);
+                    }
+                    c_row[j] = v;
+                }
+            }
+        }
+    }
+    if (reduce_output)
+    {
+        return max_modulus - 1;
+    }
+    // the last block starts from a reduced accumulator unless it is the only one
+    size_t last_block = dim_n - ((dim_n - 1) / k_block) * k_block;
+    return (dim_n > k_block ? max_modulus - 1 : 0) + last_block * bound_a * bound_b;
+}
+
+// same as above with reduced inputs and a reduced output
+inline void batched_fgemm(size_t num_slices, const double *moduli,
+                          size_t dim_m, size_t dim_n, size_t dim_k,
+                          const double *alpha,
+                          const double *A, size_t stride_a,
+                          const double *B, size_t stride_b,
+                          const double *beta,
+                          double *C, size_t stride_c)
+{
+    double max_modulus = *std::max_element(moduli, moduli + num_slices);
+    batched_fgemm(num_slices, moduli, dim_m, dim_n, dim_k,
+                  alpha, A, stride_a, max_modulus - 1, B, stride_b, max_modulus - 1,
+                  beta, C, stride_c, true);
+}
+
+} // namespace SIM_RNS
+
+#endif // H_BATCHED_FGEMM
@@ -0,0 +1,299 @@
+#if !defined(H_BENCH_COMMON)
+#define H_BENCH_COMMON
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// helpers shared by the benchmark drivers: wall clock timing, sample statistics,
+// parsing of comma separated arguments and JSON / CSV reports that plot.py reads
+
+// seconds elapsed since start on a monotonic clock
+inline double bench_seconds_since(const std::chrono::steady_clock::time_point &start)
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// the wall times of the repetitions of one measurement
+class BenchStats
+{
+    std::vector<double> m_samples;
+
+  public:
+    inline void add(double seconds) { m_samples.push_back(seconds); }
+    inline size_t count() const { return m_samples.size(); }
+
+    double min() const
+    {
+        return m_samples.empty() ? 0 : *std::min_element(m_samples.begin(), m_samples.end());
+    }
+
+    double median() const { return percentile(50); }
+    double p95() const { return percentile(95); }
+
+    // nearest rank percentile
+    double percentile(double p) const
+    {
+        if (m_samples.empty())
+        {
+            return 0;
+        }
+        std::vector<double> sorted(m_samples);
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(p / 100 * sorted.size());
+        return sorted[rank ? rank - 1 : 0];
+    }
+};
+
+// one row of a report: the statistics of one phase of one configuration
+struct BenchRecord
+{
+    std::string algorithm;
+    std::string phase;
+    size_t dim_m, dim_n, dim_k;
+    uint64_t input_bitsize;
+    uint64_t moduli_bitsize; // level 1 moduli bitsize, 0 if not applicable
+    size_t threads;
+    BenchStats stats;
+};
+
+/*
+    use this method to split a comma separated argument, eg. "1,2,4"
+*/
+inline std::vector<std::string> bench_split(const std::string &arg, char separator = ',')
+{
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, separator))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+inline std::vector<uint64_t> bench_parse_numbers(const std::string &arg)
+{
+    std::vector<uint64_t> numbers;
+    std::vector<std::string> items = bench_split(arg);
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        numbers.push_back(std::strtoull(items[i].c_str(), NULL, 10));
+    }
+    return numbers;
+}
+
+// a product of a dim_m x dim_n matrix by a dim_n x dim_k matrix
+struct BenchShape
+{
+    size_t dim_m, dim_n, dim_k;
+};
+
+/*
+    use this method to parse shapes written MxNxK (or D for a square product),
+    separated by commas, returns false on a malformed shape
+*/
+inline bool bench_parse_shapes(const std::string &arg, std::vector<BenchShape> &shapes)
+{
+    std::vector<std::string> items = bench_split(arg);
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        std::vector<std::string> parts = bench_split(items[i], 'x');
+        BenchShape shape;
+        if (parts.size() == 1)
+        {
+            shape.dim_m = shape.dim_n = shape.dim_k = std::strtoull(parts[0].c_str(), NULL, 10);
+        }
+        else if (parts.size() == 3)
+        {
+            shape.dim_m = std::strtoull(parts[0].c_str(), NULL, 10);
+            shape.dim_n = std::strtoull(parts[1].c_str(), NULL, 10);
+            shape.dim_k = std::strtoull(parts[2].c_str(), NULL, 10);
+        }
+        else
+        {
+            return false;
+        }
+        if (!shape.dim_m || !shape.dim_n || !shape.dim_k)
+        {
+            return false;
+        }
+        shapes.push_back(shape);
+    }
+    return true;
+}
+
+/*
+    use this method to write the records as a JSON array of flat objects
+*/
+inline void bench_write_json(std::ostream &out, const std::vector<BenchRecord> &records)
+{
+    out << "[" << std::endl;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const BenchRecord &r = records[i];
+        out << "  {\"algorithm\": \"" << r.algorithm << "\", \"phase\": \"" << r.phase << "\""
+            << ", \"m\": " << r.dim_m << ", \"n\": " << r.dim_n << ", \"k\": " << r.dim_k
+            << ", \"input_bitsize\": " << r.input_bitsize << ", \"moduli_bitsize\": " << r.moduli_bitsize
+            << ", \"threads\": " << r.threads << ", \"reps\": " << r.stats.count()
+            << ", \"min\": " << r.stats.min() << ", \"median\": " << r.stats.median() << ", \"p95\": " << r.stats.p95()
+            << "}" << (i + 1 < records.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+/*
+    use this method to write the records as CSV with a header line, same columns as the JSON
+*/
+inline void bench_write_csv(std::ostream &out, const std::vector<BenchRecord> &records)
+{
+    out << "algorithm,phase,m,n,k,input_bitsize,moduli_bitsize,threads,reps,min,median,p95" << std::endl;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const BenchRecord &r = records[i];
+        out << r.algorithm << "," << r.phase << "," << r.dim_m << "," << r.dim_n << "," << r.dim_k << ","
+            << r.input_bitsize << "," << r.moduli_bitsize << "," << r.threads << "," << r.stats.count() << ","
+            << r.stats.min() << "," << r.stats.median() << "," << r.stats.p95() << std::endl;
+    }
+}
+
+// the fastest algorithm of one configuration, one cell of a crossover map
+struct BenchWinner
+{
+    size_t dim_m, dim_n, dim_k;
+    uint64_t input_bitsize;
+    size_t threads;
+    std::string algorithm;
+    double median;
+    std::string runner_up; // empty if it ran alone
+    double runner_up_median;
+};
+
+/*
+    use this method to pick the algorithm with the lowest median total time
+    of every configuration among the records
+*/
+inline std::vector<BenchWinner> bench_crossover(const std::vector<BenchRecord> &records)
+{
+    typedef std::tuple<uint64_t, size_t, size_t, size_t, size_t> Key; // input bitsize first, as the maps are read
+    std::map<Key, BenchWinner> cells;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const BenchRecord &r = records[i];
+        if (r.phase != "total" || !r.stats.count())
+        {
+            continue;
+        }
+        Key key(r.input_bitsize, r.dim_m, r.dim_n, r.dim_k, r.threads);
+        double median = r.stats.median();
+        std::map<Key, BenchWinner>::iterator it = cells.find(key);
+        if (it == cells.end())
+        {
+            BenchWinner w = {r.dim_m, r.dim_n, r.dim_k, r.input_bitsize, r.threads, r.algorithm, median, "", 0};
+            cells.insert(std::make_pair(key, w));
+            continue;
+        }
+        BenchWinner &w = it->second;
+        if (median < w.median)
+        {
+            w.runner_up = w.algorithm;
+            w.runner_up_median = w.median;
+            w.algorithm = r.algorithm;
+            w.median = median;
+        }
+        else if (w.runner_up.empty() || median < w.runner_up_median)
+        {
+            w.runner_up = r.algorithm;
+            w.runner_up_median = median;
+        }
+    }
+    std::vector<BenchWinner> winners;
+    for (std::map<Key, BenchWinner>::const_iterator it = cells.begin(); it != cells.end(); ++it)
+    {
+        winners.push_back(it->second);
+    }
+    return winners;
+}
+
+/*
+    use this method to write a crossover map as CSV with a header line, one row per configuration
+    (the decision table format IntegerMatMul loads)
+*/
+inline void bench_write_crossover(std::ostream &out, const std::vector<BenchWinner> &winners)
+{
+    out << "m,n,k,input_bitsize,threads,algorithm,median,runner_up,runner_up_median" << std::endl;
+    for (size_t i = 0; i < winners.size(); i++)
+    {
+        const BenchWinner &w = winners[i];
+        out << w.dim_m << "," << w.dim_n << "," << w.dim_k << "," << w.input_bitsize << "," << w.threads << ","
+            << w.algorithm << "," << w.median << "," << w.runner_up << "," << w.runner_up_median << std::endl;
+    }
+}
+
+/*
+    use this method to print a crossover map as a grid of winners for a quick look,
+    one line per input bitsize and one column per shape, for each thread count
+*/
+inline void bench_print_crossover(std::ostream &out, const std::vector<BenchWinner> &winners)
+{
+    std::vector<size_t> threads;
+    std::vector<std::string> shapes;
+    std::vector<uint64_t> bitsizes;
+    std::map<std::tuple<size_t, std::string, uint64_t>, std::string> grid;
+    for (size_t i = 0; i < winners.size(); i++)
+    {
+        const BenchWinner &w = winners[i];
+        std::stringstream shape;
+        shape << w.dim_m << "x" << w.dim_n << "x" << w.dim_k;
+        if (std::find(threads.begin(), threads.end(), w.threads) == threads.end())
+        {
+            threads.push_back(w.threads);
+        }
+        if (std::find(shapes.begin(), shapes.end(), shape.str()) == shapes.end())
+        {
+            shapes.push_back(shape.str());
+        }
+        if (std::find(bitsizes.begin(), bitsizes.end(), w.input_bitsize) == bitsizes.end())
+        {
+            bitsizes.push_back(w.input_bitsize);
+        }
+        grid[std::make_tuple(w.threads, shape.str(), w.input_bitsize)] = w.algorithm;
+    }
+    std::sort(bitsizes.begin(), bitsizes.end());
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        out << threads[t] << " threads, bits \\ shape";
+        for (size_t s = 0; s < shapes.size(); s++)
+        {
+            out << "\t" << shapes[s];
+        }
+        out << std::endl;
+        for (size_t b = 0; b < bitsizes.size(); b++)
+        {
+            out << bitsizes[b];
+            for (size_t s = 0; s < shapes.size(); s++)
+            {
+                std::map<std::tuple<size_t, std::string, uint64_t>, std::string>::const_iterator it =
+                    grid.find(std::make_tuple(threads[t], shapes[s], bitsizes[b]));
+                out << "\t" << (it == grid.end() ? "-" : it->second);
+            }
+            out << std::endl;
+        }
+    }
+}
+
+#endif // H_BENCH_COMMON
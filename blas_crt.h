@@ -0,0 +1,566 @@
+#if !defined(H_BLAS_CRT)
+#define H_BLAS_CRT
+
+#include "gen_coprime_abstract.h"
+#include "limb_matrix.h"
+#include <fflas-ffpack/config-blas.h>
+#include <fflas-ffpack/fflas/fflas.h>
+#include <gmp++/gmp++.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+// moduli up to this bitsize are reduced with one matrix product of the 20 bit digits of the
+// inputs, larger ones (up to the 53 bits of a double) with six products of their 60 bit words
+const uint64_t BLAS_CRT_DIRECT_MAX_BITSIZE = 26;
+// the 60 bit words summed by one product on the six matrix path, so that the sums stay exact doubles
+const size_t BLAS_CRT_SIX_BLOCK_WORDS = 512;
+
+// OpenBLAS, as the makefile builds it, spreads every product over the cores by itself, so the
+// independent products are only run on OpenMP threads when the linked BLAS is single threaded
+extern "C" int openblas_get_num_threads(void) __attribute__((weak));
+
+inline bool blas_crt_blas_threaded()
+{
+    return openblas_get_num_threads && openblas_get_num_threads() > 1;
+}
+
+/*
+    A 64 byte aligned array of doubles owned by a BlasCRT, sized on first use and only grown after,
+    so repeated conversions of the same size allocate nothing
+*/
+class BlasCRTWorkspace
+{
+    double *m_data = NULL;
+    size_t m_size = 0;
+
+  public:
+    BlasCRTWorkspace() = default;
+    ~BlasCRTWorkspace() { free(m_data); }
+
+    BlasCRTWorkspace(const BlasCRTWorkspace &) = delete;
+    BlasCRTWorkspace &operator=(const BlasCRTWorkspace &) = delete;
+
+    /*
+        use this method to get room for size doubles, the contents are left unspecified
+    */
+    double *reserve(size_t size)
+    {
+        if (size > m_size)
+        {
+            free(m_data);
+            void *data = NULL;
+            if (posix_memalign(&data, 64, size * sizeof(double)) != 0)
+            {
+                std::cerr << "BlasCRT cannot allocate a workspace of " << size << " doubles" << std::endl;
+                abort();
+            }
+            m_data = (double *)data;
+            m_size = size;
+        }
+        return m_data;
+    }
+
+    inline size_t size() const { return m_size; }
+};
+
+/*
+    Simultaneous reduction and CRT as BLAS matrix products, generalized from fgemm-mp/ntl-mul/BlasCRT.cpp
+    to any basis of coprime double moduli and to Givaro integers.
+    Reduction: every input is split into 20 bit digits a_t, and x mod p_i is the sum of a_t (2^(20 t) mod p_i),
+    so the residues of len inputs modulo all the moduli are one dgemm of the count x digits matrix
+    of the 2^(20 t) mod p_i by the digits x len matrix of the inputs. Above BLAS_CRT_DIRECT_MAX_BITSIZE
+    the digits are grouped by three into 60 bit words, whose products with the 2^(60 t) mod p_i
+    take six dgemms of 20 bit pieces (a0 b0, a1 b1, a2 b2, (a0 - a2)(b0 - b2), (a0 + a1 + a2)(b0 + b1 + b2)
+    and (a0 + a1 - a2)(b0 + b1 - b2)) instead of nine.
+    CRT: y_i = r_i (M / p_i)^-1 mod p_i, and x = sum of y_i (M / p_i) - q M with q = floor(sum of y_i / p_i),
+    the sum is one dgemm of the y_i (split in pieces if needed) by the 20 bit digits of the M / p_i,
+    whose columns are carried into the limbs of x.
+    Every sum of products stays below 2^53 so the doubles are exact.
+    The residues are laid out as FFLAS' rns_double: residues[i * len + j] is input j modulo p_i.
+    The digit and product matrices live in workspaces of the instance, reused by every call (one call
+    at a time, concurrent ones wait for each other); the six products run in parallel under OpenMP,
+    the single ones rely on a multi-threaded BLAS.
+*/
+class BlasCRT
+{
+  protected:
+    typedef unsigned __int128 uint128_t;
+
+    std::vector<uint64_t> m_moduli;
+    Givaro::Integer m_product;
+    uint64_t m_moduli_bitsize;
+    uint64_t m_input_bitsize;
+    bool m_six;
+    // 20 bit digits of the inputs, a multiple of 3 on the six matrix path
+    size_t m_input_digits;
+    // the digits summed by one product on the direct path
+    size_t m_block_digits;
+    // direct: count x m_input_digits, the 2^(20 t) mod p_i
+    // six: 6 matrices of count x m_input_digits / 3, the products' pieces of 2^(60 t) mod p_i
+    std::vector<double> m_reduction_matrix;
+
+    // (M / p_i)^-1 mod p_i
+    std::vector<uint64_t> m_inverses;
+    // count x m_cofactor_digits, the 20 bit digits of M / p_i
+    std::vector<double> m_crt_matrix;
+    size_t m_cofactor_digits;
+    // the y_i are split in m_pieces pieces of m_piece_bitsize bits
+    uint64_t m_piece_bitsize;
+    size_t m_pieces;
+
+    // reduce: the input digits (and their pieces on the six matrix path) and the products
+    // recover: the pieces of the y_i and the products, see BlasCRTWorkspace
+    mutable BlasCRTWorkspace m_digits;
+    mutable BlasCRTWorkspace m_products;
+    mutable std::vector<double> m_quotients;
+    mutable std::mutex m_lock;
+
+  public:
+    /*
+        moduli is the basis, every input to reduce must be nonnegative and below 2^input_bitsize
+    */
+    BlasCRT(const GenCoprimeAbstract<double> &moduli, uint64_t input_bitsize)
+        : m_moduli(moduli.count()), m_product(1), m_moduli_bitsize(0), m_input_bitsize(std::max(input_bitsize, uint64_t(1)))
+    {
+        const uint64_t mask = (uint64_t(1) << 20) - 1;
+        size_t count = m_moduli.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            m_moduli[i] = uint64_t(moduli.val(i));
+            m_product *= Givaro::Integer(m_moduli[i]);
+            m_moduli_bitsize = std::max(m_moduli_bitsize, uint64_t(Givaro::Integer(m_moduli[i]).bitsize()));
+        }
+        assert(m_moduli_bitsize <= 53 && "BlasCRT moduli must be exact doubles");
+        m_six = m_moduli_bitsize > BLAS_CRT_DIRECT_MAX_BITSIZE;
+
+        // reduction matrix
+        m_input_digits = (m_input_bitsize + 19) / 20;
+        if (m_six)
+        {
+            m_input_digits = 3 * ((m_input_digits + 2) / 3);
+            size_t words = m_input_digits / 3;
+            m_reduction_matrix.resize(6 * count * words);
+            double *b[6];
+            for (size_t s = 0; s < 6; s++)
+            {
+                b[s] = m_reduction_matrix.data() + s * count * words;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t p = m_moduli[i];
+                uint64_t two_sixty = (uint64_t(1) << 60) % p;
+                uint64_t power = 1 % p;
+                for (size_t t = 0; t < words; t++)
+                {
+                    double b0 = power & mask, b1 = (power >> 20) & mask, b2 = (power >> 40) & mask;
+                    b[0][i * words + t] = b0;
+                    b[1][i * words + t] = b1;
+                    b[2][i * words + t] = b2;
+                    b[3][i * words + t] = b0 - b2;
+                    b[4][i * words + t] = b0 + b1 + b2;
+                    b[5][i * words + t] = b0 + b1 - b2;
+                    power = uint64_t(uint128_t(power) * two_sixty % p);
+                }
+            }
+            m_block_digits = 3 * BLAS_CRT_SIX_BLOCK_WORDS;
+        }
+        else
+        {
+            m_reduction_matrix.resize(count * m_input_digits);
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t p = m_moduli[i];
+                uint64_t power = 1 % p;
+                for (size_t t = 0; t < m_input_digits; t++)
+                {
+                    m_reduction_matrix[i * m_input_digits + t] = double(power);
+                    power = (power << 20) % p;
+                }
+            }
+            // (2^20 - 1) (p - 1) per term
+            uint64_t max_modulus = *std::max_element(m_moduli.begin(), m_moduli.end());
+            m_block_digits = std::max(uint64_t(1), ((uint64_t(1) << 53) - 1) / (mask * std::max(max_modulus - 1, uint64_t(1))));
+        }
+
+        // CRT matrix
+        m_inverses.resize(count);
+        m_cofactor_digits = 1;
+        std::vector<Givaro::Integer> cofactors(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            Givaro::Integer p(m_moduli[i]);
+            cofactors[i] = m_product / p;
+            Givaro::Integer inverse;
+            mpz_invert(inverse.get_mpz(), cofactors[i].get_mpz(), p.get_mpz());
+            m_inverses[i] = mpz_get_ui(inverse.get_mpz());
+            m_cofactor_digits = std::max(m_cofactor_digits, size_t((cofactors[i].bitsize() + 19) / 20));
+        }
+        m_crt_matrix.assign(count * m_cofactor_digits, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            split(m_crt_matrix.data() + i * m_cofactor_digits, 1, cofactors[i].get_mpz(), m_cofactor_digits);
+        }
+        // count (2^w - 1) (2^20 - 1) must stay below 2^53
+        uint64_t count_bitsize = Givaro::Integer(uint64_t(count)).bitsize();
+        assert(count_bitsize < 33 && "too many BlasCRT moduli for exact sums");
+        uint64_t exact_bitsize = 53 - 20 - count_bitsize;
+        if (m_moduli_bitsize <= exact_bitsize)
+        {
+            m_piece_bitsize = m_moduli_bitsize;
+            m_pieces = 1;
+        }
+        else
+        {
+            // 20 bit pieces line up with the digits, past 8191 moduli the pieces get narrower
+            m_piece_bitsize = std::min<uint64_t>(20, exact_bitsize);
+            m_pieces = (m_moduli_bitsize + m_piece_bitsize - 1) / m_piece_bitsize;
+        }
+    }
+
+    BlasCRT(const BlasCRT &) = delete;
+    BlasCRT &operator=(const BlasCRT &) = delete;
+
+    inline size_t count() const { return m_moduli.size(); }
+    inline const Givaro::Integer &product() const { return m_product; }
+    inline uint64_t input_bitsize() const { return m_input_bitsize; }
+
+    /*
+        use this method to reduce len nonnegative integers below 2^input_bitsize modulo every modulus,
+        residues[i * len + j] = inputs[j] mod p_i
+    */
+    void reduce(double *residues, const Givaro::Integer *inputs, size_t len) const
+    {
+        reduce(residues, len, [inputs](size_t j, mpz_t) { return (mpz_srcptr)inputs[j].get_mpz(); });
+    }
+
+    // the same with the inputs packed in a LimbMatrix, read in place
+    void reduce(double *residues, const LimbMatrix &inputs) const
+    {
+        reduce(residues, inputs.count(), [&inputs](size_t j, mpz_t v) { return inputs.view(v, j); });
+    }
+
+  protected:
+    // entry(j, v) is the input j, it may use v as a read-only view
+    template <typename Entry>
+    void reduce(double *residues, size_t len, Entry entry) const
+    {
+        if (len == 0)
+        {
+            return;
+        }
+        size_t count = m_moduli.size();
+        std::lock_guard<std::mutex> guard(m_lock);
+        // on the six matrix path the digits are followed by the six pieces of the words
+        double *digits = m_digits.reserve(m_input_digits * len * (m_six ? 3 : 1));
+#pragma omp parallel for schedule(static)
+        for (size_t j = 0; j < len; j++)
+        {
+            mpz_t v;
+            mpz_srcptr input = entry(j, v);
+            assert(mpz_sgn(input) >= 0 && "BlasCRT only reduces nonnegative integers");
+            assert(mpz_sizeinbase(input, 2) <= m_input_bitsize && "BlasCRT input is too large");
+            split(digits + j, len, input, m_input_digits);
+        }
+        if (m_six)
+        {
+            reduce_six(residues, digits, len);
+            return;
+        }
+        double *sums = m_products.reserve(count * len);
+        for (size_t t0 = 0; t0 < m_input_digits; t0 += m_block_digits)
+        {
+            size_t block = std::min(m_block_digits, m_input_digits - t0);
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, count, len, block,
+                        1.0, m_reduction_matrix.data() + t0, m_input_digits,
+                        digits + t0 * len, len,
+                        0.0, sums, len);
+#pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < count; i++)
+            {
+                double p = double(m_moduli[i]);
+                for (size_t j = 0; j < len; j++)
+                {
+                    double r = std::fmod(sums[i * len + j], p);
+                    residues[i * len + j] = t0 ? std::fmod(residues[i * len + j] + r, p) : r;
+                }
+            }
+        }
+    }
+
+  public:
+    /*
+        use this method to recover len integers in [0, product()) from their residues,
+        laid out as reduce writes them
+    */
+    void recover(Givaro::Integer *outputs, const double *residues, size_t len) const
+    {
+        if (len == 0)
+        {
+            return;
+        }
+        size_t count = m_moduli.size();
+        const uint64_t piece_mask = (uint64_t(1) << m_piece_bitsize) - 1;
+        std::lock_guard<std::mutex> guard(m_lock);
+        // y_ij = r_ij (M / p_i)^-1 mod p_i, and their pieces as len x count matrices
+        double *pieces = m_digits.reserve(m_pieces * len * count);
+        m_quotients.assign(len, 0.);
+        double *quotients = m_quotients.data();
+#pragma omp parallel for schedule(static)
+        for (size_t j = 0; j < len; j++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t p = m_moduli[i];
+                // the residues may come out of a product unnormalized or in the symmetric range
+                int64_t r = int64_t(residues[i * len + j]) % int64_t(p);
+                uint64_t y = uint64_t(uint128_t(uint64_t(r < 0 ? r + int64_t(p) : r)) * m_inverses[i] % p);
+                quotients[j] += double(y) / double(p);
+                for (size_t q = 0; q < m_pieces; q++)
+                {
+                    pieces[q * len * count + j * count + i] = double((y >> (q * m_piece_bitsize)) & piece_mask);
+                }
+            }
+        }
+        // sums[q][j][t] = sum over i of piece q of y_ij times digit t of M / p_i
+        double *sums = m_products.reserve(m_pieces * len * m_cofactor_digits);
+        bool parallel_products = m_pieces > 1 && !blas_crt_blas_threaded();
+#pragma omp parallel for schedule(static) if (parallel_products)
+        for (size_t q = 0; q < m_pieces; q++)
+        {
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, len, m_cofactor_digits, count,
+                        1.0, pieces + q * len * count, count,
+                        m_crt_matrix.data(), m_cofactor_digits,
+                        0.0, sums + q * len * m_cofactor_digits, m_cofactor_digits);
+        }
+#pragma omp parallel for schedule(static)
+        for (size_t j = 0; j < len; j++)
+        {
+            combine(outputs[j], sums, j, len);
+            // x = sum - q M, q from the floating point sum of y_i / p_i, corrected by one if it rounded across
+            unsigned long quotient = (unsigned long)std::floor(quotients[j]);
+            mpz_submul_ui(outputs[j].get_mpz(), m_product.get_mpz(), quotient);
+            if (mpz_sgn(outputs[j].get_mpz()) < 0)
+            {
+                mpz_add(outputs[j].get_mpz(), outputs[j].get_mpz(), m_product.get_mpz());
+            }
+            else if (mpz_cmp(outputs[j].get_mpz(), m_product.get_mpz()) >= 0)
+            {
+                mpz_sub(outputs[j].get_mpz(), outputs[j].get_mpz(), m_product.get_mpz());
+            }
+        }
+    }
+
+  protected:
+    // writes the digits 20 bit digits of z to data[0], data[step], ..., zero padded
+    static void split(double *data, size_t step, mpz_srcptr z, size_t digits)
+    {
+        const uint64_t mask = (uint64_t(1) << 20) - 1;
+        const mp_limb_t *limbs = mpz_limbs_read(z);
+        size_t size = mpz_size(z);
+        for (size_t t = 0; t < digits; t++)
+        {
+            size_t bit = 20 * t, limb = bit / 64, shift = bit % 64;
+            uint64_t digit = 0;
+            if (limb < size)
+            {
+                digit = limbs[limb] >> shift;
+                if (shift > 44 && limb + 1 < size)
+                {
+                    digit |= limbs[limb + 1] << (64 - shift);
+                }
+            }
+            data[t * step] = double(digit & mask);
+        }
+    }
+
+    // the six matrix path of reduce, digits is m_input_digits x len followed by room for the pieces
+    void reduce_six(double *residues, double *digits, size_t len) const
+    {
+        size_t count = m_moduli.size();
+        size_t words = m_input_digits / 3;
+        // the pieces of the words: a0, a1, a2, a0 - a2, a0 + a1 + a2, a0 + a1 - a2, each words x len
+        double *a = digits + m_input_digits * len;
+#pragma omp parallel for schedule(static)
+        for (size_t t = 0; t < words; t++)
+        {
+            for (size_t j = 0; j < len; j++)
+            {
+                double a0 = digits[(3 * t) * len + j], a1 = digits[(3 * t + 1) * len + j], a2 = digits[(3 * t + 2) * len + j];
+                size_t e = t * len + j;
+                a[e] = a0;
+                a[words * len + e] = a1;
+                a[2 * words * len + e] = a2;
+                a[3 * words * len + e] = a0 - a2;
+                a[4 * words * len + e] = a0 + a1 + a2;
+                a[5 * words * len + e] = a0 + a1 - a2;
+            }
+        }
+        double *products = m_products.reserve(6 * count * len);
+        bool parallel_products = !blas_crt_blas_threaded();
+        for (size_t t0 = 0; t0 < words; t0 += BLAS_CRT_SIX_BLOCK_WORDS)
+        {
+            size_t block = std::min(BLAS_CRT_SIX_BLOCK_WORDS, words - t0);
+#pragma omp parallel for schedule(static) if (parallel_products)
+            for (size_t s = 0; s < 6; s++)
+            {
+                cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, count, len, block,
+                            1.0, m_reduction_matrix.data() + s * count * words + t0, words,
+                            a + s * words * len + t0 * len, len,
+                            0.0, products + s * count * len, len);
+            }
+#pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t p = m_moduli[i];
+                for (size_t j = 0; j < len; j++)
+                {
+                    size_t e = i * len + j;
+                    uint64_t r = unsplit(products, count * len, e, p);
+                    residues[e] = double(t0 ? (uint64_t(residues[e]) + r) % p : r);
+                }
+            }
+        }
+    }
+
+    // the value mod p of the sum of the word products whose six products are at products[s * stride + e]
+    static uint64_t unsplit(const double *products, size_t stride, size_t e, uint64_t p)
+    {
+        const int64_t mask = (int64_t(1) << 20) - 1;
+        int64_t p0 = int64_t(products[e]);
+        int64_t p1 = int64_t(products[stride + e]);
+        int64_t p2 = int64_t(products[2 * stride + e]);
+        int64_t p3 = int64_t(products[3 * stride + e]);
+        int64_t p4 = int64_t(products[4 * stride + e]);
+        int64_t p5 = int64_t(products[5 * stride + e]);
+        // the coefficients c0 ... c4 of (a0 + a1 X + a2 X^2)(b0 + b1 X + b2 X^2), X = 2^20
+        int64_t c0 = p0, c4 = p2;
+        int64_t c2 = c0 + c4 - p3 + p1;
+        int64_t s = p4 - c0 - c4 - c2; // c1 + c3
+        int64_t c1 = (s + p5 - p3 - p1) >> 1;
+        int64_t c3 = s - c1;
+        // fold c1 and c3 into c0 + c2 2^40 + c4 2^80
+        c0 += (c1 & mask) << 20;
+        c2 += (c1 >> 20) + ((c3 & mask) << 20);
+        c4 += c3 >> 20;
+        uint128_t r = uint64_t(c4) % p;
+        r = ((r << 40) + uint64_t(c2)) % p;
+        r = ((r << 40) + uint64_t(c0)) % p;
+        return uint64_t(r);
+    }
+
+    // out = the sum over pieces q and digits t of sums[q][j][t] 2^(20 t + q m_piece_bitsize)
+    void combine(Givaro::Integer &out, const double *sums, size_t j, size_t len) const
+    {
+        if (m_pieces == 1 || m_piece_bitsize == 20)
+        {
+            combine_digits(out.get_mpz(), sums, j, len, 0, m_pieces);
+            return;
+        }
+        // narrower pieces do not line up with the digits, each is carried on its own and shifted in
+        combine_digits(out.get_mpz(), sums, j, len, 0, 1);
+        Givaro::Integer piece;
+        for (size_t q = 1; q < m_pieces; q++)
+        {
+            combine_digits(piece.get_mpz(), sums, j, len, q, 1);
+            mpz_mul_2exp(piece.get_mpz(), piece.get_mpz(), q * m_piece_bitsize);
+            mpz_add(out.get_mpz(), out.get_mpz(), piece.get_mpz());
+        }
+    }
+
+    // out = the sum over the pieces q in [first, first + pieces) and digits t of
+    // sums[q][j][t] 2^(20 (t + q - first)), carried into limbs
+    void combine_digits(mpz_ptr out, const double *sums, size_t j, size_t len, size_t first, size_t pieces) const
+    {
+        size_t digits = m_cofactor_digits + (pieces - 1);
+        size_t n = (20 * digits + 64 + 63) / 64 + 1;
+        mp_limb_t *limbs = mpz_limbs_write(out, n);
+        const uint64_t mask = (uint64_t(1) << 20) - 1;
+        uint128_t carry = 0, buffer = 0;
+        size_t fill = 0, w = 0;
+        for (size_t t = 0; t < digits || carry; t++)
+        {
+            uint128_t v = carry;
+            for (size_t q = 0; q < pieces; q++)
+            {
+                if (t >= q && t - q < m_cofactor_digits)
+                {
+                    v += uint64_t(sums[((first + q) * len + j) * m_cofactor_digits + t - q]);
+                }
+            }
+            carry = v >> 20;
+            buffer |= uint128_t(uint64_t(v) & mask) << fill;
+            fill += 20;
+            if (fill >= 64)
+            {
+                limbs[w++] = mp_limb_t(buffer);
+                buffer >>= 64;
+                fill -= 64;
+            }
+        }
+        if (fill)
+        {
+            limbs[w++] = mp_limb_t(buffer);
+        }
+        assert(w <= n);
+        mpz_limbs_finish(out, w);
+    }
+};
+
+namespace SIM_RNS
+{
+
+/*
+    the same as fflas_new_sim_reduce, with the residues computed by crt (built on the basis of rns_field)
+*/
+template <class Int_Field, class RNS_Field>
+typename RNS_Field::Element_ptr blas_new_sim_reduce(
+    const BlasCRT &crt,
+    const std::vector<typename Int_Field::Element> &inputs,
+    const RNS_Field &rns_field)
+{
+    size_t len_inputs = inputs.size();
+    assert(len_inputs > 0);
+    assert(crt.count() == rns_field.rns()._size && "BlasCRT basis differs from the RNS field");
+    typename RNS_Field::Element_ptr output_A = FFLAS::fflas_new(rns_field, len_inputs);
+    crt.reduce(output_A._ptr, inputs.data(), len_inputs);
+    return output_A;
+}
+
+// the same with the inputs packed in a LimbMatrix
+template <typename RNS_Field>
+typename RNS_Field::Element_ptr blas_new_sim_reduce(
+    const BlasCRT &crt,
+    const LimbMatrix &inputs,
+    const RNS_Field &rns_field)
+{
+    assert(inputs.count() > 0);
+    assert(crt.count() == rns_field.rns()._size && "BlasCRT basis differs from the RNS field");
+    typename RNS_Field::Element_ptr output_A = FFLAS::fflas_new(rns_field, inputs.count());
+    crt.reduce(output_A._ptr, inputs);
+    return output_A;
+}
+
+/*
+    the same as fflas_new_sim_recover, with the integers recovered by crt (built on the basis of rns_field)
+*/
+template <class RNS_Field, class Int_Field>
+std::vector<typename Int_Field::Element> blas_new_sim_recover(
+    const BlasCRT &crt,
+    const RNS_Field &rns_field, typename RNS_Field::Element_ptr input_A,
+    size_t num_integers, const Int_Field &out_field)
+{
+    assert(crt.count() == rns_field.rns()._size && "BlasCRT basis differs from the RNS field");
+    std::vector<typename Int_Field::Element> output_vec(num_integers);
+    crt.recover(output_vec.data(), input_A._ptr, num_integers);
+    return output_vec;
+}
+
+} // namespace SIM_RNS
+
+#endif // H_BLAS_CRT
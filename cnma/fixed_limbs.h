@@ -0,0 +1,146 @@
+#if !defined(H_FIXED_LIMBS)
+#define H_FIXED_LIMBS
+
+#include "matrix.h"
+#include "reconstruct_hybrid.h"
+#include <cstddef>
+#include <cstdint>
+
+// Reductions of moderate size nonnegative integers (at most FIXED_LIMBS_MAX limbs) by
+// moduli 2^n - 1 and 2^n + 1 on stack arrays of a compile time number of limbs.
+// An input is copied once into a LIMBS limbs array and folded by every modulus with
+// mpn additions of n bit chunks, so the only heap traffic is the write of each residue.
+// The limb count is a template parameter so the copy and chunk extraction loops are
+// unrolled, the exponents stay runtime values (there are too many to instantiate).
+#if !defined(FIXED_LIMBS_MAX)
+#define FIXED_LIMBS_MAX 64
+#endif
+
+namespace CNMA
+{
+
+// an mpz view of a limb array, without allocating
+inline mpz_srcptr fixed_view(mpz_t view, const mp_limb_t *limbs, size_t size)
+{
+    while (size > 0 && limbs[size - 1] == 0)
+    {
+        size--;
+    }
+    return mpz_roinit_n(view, limbs, size);
+}
+
+// bits [start, start + n) of the LIMBS limbs of a into w limbs of out
+template <size_t LIMBS>
+inline void fixed_extract(mp_limb_t *out, size_t w, const mp_limb_t *a, uint64_t start, uint64_t n)
+{
+    size_t q = start / GMP_NUMB_BITS;
+    unsigned s = start % GMP_NUMB_BITS;
+    for (size_t j = 0; j < w; j++)
+    {
+        mp_limb_t lo = (q + j < LIMBS) ? a[q + j] : 0;
+        mp_limb_t hi = (q + j + 1 < LIMBS) ? a[q + j + 1] : 0;
+        out[j] = s ? (lo >> s) | (hi << (GMP_NUMB_BITS - s)) : lo;
+    }
+    size_t full = n / GMP_NUMB_BITS;
+    unsigned rem = n % GMP_NUMB_BITS;
+    for (size_t j = full; j < w; j++)
+    {
+        out[j] = (j == full && rem) ? out[j] & ((mp_limb_t(1) << rem) - 1) : 0;
+    }
+}
+
+/*
+    r = a mod 2^n + sign for an input of at most LIMBS limbs (already in a zero padded array),
+    sign is -1 or +1, the result may be unreduced by one modulus as with dc_reduce_minus,
+    t is a temporary supplied by the caller
+*/
+template <size_t LIMBS>
+void fixed_reduce(mpz_t r, const mp_limb_t *a, uint64_t n, int sign, mpz_t t)
+{
+    mpz_t view;
+    if (n >= uint64_t(LIMBS) * GMP_NUMB_BITS)
+    {
+        // a < 2^n already
+        mpz_set(r, fixed_view(view, a, LIMBS));
+        dc_reduce_hybrid(r, n, sign, t);
+        return;
+    }
+    // n bit chunks need w limbs, their sums one more for the carries
+    const size_t w = n / GMP_NUMB_BITS + 1;
+    mp_limb_t chunk[LIMBS + 1];
+    mp_limb_t acc[2][LIMBS + 2] = {};
+    // 2^n = -sign, so chunk i has the sign (-sign)^i
+    size_t i = 0;
+    for (uint64_t start = 0; start < uint64_t(LIMBS) * GMP_NUMB_BITS; start += n, i++)
+    {
+        mp_limb_t *sum = acc[(sign > 0) ? (i & 1) : 0];
+        fixed_extract<LIMBS>(chunk, w, a, start, n);
+        sum[w] += mpn_add_n(sum, sum, chunk, w);
+    }
+    if (sign < 0)
+    {
+        mpz_set(r, fixed_view(view, acc[0], w + 1));
+    }
+    else
+    {
+        mpz_t view_odd;
+        mpz_sub(r, fixed_view(view, acc[0], w + 1), fixed_view(view_odd, acc[1], w + 1));
+    }
+    // a few bits above n are left
+    dc_reduce_hybrid(r, n, sign, t);
+}
+
+// reduces a (at most LIMBS limbs, nonnegative) by every modulus 2^expo[f] + sign[f] into out[f]
+template <size_t LIMBS, typename Int>
+void fixed_reduce_many(Int *out, const mpz_t a, size_t count, const uint64_t expo[], const int sign[])
+{
+    mp_limb_t limbs[LIMBS] = {};
+    size_t size = mpz_size(a);
+    for (size_t j = 0; j < size; j++)
+    {
+        limbs[j] = mpz_getlimbn(a, j);
+    }
+    mpz_t t;
+    mpz_init2(t, LIMBS * GMP_NUMB_BITS);
+    for (size_t f = 0; f < count; f++)
+    {
+        fixed_reduce<LIMBS>(out[f].get_mpz(), limbs, expo[f], sign[f], t);
+    }
+    mpz_clear(t);
+}
+
+/*
+    use this method to reduce a by every modulus 2^expo[f] + sign[f] into out[f] (any type with
+    get_mpz()) on the fixed size path, returns false without touching out if a is negative or
+    larger than FIXED_LIMBS_MAX limbs, so the caller falls back to the mpz kernels
+*/
+template <typename Int>
+bool fixed_reduce_dispatch(Int *out, const mpz_t a, size_t count, const uint64_t expo[], const int sign[])
+{
+    if (mpz_sgn(a) < 0)
+    {
+        return false;
+    }
+    size_t size = mpz_size(a);
+    if (size <= 1)
+        fixed_reduce_many<1>(out, a, count, expo, sign);
+    else if (size <= 2)
+        fixed_reduce_many<2>(out, a, count, expo, sign);
+    else if (size <= 4)
+        fixed_reduce_many<4>(out, a, count, expo, sign);
+    else if (size <= 8)
+        fixed_reduce_many<8>(out, a, count, expo, sign);
+    else if (size <= 16)
+        fixed_reduce_many<16>(out, a, count, expo, sign);
+    else if (size <= 32)
+        fixed_reduce_many<32>(out, a, count, expo, sign);
+    else if (size <= FIXED_LIMBS_MAX && FIXED_LIMBS_MAX >= 64)
+        fixed_reduce_many<64>(out, a, count, expo, sign);
+    else
+        return false;
+    return true;
+}
+
+} // namespace CNMA
+
+#endif // H_FIXED_LIMBS
@@ -13,16 +13,20 @@ using namespace CNMA;
 
 void CNMA::dc_reduce_minus(mpz_t a, unsigned long int n)
 {
-    mpz_t t, p;
+    mpz_t t;
+    mpz_init(t);
+    dc_reduce_minus(a, n, t);
+    mpz_clear(t);
+}
+
+// t is a temporary supplied by the caller, so that a hot loop can reuse it
+void CNMA::dc_reduce_minus(mpz_t a, unsigned long int n, mpz_t t)
+{
     int s;
     int b;
     uint64_t k;
-    mpz_init(t);
-    mpz_init_set_ui(p, 1);
-    mpz_mul_2exp(p, p, n);
-    int cmp_val = mpz_cmp(a, p);
-
-    while (cmp_val >= 0)
+    // a >= 2^n
+    while (mpz_sgn(a) > 0 && mpz_sizeinbase(a, 2) > n)
     {
         s = mpz_sizeinbase(a, 2);
         b = (s - 1) / n + 1;
@@ -31,10 +35,7 @@ void CNMA::dc_reduce_minus(mpz_t a, unsigned long int n)
         mpz_tdiv_q_2exp(t, a, k);
         mpz_tdiv_r_2exp(a, a, k);
         mpz_add(a, a, t);
-        cmp_val = mpz_cmp(a, p);
     }
-    mpz_clear(t);
-    mpz_clear(p);
 }
 
 void CNMA::minadd(mpz_t res, mpz_t a, mpz_t b, int n)
@@ -3,6 +3,7 @@
 
 namespace CNMA {
 void dc_reduce_minus(mpz_t a, unsigned long int n);
+void dc_reduce_minus(mpz_t a, unsigned long int n, mpz_t t);
 void minadd(mpz_t res, mpz_t a, mpz_t b, int n);
 void minsub(mpz_t res, mpz_t a, mpz_t b, int n);
 void minmul(mpz_t res, mpz_t a, mpz_t b, int n);
@@ -16,20 +16,24 @@ void CNMA::dc_reduce_plus(mpz_t a, long unsigned int n)
 {
     mpz_t t;
     mpz_init(t);
-    dc_reduce_minus(a, 2 * n);
+    dc_reduce_plus(a, n, t);
+    mpz_clear(t);
+}
+
+// t is a temporary supplied by the caller, so that a hot loop can reuse it
+void CNMA::dc_reduce_plus(mpz_t a, long unsigned int n, mpz_t t)
+{
+    dc_reduce_minus(a, 2 * n, t);
     mpz_tdiv_q_2exp(t, a, n); // right shift
     mpz_tdiv_r_2exp(a, a, n); // 
     mpz_sub(a, a, t);
     if (mpz_cmp_ui(a, 0) < 0)
     {
-        mpz_t p;
-        mpz_init(p);
-        mpz_ui_pow_ui(p, 2, n);
-        mpz_add(a, a, p);
+        mpz_set_ui(t, 1);
+        mpz_mul_2exp(t, t, n);
+        mpz_add(a, a, t);
         mpz_add_ui(a, a, 1);
-        mpz_clear(p);
     }
-    mpz_clear(t);
 }
 
 void CNMA::plusadd(mpz_t res, mpz_t a, mpz_t b, int n)
@@ -97,3 +101,95 @@ void CNMA::get_mod_plus(mpz_t m, int n)
     mpz_ui_pow_ui(m, 2, n);
     mpz_add_ui(m, m, 1);
 }
+
+// r = a mod 2^n, a truncation to the low n bits
+void CNMA::reduce_pow2(mpz_t r, const mpz_t a, uint64_t n)
+{
+    mpz_fdiv_r_2exp(r, a, n);
+}
+
+// the number of powers 3^(2^j) dc_reduce_plus3 uses on inputs of up to bitsize bits
+size_t CNMA::pow3_squares_count(uint64_t bitsize, uint64_t n)
+{
+    size_t count = 1;
+    while ((uint64_t(1) << count) * n < bitsize)
+    {
+        count++;
+    }
+    return count;
+}
+
+// pow3[j] = 3^(2^j) for j < count
+void CNMA::pow3_squares(mpz_t *pow3, size_t count)
+{
+    mpz_set_ui(pow3[0], 3);
+    for (size_t j = 1; j < count; j++)
+    {
+        mpz_mul(pow3[j], pow3[j - 1], pow3[j - 1]);
+    }
+}
+
+void CNMA::dc_reduce_plus3(mpz_t a, const mpz_t m, uint64_t n)
+{
+    size_t count = pow3_squares_count(mpz_sizeinbase(a, 2), n);
+    mpz_t t, pow3[64];
+    mpz_init(t);
+    for (size_t j = 0; j < count; j++)
+    {
+        mpz_init(pow3[j]);
+    }
+    pow3_squares(pow3, count);
+    dc_reduce_plus3(a, m, n, pow3, count, t);
+    for (size_t j = 0; j < count; j++)
+    {
+        mpz_clear(pow3[j]);
+    }
+    mpz_clear(t);
+}
+
+// a = a mod m where m = 2^n + 3, so 2^(b * n) = (-3)^b (mod m):
+// a = hi * 2^(b * n) + lo is folded into lo + (-3)^b * hi, with b the largest power of two
+// up to half the blocks of n bits, so that 3^b is read from pow3 (see pow3_squares) rather than computed;
+// past the end of pow3 the last power is used and the input just takes more folds.
+// t is a temporary supplied by the caller, so that a hot loop can reuse it
+void CNMA::dc_reduce_plus3(mpz_t a, const mpz_t m, uint64_t n, const mpz_t *pow3, size_t pow3_count, mpz_t t)
+{
+    uint64_t s = mpz_sizeinbase(a, 2);
+    while (s > n + 1)
+    {
+        uint64_t half = ((s - 1) / n + 1) >> 1;
+        size_t j = 0;
+        while (j + 1 < pow3_count && (uint64_t(2) << j) <= half)
+        {
+            j++;
+        }
+        uint64_t b = uint64_t(1) << j;
+        mpz_tdiv_q_2exp(t, a, b * n);
+        mpz_tdiv_r_2exp(a, a, b * n);
+        mpz_mul(t, t, pow3[j]);
+        if (b & 1)
+        {
+            mpz_sub(a, a, t);
+        }
+        else
+        {
+            mpz_add(a, a, t);
+        }
+        s = mpz_sizeinbase(a, 2);
+    }
+    // |a| < 2^(n + 1) < 2 * m
+    while (mpz_sgn(a) < 0)
+    {
+        mpz_add(a, a, m);
+    }
+    while (mpz_cmp(a, m) >= 0)
+    {
+        mpz_sub(a, a, m);
+    }
+}
+
+// r = a mod p for a word size p, a single pass over the limbs of a
+void CNMA::reduce_word(mpz_t r, const mpz_t a, unsigned long p)
+{
+    mpz_set_ui(r, mpz_fdiv_ui(a, p));
+}
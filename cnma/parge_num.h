@@ -5,10 +5,18 @@ namespace CNMA {
     
 void dc_reduce_minus(mpz_t a, unsigned long int n);
 void dc_reduce_plus(mpz_t a, long unsigned int n);
+void dc_reduce_plus(mpz_t a, long unsigned int n, mpz_t t);
 void plusadd(mpz_t res, mpz_t a, mpz_t b, int n);
 void plussub(mpz_t res, mpz_t a, mpz_t b, int n);
 void plusmul(mpz_t res, mpz_t a, mpz_t b, int n);
 void get_mod_plus(mpz_t m, int n);
+// kernels for the first three moduli of the parge shift scheme
+void reduce_pow2(mpz_t r, const mpz_t a, uint64_t n);
+size_t pow3_squares_count(uint64_t bitsize, uint64_t n);
+void pow3_squares(mpz_t *pow3, size_t count);
+void dc_reduce_plus3(mpz_t a, const mpz_t m, uint64_t n);
+void dc_reduce_plus3(mpz_t a, const mpz_t m, uint64_t n, const mpz_t *pow3, size_t pow3_count, mpz_t t);
+void reduce_word(mpz_t r, const mpz_t a, unsigned long p);
 void bits(mpz_t r, mpz_t a, unsigned long int n, mp_bitcnt_t b);
 
 }
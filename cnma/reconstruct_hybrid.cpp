@@ -0,0 +1,142 @@
+#include "matrix.h"
+#include "reconstruct_hybrid.h"
+#include "marge_num.h"
+#include "parge_num.h"
+#include <assert.h>
+#include <givaro/givtimer.h>
+
+using namespace CNMA;
+using namespace std;
+
+// reduce a modulo 2^n + sign, sign is -1 (marge) or +1 (parge)
+void CNMA::dc_reduce_hybrid(mpz_t a, uint64_t n, int sign)
+{
+    mpz_t t;
+    mpz_init(t);
+    dc_reduce_hybrid(a, n, sign, t);
+    mpz_clear(t);
+}
+
+// t is a temporary supplied by the caller, so that a hot loop can reuse it
+void CNMA::dc_reduce_hybrid(mpz_t a, uint64_t n, int sign, mpz_t t)
+{
+    if (sign < 0)
+    {
+        dc_reduce_minus(a, n, t);
+    }
+    else if (mpz_sgn(a) >= 0)
+    {
+        dc_reduce_plus(a, n, t);
+    }
+    else
+    {
+        // dc_reduce_plus expects a nonnegative input
+        mpz_set_ui(t, 1);
+        mpz_mul_2exp(t, t, n);
+        mpz_add_ui(t, t, 1);
+        mpz_mod(a, a, t);
+    }
+}
+
+void CNMA::garner_hybrid(mpz_t a,               // output
+                         int N,                 // size of r[], expo[], sign[], m[], Mi[], work[]
+                         const mpz_t r[],       // remainders
+                         const uint64_t expo[], // array of exponents n as in moduli 2^n - 1 or 2^n + 1
+                         const int sign[],      // -1 for moduli 2^n - 1, +1 for moduli 2^n + 1
+                         const mpz_t m[],       // moduli
+                         const mpz_t Mi[],      // precomputed Mi (see precompute_Mi_marge)
+                         mpz_t work[])          // a work array, caller is responsible for initializing and freeing this for efficiency reason
+{
+    mpz_t scratch[2];
+    mpz_init(scratch[0]);
+    mpz_init(scratch[1]);
+    garner_hybrid(a, N, r, expo, sign, m, Mi, work, scratch);
+    mpz_clear(scratch[0]);
+    mpz_clear(scratch[1]);
+}
+
+// scratch holds two temporaries supplied by the caller, so that a hot loop can reuse them
+void CNMA::garner_hybrid(mpz_t a,               // output
+                         int N,                 // size of r[], expo[], sign[], m[], Mi[], work[]
+                         const mpz_t r[],       // remainders
+                         const uint64_t expo[], // array of exponents n as in moduli 2^n - 1 or 2^n + 1
+                         const int sign[],      // -1 for moduli 2^n - 1, +1 for moduli 2^n + 1
+                         const mpz_t m[],       // moduli
+                         const mpz_t Mi[],      // precomputed Mi (see precompute_Mi_marge)
+                         mpz_t work[],          // a work array, caller is responsible for initializing and freeing this for efficiency reason
+                         mpz_t scratch[])       // two temporaries, same
+{
+#if DEBUG_CNMA || TIME_CNMA
+    gmp_fprintf(stderr, "########## garner_hybrid ##########\n");
+#endif
+#if TIME_CNMA
+    Givaro::Timer timer;
+    timer.clear();
+    timer.start();
+#endif
+#if DEBUG_CNMA
+    for (int i = 0; i < N; i++)
+    {
+        gmp_fprintf(stderr, " - r[%d] = %Zd - m[%d] = %Zd\n", i, r[i], i, m[i]);
+    }
+#endif
+    assert(N > 0);
+    if (N == 1)
+    {
+        mpz_set(a, r[0]);
+        return;
+    }
+    mpz_set_ui(a, 0);
+    mpz_set(work[0], r[0]);
+    // initialize temporary vars
+    mpz_ptr t = scratch[0];
+    mpz_ptr temp = scratch[1];
+    // same as garner_marge and garner_parge_block, t * m[j] is a shift and an add or a sub
+    for (int i = 1; i < N; i++)
+    {
+        mpz_set(t, work[i - 1]);
+        for (int j = i - 2; j >= 0; j--)
+        {
+            // t = t * m[j] + work[j]
+            if (sign[j] < 0)
+            {
+                mpz_sub(temp, work[j], t);
+            }
+            else
+            {
+                mpz_add(temp, work[j], t);
+            }
+            mpz_mul_2exp(t, t, expo[j]);
+            mpz_add(t, t, temp);
+        }
+        mpz_sub(t, r[i], t);
+        mpz_mul(work[i], t, Mi[i]);
+        dc_reduce_hybrid(work[i], expo[i], sign[i], temp);
+    }
+    mpz_set(a, work[N - 1]);
+    for (int i = N - 2; i >= 0; i--)
+    {
+        // a = a * m[i] + work[i]
+        if (sign[i] < 0)
+        {
+            mpz_sub(temp, work[i], a);
+        }
+        else
+        {
+            mpz_add(temp, work[i], a);
+        }
+        mpz_mul_2exp(a, a, expo[i]);
+        mpz_add(a, a, temp);
+    }
+    // outputs in a
+#if DEBUG_CNMA
+    gmp_fprintf(stderr, " - a: %Zd\n", a);
+#endif
+#if TIME_CNMA
+    timer.stop();
+    cerr << "Timer: " << timer << endl;
+#endif
+#if DEBUG_CNMA || TIME_CNMA
+    gmp_fprintf(stderr, "########## garner_hybrid ends ##########\n");
+#endif
+}
@@ -0,0 +1,8 @@
+#include "matrix.h"
+
+namespace CNMA {
+void dc_reduce_hybrid(mpz_t a, uint64_t n, int sign);
+void dc_reduce_hybrid(mpz_t a, uint64_t n, int sign, mpz_t t);
+void garner_hybrid(mpz_t a, int N, const mpz_t r[], const uint64_t expo[], const int sign[], const mpz_t m[], const mpz_t Mi[], mpz_t work[]);
+void garner_hybrid(mpz_t a, int N, const mpz_t r[], const uint64_t expo[], const int sign[], const mpz_t m[], const mpz_t Mi[], mpz_t work[], mpz_t scratch[]);
+}
@@ -49,6 +49,24 @@ void CNMA::garner_marge(mpz_t a,               // output
                         const mpz_t m[],       // moduli of the form 2^n - 1
                         const mpz_t Mi[],      // precomputed Mi (see paper)
                         mpz_t work[])          // a work array, caller is responsible for initializing and freeing this for efficiency reason
+{
+    mpz_t scratch[2];
+    mpz_init(scratch[0]);
+    mpz_init(scratch[1]);
+    garner_marge(a, N, r, expo, m, Mi, work, scratch);
+    mpz_clear(scratch[0]);
+    mpz_clear(scratch[1]);
+}
+
+// scratch holds two temporaries supplied by the caller, so that a hot loop can reuse them
+void CNMA::garner_marge(mpz_t a,               // output
+                        int N,                 // size of r[], expo[], m[], Mi[], work[]
+                        const mpz_t r[],       // remainders
+                        const uint64_t expo[], // array of exponents n as in moduli 2^n - 1
+                        const mpz_t m[],       // moduli of the form 2^n - 1
+                        const mpz_t Mi[],      // precomputed Mi (see paper)
+                        mpz_t work[],          // a work array, caller is responsible for initializing and freeing this for efficiency reason
+                        mpz_t scratch[])       // two temporaries, same
 {
 #if DEBUG_CNMA || TIME_CNMA
     gmp_fprintf(stderr, "########## garner_marge ##########\n");
@@ -76,10 +94,8 @@ void CNMA::garner_marge(mpz_t a,               // output
     mpz_set_ui(a, 0);
     mpz_set(work[0], r[0]);
     // initialize temporary vars
-    mpz_t t;
-    mpz_init(t);
-    mpz_t temp;
-    mpz_init(temp);
+    mpz_ptr t = scratch[0];
+    mpz_ptr temp = scratch[1];
     // garner_marge main body
     // starting from line 7 in Eugene's paper
     for (int i = 1; i < N; i++)
@@ -97,7 +113,7 @@ void CNMA::garner_marge(mpz_t a,               // output
         mpz_sub(t, r[i], t);     // line 13
         mpz_mul(work[i], t, Mi[i]); // line 14
         // mpz_mod(work[i], temp, m[i]);
-        dc_reduce_minus(work[i], expo[i]);
+        dc_reduce_minus(work[i], expo[i], temp);
     }                        // end for line 15
     mpz_set(a, work[N - 1]); // line 16
     for (int i = N - 1; i >= 0; i--)
@@ -106,9 +122,6 @@ void CNMA::garner_marge(mpz_t a,               // output
         mpz_mul_2exp(a, a, expo[i]);
         mpz_add(a, a, temp);
     } // line for line 20
-    // free used temporary vars
-    mpz_clear(t);
-    mpz_clear(temp);
     // outputs in a
 #if DEBUG_CNMA
     gmp_fprintf(stderr, " - a: %Zd\n", a);
@@ -123,7 +136,7 @@ void CNMA::garner_marge(mpz_t a,               // output
 }
 
 // Mi: precomputed array
-void garner_simple_marge(mpz_t a, int N, const mpz_t r[], const mpz_t m[], const mpz_t Mi[])
+void CNMA::garner_simple_marge(mpz_t a, int N, const mpz_t r[], const mpz_t m[], const mpz_t Mi[])
 {
 #if DEBUG_CNMA
     gmp_fprintf(stderr, "########## garner_simple_marge ##########\n");
@@ -168,7 +181,7 @@ void garner_simple_marge(mpz_t a, int N, const mpz_t r[], const mpz_t m[], const
 #endif
 }
 
-void prod(mpz_t M, mpz_t Mi, mpz_t *m, int N)
+void CNMA::prod(mpz_t M, mpz_t Mi, mpz_t *m, int N)
 {
     mpz_set_ui(M, 1);
     mpz_t plchldr;
@@ -107,6 +107,25 @@ void CNMA::garner_parge_shift_mixed(mpz_t a,
                                     const mpz_t Mi[],         
                                     uint64_t coef,            
                                     mpz_t work[])             
+{
+    mpz_t scratch[2];
+    mpz_init(scratch[0]);
+    mpz_init(scratch[1]);
+    garner_parge_shift_mixed(a, N, r, bitsize, m, Mi, coef, work, scratch);
+    mpz_clear(scratch[0]);
+    mpz_clear(scratch[1]);
+}
+
+// scratch holds two temporaries supplied by the caller, so that a hot loop can reuse them
+void CNMA::garner_parge_shift_mixed(mpz_t a,                  
+                                    size_t N,                    
+                                    const mpz_t r[],          
+                                    const uint64_t bitsize[], 
+                                    const mpz_t m[],          
+                                    const mpz_t Mi[],         
+                                    uint64_t coef,            
+                                    mpz_t work[],
+                                    mpz_t scratch[])             
 {
 #if DEBUG_CNMA || TIME_MMA
     gmp_fprintf(stderr, "########## garner_parge_shift_mixed ##########\n");
@@ -134,10 +153,8 @@ void CNMA::garner_parge_shift_mixed(mpz_t a,
     mpz_set_ui(a, 0);
     mpz_set(work[0], r[0]);
     // initialize temporary vars
-    mpz_t t;
-    mpz_init(t);
-    mpz_t temp;
-    mpz_init(temp);
+    mpz_ptr t = scratch[0];
+    mpz_ptr temp = scratch[1];
     // garner_parge_shift_mixed main body
     // starting from line 7 in Eugene's paper
     for (size_t i = 1; i < N; i++)
@@ -204,9 +221,6 @@ void CNMA::garner_parge_shift_mixed(mpz_t a,
         mpz_mul_2exp(a, a, bitsize[0]);
         mpz_add(a, a, work[0]);
     }
-    // free used temporary vars
-    mpz_clear(t);
-    mpz_clear(temp);
     // outputs in a
 #if DEBUG_CNMA
     gmp_fprintf(stderr, " - a: %Zd\n", a);
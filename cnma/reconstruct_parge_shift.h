@@ -11,4 +11,6 @@ void garner_parge_shift_mixed(mpz_t a,                  // output
                               const mpz_t Mi[],         // precomputed Mi (see paper)
                               uint64_t coef,            // coefficient used to generate these parges
                               mpz_t work[]);            // a work workarray, caller is responsible for initializing and freeing this for efficiency reason
+// the same with two temporaries supplied by the caller in scratch[0] and scratch[1]
+void garner_parge_shift_mixed(mpz_t a, size_t N, const mpz_t r[], const uint64_t bitsize[], const mpz_t m[], const mpz_t Mi[], uint64_t coef, mpz_t work[], mpz_t scratch[]);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <stdlib.h>
 #include <gmp.h>
 #include <NTL/ZZ_p.h>
 #include <NTL/vec_ZZ_p.h>
@@ -11,11 +12,54 @@ extern "C" {
 #include <cblas.h>
 }
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "BlasCRT.h"
 
 using namespace std;
 NTL_CLIENT
 
+// a threaded BLAS spreads every product over the cores by itself, the six independent
+// products are only run on OpenMP threads when it is single threaded (eg. ATLAS' libcblas)
+extern "C" int openblas_get_num_threads(void) __attribute__((weak));
+
+static inline bool blas_threaded(){
+  return openblas_get_num_threads && openblas_get_num_threads() > 1;
+}
+
+static inline long max_threads(){
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+static inline long thread_num(){
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+template <class T>
+T * BlasCRT::workspace(T *&buf, long &cap, long n){
+  if (n > cap){
+    free(buf);
+    void *data = NULL;
+    if (posix_memalign(&data, 64, n * sizeof(T)) != 0){
+      cout << "error in BlasCRT: cannot allocate a workspace of " << n << " entries\n";
+      exit(-1);
+    }
+    buf = (T *) data;
+    cap = n;
+  }
+  return buf;
+}
+
 
 #define SIZE(p) (((long *) (p))[1])
 
@@ -219,7 +263,9 @@ long BlasCRT::split (double *data, long step, const ZZ_p& z){
 }
 
 // we add the construction of another matrix using powers of 2^60
-BlasCRT::BlasCRT(){
+BlasCRT::BlasCRT()
+  : coeffsBuf(NULL), resBuf(NULL), splitBuf(NULL), outputBuf(NULL),
+    coeffsCap(0), resCap(0), splitCap(0), outputCap(0) {
   size = NumBits(ZZ_p::modulus()); // in bits
   size = 1 + (size / 20);
 
@@ -340,6 +386,10 @@ BlasCRT::BlasCRT(){
 BlasCRT::~BlasCRT(){
   delete[] reductionMatrix;
   delete[] crtMatrix;
+  free(coeffsBuf);
+  free(resBuf);
+  free(splitBuf);
+  free(outputBuf);
 }
 
 // reduces a vector of ZZ_p modulo the current primes
@@ -350,8 +400,10 @@ void BlasCRT::reduce(Unique2DArray<long>& a, const vec_ZZ_p& coeffs) {
 
   tt = GetTime();
   long len = coeffs.length();
-  double * mat_coeffs = new double[size60 * len * 6]; // was: size * len = size60 * 3 * len
-  double * mat_res = new double[numPrimes * len * 6]; // was: 3 * numPrimes * len
+  double * mat_coeffs = workspace(coeffsBuf, coeffsCap, size60 * len * 6); // was: size * len = size60 * 3 * len
+  double * mat_res = workspace(resBuf, resCap, numPrimes * len * 6); // was: 3 * numPrimes * len
+  // one split buffer per thread
+  double * buffers = workspace(splitBuf, splitCap, size * max_threads());
 
   long size_of_one_mat_coeffs = size60 * len;
   double * mat_coeffs_0 = mat_coeffs;
@@ -370,18 +422,13 @@ void BlasCRT::reduce(Unique2DArray<long>& a, const vec_ZZ_p& coeffs) {
   double * mat_res_5 = mat_res + 5*size_of_one_mat_res;
 
   long size_of_one_mat_red = numPrimes * size60;
-  double * reductionMatrix_0 = reductionMatrix;
-  double * reductionMatrix_1 = reductionMatrix + 1*size_of_one_mat_red;
-  double * reductionMatrix_2 = reductionMatrix + 2*size_of_one_mat_red;
-  double * reductionMatrix_3 = reductionMatrix + 3*size_of_one_mat_red;
-  double * reductionMatrix_4 = reductionMatrix + 4*size_of_one_mat_red;
-  double * reductionMatrix_5 = reductionMatrix + 5*size_of_one_mat_red;
-  cout << " alloc: " << GetTime()-tt << endl;
+  BLASCRT_LOG(" alloc: ", tt);
 
 
   tt = GetTime();
-  double * buffer = new double[size];
+#pragma omp parallel for schedule(static)
   for (long i = 0; i < len; i++){
+    double * buffer = buffers + size * thread_num();
     long count = split(buffer, 1, coeffs[i]);
     for (long j = count; j < size; j++)
       buffer[j] = 0;
@@ -394,7 +441,7 @@ void BlasCRT::reduce(Unique2DArray<long>& a, const vec_ZZ_p& coeffs) {
       mat_coeffs_2[j*len + i] = a2;
     }
   }
-  delete[] buffer;
+#pragma omp parallel for schedule(static)
   for (long i = 0; i < size60*len; i++){
     double a0 = mat_coeffs_0[i];
     double a1 = mat_coeffs_1[i];
@@ -404,59 +451,31 @@ void BlasCRT::reduce(Unique2DArray<long>& a, const vec_ZZ_p& coeffs) {
     mat_coeffs_4[i] = s+a2;
     mat_coeffs_5[i] = s-a2;
   }
-  cout << " split: " << GetTime()-tt << endl;
+  BLASCRT_LOG(" split: ", tt);
 
  
+  // the six products are independent, one per thread unless the BLAS is threaded
   tt = GetTime();
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_0, size60, 
-	      mat_coeffs_0, len, 
-	      0.0, 
-	      mat_res_0, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_1, size60, 
-	      mat_coeffs_1, len, 
-	      0.0, 
-	      mat_res_1, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_2, size60, 
-	      mat_coeffs_2, len, 
-	      0.0, 
-	      mat_res_2, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_3, size60, 
-	      mat_coeffs_3, len, 
-	      0.0, 
-	      mat_res_3, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_4, size60, 
-	      mat_coeffs_4, len, 
-	      0.0, 
-	      mat_res_4, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      numPrimes, len, size60, 
-	      1.0, 
-	      reductionMatrix_5, size60, 
-	      mat_coeffs_5, len, 
-	      0.0, 
-	      mat_res_5, len);
-  cout << " matrix product: " << GetTime()-tt << endl;
+#pragma omp parallel for schedule(static) if (!blas_threaded())
+  for (long m = 0; m < 6; m++){
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
+		numPrimes, len, size60, 
+		1.0, 
+		reductionMatrix + m*size_of_one_mat_red, size60, 
+		mat_coeffs + m*size_of_one_mat_coeffs, len, 
+		0.0, 
+		mat_res + m*size_of_one_mat_res, len);
+  }
+  BLASCRT_LOG(" matrix product: ", tt);
 
 
+  // the ZZ_p context may be thread local, the primes are read before the parallel loop
   tt = GetTime();
   const long two_fourty = 1L << 40;
+  const long *primes = ZZ_p::GetFFTInfo()->prime.elts();
+#pragma omp parallel for schedule(static)
   for (long j = 0; j < numPrimes; j++){
-    long p = ZZ_p::GetFFTInfo()->prime[j];
+    long p = primes[j];
     mulmod_t inv_p = PrepMulMod(p);
     mulmod_precon_t two_fourty_prec = PrepMulModPrecon(two_fourty, p, inv_p);
     long *aj = &a[j][0];
@@ -484,12 +503,7 @@ void BlasCRT::reduce(Unique2DArray<long>& a, const vec_ZZ_p& coeffs) {
       aj[i] = AddMod(res, c0, p);
     }
   }
-  cout << " unsplit: " << GetTime()-tt << endl;
-
-  tt = GetTime();
-  delete[] mat_coeffs;
-  delete[] mat_res;
-  cout << " free: " << GetTime()-tt << endl;
+  BLASCRT_LOG(" unsplit: ", tt);
 }
 
 
@@ -506,14 +520,8 @@ void BlasCRT::CRT(vec_ZZ& coeffs, const vec_vec_long& a) {
   const long s3 = sizeM/3;
 
   long size_one_mat = s3*numPrimes;
-  double *crtMatrix0 = crtMatrix;
-  double *crtMatrix1 = crtMatrix + size_one_mat;
-  double *crtMatrix2 = crtMatrix + 2*size_one_mat;
-  double *crtMatrix3 = crtMatrix + 3*size_one_mat;
-  double *crtMatrix4 = crtMatrix + 4*size_one_mat;
-  double *crtMatrix5 = crtMatrix + 5*size_one_mat;
 
-  double * mat_residues = new double[numPrimes*6*len];
+  double * mat_residues = workspace(coeffsBuf, coeffsCap, numPrimes*6*len);
   long size_of_one_mat1 = numPrimes*len;
   double * mat_residues0 = mat_residues;
   double * mat_residues1 = mat_residues + 1*size_of_one_mat1;
@@ -522,7 +530,7 @@ void BlasCRT::CRT(vec_ZZ& coeffs, const vec_vec_long& a) {
   double * mat_residues4 = mat_residues + 4*size_of_one_mat1;
   double * mat_residues5 = mat_residues + 5*size_of_one_mat1;
 
-  double * mat_result = new double[sizeM*2*len];
+  double * mat_result = workspace(resBuf, resCap, sizeM*2*len);
   long size_of_one_mat2 = s3*len;
   double * mat_result0 = mat_result;
   double * mat_result1 = mat_result + 1*size_of_one_mat2;
@@ -530,10 +538,13 @@ void BlasCRT::CRT(vec_ZZ& coeffs, const vec_vec_long& a) {
   double * mat_result3 = mat_result + 3*size_of_one_mat2;
   double * mat_result4 = mat_result + 4*size_of_one_mat2;
   double * mat_result5 = mat_result + 5*size_of_one_mat2;
-  cout << "  alloc: " << GetTime()-tt << endl;
+
+  unsigned long * output = workspace(outputBuf, outputCap, sizeM);
+  BLASCRT_LOG("  alloc: ", tt);
 
 
   tt = GetTime();
+#pragma omp parallel for schedule(static)
   for (long i = 0; i < numPrimes; i++){
     for (long j = 0; j < len; j++){
       long tmp = a[i][j];
@@ -549,55 +560,24 @@ void BlasCRT::CRT(vec_ZZ& coeffs, const vec_vec_long& a) {
       mat_residues5[i*len + j] = a2m0+a1;
     }
   }
-  cout << "  setup: " << GetTime()-tt << endl;
+  BLASCRT_LOG("  setup: ", tt);
 
+  // the six products are independent, one per thread unless the BLAS is threaded
   tt = GetTime();
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix0, numPrimes, 
-	      mat_residues0, len, 
-	      0.0, 
-	      mat_result0, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix1, numPrimes, 
-	      mat_residues1, len, 
-	      0.0, 
-	      mat_result1, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix2, numPrimes, 
-	      mat_residues2, len, 
-	      0.0, 
-	      mat_result2, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix3, numPrimes, 
-	      mat_residues3, len, 
-	      0.0, 
-	      mat_result3, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix4, numPrimes, 
-	      mat_residues4, len, 
-	      0.0, 
-	      mat_result4, len);
-  cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-	      s3, len, numPrimes, 
-	      1.0, 
-	      crtMatrix5, numPrimes, 
-	      mat_residues5, len, 
-	      0.0, 
-	      mat_result5, len);
-  cout << "  matrix product: " << GetTime()-tt << endl;
+#pragma omp parallel for schedule(static) if (!blas_threaded())
+  for (long m = 0; m < 6; m++){
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
+		s3, len, numPrimes, 
+		1.0, 
+		crtMatrix + m*size_one_mat, numPrimes, 
+		mat_residues + m*size_of_one_mat1, len, 
+		0.0, 
+		mat_result + m*size_of_one_mat2, len);
+  }
+  BLASCRT_LOG("  matrix product: ", tt);
 
+  // the ZZ are written one after the other, NTL may not be built thread safe
   tt = GetTime();
-  unsigned long * output = new unsigned long[sizeM];
   for (long j = 0; j < len; j++){
     unsigned long res = 0;
     for (long i = 0; i < s3; i++){
@@ -625,13 +605,5 @@ void BlasCRT::CRT(vec_ZZ& coeffs, const vec_vec_long& a) {
     }
     mpz_import(coeffs[j], sizeM, ceil((double)sizeM * 20.0/64.0), output);
   }
-  cout << "  combine: " << GetTime()-tt << endl;
-
-  
-  tt = GetTime();
-  delete[] output;
-  delete[] mat_residues;
-  delete[] mat_result;
-  cout << "  free: " << GetTime()-tt << endl;
-
+  BLASCRT_LOG("  combine: ", tt);
 }
@@ -12,6 +12,17 @@
 
 NTL_CLIENT
 
+// the timings of the stages of the multiplication, reduce and CRT are printed with -DBLASCRT_VERBOSE=1
+#ifndef BLASCRT_VERBOSE
+#define BLASCRT_VERBOSE 0
+#endif
+
+#if BLASCRT_VERBOSE
+#define BLASCRT_LOG(label, tt) (cout << label << GetTime()-(tt) << endl)
+#else
+#define BLASCRT_LOG(label, tt) ((void) (tt))
+#endif
+
 class BlasCRT
 {
 
@@ -19,6 +30,14 @@ class BlasCRT
     double *reductionMatrix; // for words of 60 bits
     double *crtMatrix;
 
+    // workspaces of reduce and CRT, 64 bytes aligned, sized on first use and only grown after,
+    // so that repeated calls of the same size do not allocate
+    double *coeffsBuf, *resBuf, *splitBuf;
+    unsigned long *outputBuf;
+    long coeffsCap, resCap, splitCap, outputCap;
+    template <class T>
+    static T *workspace(T *&buf, long &cap, long n);
+
   public:
     // size is in 20 bits, size60 in 60 bits
     long size, size60, sizeM, numPrimes;
@@ -30,6 +49,10 @@ class BlasCRT
 
     BlasCRT();
     ~BlasCRT();
+
+  private:
+    BlasCRT(const BlasCRT &);
+    BlasCRT &operator=(const BlasCRT &);
 };
 
 #endif /* BIGINTMAT_H_ */
@@ -7,6 +7,7 @@
 #include <NTL/ZZX.h>
 #include <NTL/FFT.h>
 #include <gmp.h>
+#include <memory>
 
 #include "BlasCRT.h"
 
@@ -49,7 +50,7 @@ void my_ToFFTRep(FFTRep& y, const ZZ_pX& x, long k, BlasCRT& blas_crt){
 
    tt = GetTime();
    blas_crt.reduce(y.tbl, x.rep);
-   cout << "mod: " << GetTime()-tt << endl;
+   BLASCRT_LOG("mod: ", tt);
 
    tt = GetTime();
    for (i = 0; i < nprimes; i++) {
@@ -58,14 +59,14 @@ void my_ToFFTRep(FFTRep& y, const ZZ_pX& x, long k, BlasCRT& blas_crt){
        yp[j] = 0;
      }
    }
-   cout << "pad: " << GetTime()-tt << endl;
+   BLASCRT_LOG("pad: ", tt);
 
    tt = GetTime();
    for (i = 0; i < nprimes; i++) {
       long *yp = &y.tbl[i][0];
       FFTFwd(yp, yp, k, i);
    }
-   cout << "FFT: " << GetTime()-tt << endl;
+   BLASCRT_LOG("FFT: ", tt);
 
 }
 
@@ -103,7 +104,7 @@ void my_FromFFTRep(ZZ_pX& x, FFTRep& y, long hi, BlasCRT& blas_crt){
       long *yp = &y.tbl[i][0];
       FFTRev1(yp, yp, k, i);
    }
-   cout << "iFFT: " << GetTime()-tt << endl;
+   BLASCRT_LOG("iFFT: ", tt);
 
    hi = min(hi, n-1);
    l = hi+1;
@@ -126,13 +127,13 @@ void my_FromFFTRep(ZZ_pX& x, FFTRep& y, long hi, BlasCRT& blas_crt){
       }
       qtab[j] = long(yd + 0.5);
    }
-   cout << "preprocess: " << GetTime()-tt << endl;
+   BLASCRT_LOG("preprocess: ", tt);
 
    tt = GetTime();
    vec_ZZ vZ;
    vZ.SetLength(l);
    blas_crt.CRT(vZ, aa);
-   cout << "CRT: " << GetTime()-tt << endl;
+   BLASCRT_LOG("CRT: ", tt);
 
    // there is some Montgomery stuff here
    tt = GetTime();
@@ -140,7 +141,7 @@ void my_FromFFTRep(ZZ_pX& x, FFTRep& y, long hi, BlasCRT& blas_crt){
       MulAddTo(vZ[j], FFTInfo->MinusMModP, qtab[j]);
       FFTInfo->reduce_struct.eval(x.rep[j].LoopHole(), vZ[j]);
    }
-   cout << "Montgomery: " << GetTime()-tt << endl;
+   BLASCRT_LOG("Montgomery: ", tt);
    
    x.normalize();
    delete[] qtab;
@@ -152,6 +153,20 @@ void my_FromFFTRep(ZZ_pX& x, FFTRep& y, long hi, BlasCRT& blas_crt){
 /*-----------------------------------------------------------------------*/
 /*-----------------------------------------------------------------------*/
 
+// the BlasCRT of the current modulus, rebuilt only when the modulus changes
+// so that its matrices and workspaces are reused across multiplications;
+// one per thread, as the ZZ_p modulus may be, and freed with the thread
+BlasCRT& current_blas_crt(){
+  thread_local std::unique_ptr<BlasCRT> blas_crt;
+  thread_local ZZ modulus;
+  if (!blas_crt || modulus != ZZ_p::modulus()){
+    blas_crt.reset();
+    blas_crt.reset(new BlasCRT());
+    modulus = ZZ_p::modulus();
+  }
+  return *blas_crt;
+}
+
 void my_FFTMul(ZZ_pX& x, const ZZ_pX& a, const ZZ_pX& b){
   long k, d;
   
@@ -160,8 +175,8 @@ void my_FFTMul(ZZ_pX& x, const ZZ_pX& a, const ZZ_pX& b){
     return;
   }
   double tt = GetTime();
-  BlasCRT blas_crt = BlasCRT();
-  cout << "create: " << GetTime()-tt << endl;
+  BlasCRT& blas_crt = current_blas_crt();
+  BLASCRT_LOG("create: ", tt);
   
   d = deg(a) + deg(b);
   k = NextPowerOfTwo(d+1);
@@ -0,0 +1,76 @@
+#if !defined(H_FREIVALDS)
+#define H_FREIVALDS
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SIM_RNS
+{
+
+// the check prime used to verify recovered products, 2^61 - 1
+const uint64_t FREIVALDS_CHECK_PRIME = (uint64_t(1) << 61) - 1;
+
+// dot product of u (entries that fit in an uint64_t) and v (entries below p) modulo p
+template <typename T>
+inline uint64_t freivalds_dot(uint64_t p, const T *u, const uint64_t *v, size_t len)
+{
+    if (p <= (uint64_t(1) << 32))
+    {
+        // the slice primes: products of residues fit in 64 bits, so they are summed as they
+        // are and the sum is only reduced once block of them could overflow it
+        const uint64_t block = (~uint64_t(0) - (p - 1)) / ((p - 1) * (p - 1));
+        uint64_t acc = 0;
+        uint64_t pending = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            acc += ((uint64_t)u[i] % p) * v[i];
+            if (++pending == block)
+            {
+                acc %= p;
+                pending = 0;
+            }
+        }
+        return acc % p;
+    }
+    // the check prime: 128 bits products
+    typedef unsigned __int128 uint128_t;
+    uint64_t acc = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        acc = (uint64_t)((acc + (uint128_t)((uint64_t)u[i] % p) * v[i]) % p);
+    }
+    return acc;
+}
+
+/*
+    Freivalds check of C == A * B modulo p with the random vector x, where A is
+    dim_m x dim_n, B is dim_n x dim_k, C is dim_m x dim_k (row major, contiguous)
+    and x has dim_k entries below p. Entries of A, B and C may be unreduced as
+    long as they fit in an uint64_t. Costs O(dim_m * dim_n + dim_n * dim_k + dim_m * dim_k)
+    and wrongly accepts a bad product with probability at most 1 / p.
+*/
+template <typename T>
+inline bool freivalds(uint64_t p, size_t dim_m, size_t dim_n, size_t dim_k,
+                      const T *A, const T *B, const T *C, const uint64_t *x)
+{
+    // y = B * x
+    std::vector<uint64_t> y(dim_n);
+    for (size_t r = 0; r < dim_n; r++)
+    {
+        y[r] = freivalds_dot(p, B + r * dim_k, x, dim_k);
+    }
+    // compare A * y with C * x
+    for (size_t r = 0; r < dim_m; r++)
+    {
+        if (freivalds_dot(p, A + r * dim_n, y.data(), dim_n) != freivalds_dot(p, C + r * dim_k, x, dim_k))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace SIM_RNS
+
+#endif // H_FREIVALDS
@@ -0,0 +1,47 @@
+#if !defined(H_GEN_COPRIME_LIST)
+#define H_GEN_COPRIME_LIST
+
+#include "gen_coprime_abstract.h"
+#include <gmp++/gmp++.h>
+#include <cassert>
+#include <vector>
+
+// a coprime basis given as a list of moduli, eg. loaded from a PlanCache (see plan_cache.h)
+// the moduli are kept in the given order, the caller is responsible for them being coprime
+template <typename T>
+class GenCoprimeList : public GenCoprimeAbstract<T>
+{
+  protected:
+    Givaro::Integer _product = 1;
+    size_t _max_index = 0;
+
+    static double from_integer(const Givaro::Integer &v, const double *) { return mpz_get_d(v.get_mpz()); }
+    static Givaro::Integer from_integer(const Givaro::Integer &v, const Givaro::Integer *) { return v; }
+
+  public:
+    inline virtual Givaro::Integer product() const override { return _product; }
+    inline virtual uint_fast64_t product_bitsize() const override { return product().bitsize(); }
+    inline virtual uint_fast64_t max_bitsize() const override { return Givaro::Integer(max()).bitsize(); }
+    inline virtual const T &max() const override { return this->operator[](_max_index); }
+
+  public:
+    GenCoprimeList(const std::vector<Givaro::Integer> &moduli)
+    {
+        assert(moduli.size() > 0 && "need at least one moduli");
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            this->push_back(from_integer(moduli[i], (const T *)0));
+            _product *= moduli[i];
+            if (moduli[i] > moduli[_max_index])
+            {
+                _max_index = i;
+            }
+        }
+    }
+
+    ~GenCoprimeList() = default;
+    GenCoprimeList(const GenCoprimeList &) = delete;
+    GenCoprimeList &operator=(const GenCoprimeList &) = delete;
+};
+
+#endif // H_GEN_COPRIME_LIST
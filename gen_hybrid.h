@@ -0,0 +1,130 @@
+#if !defined(H_GEN_HYBRID)
+#define H_GEN_HYBRID
+
+#include <gmp++/gmp++.h>
+#include "gen_coprime_abstract.h"
+#include "gen_prime_table.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+// generates a mix of marge numbers 2^p - 1 and parge numbers 2^e + 1, largest first,
+// until the product is at least 2^product_bound, each modulus has at most max_bound bits:
+//  - the marge exponents p are the odd primes up to max_bound,
+//  - the parge exponents are e_k = 2^k * (the largest odd number with e_k < max_bound),
+//    one for each 2-adic valuation k.
+// Every marge exponent is odd so v2(p) = 0 <= v2(e) and the two families are coprime
+// (see Coprime::marge_parge), so for a product bound there are about twice as many moduli
+// of nearly max_bound bits as with a single family.
+class GenHybrid : public GenCoprimeAbstract<Givaro::Integer>
+{
+  protected:
+    Givaro::Integer _product = 1;
+    std::vector<uint64_t> _expos;
+    std::vector<int> _signs;
+
+  public:
+    inline virtual Givaro::Integer product() const override { return _product; }
+    inline virtual uint_fast64_t product_bitsize() const override { return product().bitsize(); }
+    inline virtual uint_fast64_t max_bitsize() const override { return max().bitsize(); }
+    inline virtual const Givaro::Integer &max() const override { return this->operator[](0); }
+
+    // the modulus i is 2^expo(i) + sign(i)
+    inline uint64_t expo(size_t i) const { return _expos[i]; }
+    inline int sign(size_t i) const { return _signs[i]; }
+
+    /*
+        use this method to get the (exponent, sign) pairs of the moduli without generating them,
+        returns false if there are not enough moduli of at most max_bound bits
+    */
+    static bool exponents_for(uint_fast64_t product_bound, uint_fast64_t max_bound, std::vector<std::pair<uint64_t, int>> &expos)
+    {
+        assert(max_bound >= 3 && max_bound < (uint64_t(1) << 62));
+        std::vector<std::pair<uint64_t, int>> all;
+        std::vector<uint64_t> primes = PrimeTable::small_primes(max_bound + 1);
+        for (size_t i = 0; i < primes.size(); i++)
+        {
+            if (primes[i] > 2)
+            {
+                all.push_back(std::make_pair(primes[i], -1)); // 2^p - 1 has p bits
+            }
+        }
+        const uint64_t max_expo = max_bound - 1; // 2^e + 1 has e + 1 bits
+        for (uint64_t low = 1; low <= max_expo; low <<= 1)
+        {
+            uint64_t odd = max_expo / low;
+            if (odd % 2 == 0)
+            {
+                odd--;
+            }
+            all.push_back(std::make_pair(odd * low, +1));
+        }
+        // largest moduli (by bitsize) first
+        std::sort(all.begin(), all.end(), [](const std::pair<uint64_t, int> &x, const std::pair<uint64_t, int> &y) {
+            return x.first + (x.second > 0) > y.first + (y.second > 0);
+        });
+        expos.clear();
+        uint64_t bits = 0;
+        for (size_t i = 0; i < all.size() && bits < product_bound; i++)
+        {
+            expos.push_back(all[i]);
+            // 2^p - 1 has just under p bits
+            bits += all[i].first - (all[i].second < 0);
+        }
+        return bits >= product_bound;
+    }
+
+  public:
+    GenHybrid(uint_fast64_t product_bound, uint_fast64_t max_bound)
+    {
+        assert(product_bound > max_bound && "The product of moduli must be greater than any moduli.");
+        std::vector<std::pair<uint64_t, int>> expos;
+        if (!exponents_for(product_bound, max_bound, expos))
+        {
+            std::cerr << "GenHybrid: there are not enough marge and parge numbers of at most " << max_bound
+                      << " bits for a product of " << product_bound << " bits, consider increasing max bound." << std::endl;
+            abort();
+        }
+        for (size_t i = 0; i < expos.size(); i++)
+        {
+            Givaro::Integer t = 1;
+            t <<= expos[i].first;
+            t += expos[i].second;
+            this->push_back(t); // t = 2^e +/- 1
+            _product *= t;
+            _expos.push_back(expos[i].first);
+            _signs.push_back(expos[i].second);
+        }
+#if CHECK_MMC
+        std::cerr << "CHECK_MMC: checking correctness..." << std::endl;
+        std::vector<uint64_t> marge_expos, parge_expos;
+        for (size_t i = 0; i < _expos.size(); i++)
+        {
+            (_signs[i] < 0 ? marge_expos : parge_expos).push_back(_expos[i]);
+        }
+        bool coprime = Coprime::marge_exponents_are_distinct_primes(marge_expos) && Coprime::parge_exponents_coprime(parge_expos);
+        for (size_t i = 0; i < marge_expos.size() && coprime; i++)
+        {
+            for (size_t j = 0; j < parge_expos.size() && coprime; j++)
+            {
+                coprime = Coprime::marge_parge(marge_expos[i], parge_expos[j]);
+            }
+        }
+        if (!coprime)
+        {
+            std::cerr << "GenHybrid is not generating coprimes." << std::endl
+                      << " - got: " << *this << std::endl;
+            abort();
+        }
+        std::cerr << "CHECK_MMC: passed." << std::endl;
+#endif
+    }
+
+    ~GenHybrid() = default;
+    GenHybrid(GenHybrid &) = delete;
+};
+
+#endif // H_GEN_HYBRID
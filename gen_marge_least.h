@@ -3,6 +3,7 @@
 
 #include <gmp++/gmp++.h>
 #include "gen_prime.h"
+#include "gen_prime_table.h"
 #include <cmath>
 #include <iterator>
 
@@ -12,7 +13,6 @@
 class GenMargeLeast : public GenCoprimeAbstract<Givaro::Integer>
 {
   protected:
-    Givaro::IntPrimeDom _int_prime_domain;
     Givaro::Integer _product = 1;
 
   public:
@@ -26,31 +26,26 @@ class GenMargeLeast : public GenCoprimeAbstract<Givaro::Integer>
     {
         assert(product_bound > min_bound && "The product of moduli must be greater than any moduli.");
         assert(min_bound >= 0);
-        Givaro::Integer prime_expo = min_bound;
-        _int_prime_domain.nextprimein(prime_expo);
+        // exponents are distinct primes, so the moduli are coprime (gcd(2^a - 1, 2^b - 1) = 2^gcd(a, b) - 1)
+        std::vector<uint64_t> expos;
+        uint64_t prime_expo = PrimeTable::next_prime(min_bound);
         while (product_bitsize() < product_bound)
         {
             Givaro::Integer marge(1);
-            marge <<= (prime_expo % product_bound);
+            marge <<= prime_expo;
             marge--;
             // marge = 2^prime_expo - 1
             this->push_back(marge);
             _product *= marge;
-            _int_prime_domain.nextprimein(prime_expo);
+            expos.push_back(prime_expo);
+            prime_expo = PrimeTable::next_prime(prime_expo);
         }
 #if CHECK_MMC
-        size_t N = this->count();
-        for (size_t i = 0; i < N; i++)
+        if (!Coprime::marge_exponents_are_distinct_primes(expos))
         {
-            for (size_t j = 0; j < N; j++)
-            {
-                if (i != j && gcd(this->val(i), this->val(j)) != 1)
-                {
-                    cerr << "GenMargeLeast is not generating coprimes." << endl
-                         << " - got: " << this->val(i) << " and " << this->val(j) << endl;
-                    abort();
-                }
-            }
+            cerr << "GenMargeLeast is not generating coprimes." << endl
+                 << " - got: " << *this << endl;
+            abort();
         }
 #endif
         assert(max() >= 3);
@@ -3,6 +3,7 @@
 
 #include <gmp++/gmp++.h>
 #include "gen_prime.h"
+#include "gen_prime_table.h"
 #include <cmath>
 #include <iterator>
 
@@ -12,7 +13,6 @@
 class GenMargeMost : public GenCoprimeAbstract<Givaro::Integer>
 {
   protected:
-    Givaro::IntPrimeDom _int_prime_domain;
     Givaro::Integer _product = 1;
 
   public:
@@ -26,8 +26,9 @@ class GenMargeMost : public GenCoprimeAbstract<Givaro::Integer>
     {
         assert(product_bound > max_bound && "The product of moduli must be greater than any moduli.");
         assert(max_bound > 1 && "Any moduli must be at least 2 bits");
-        Givaro::Integer prime_expo = max_bound;
-        _int_prime_domain.prevprimein(prime_expo);
+        // exponents are distinct primes, so the moduli are coprime (gcd(2^a - 1, 2^b - 1) = 2^gcd(a, b) - 1)
+        std::vector<uint64_t> expos;
+        uint64_t prime_expo = max_bound > 2 ? PrimeTable::prev_prime(max_bound) : 0;
         while (product_bitsize() < product_bound)
         {
             if (prime_expo < 2)
@@ -36,26 +37,20 @@ class GenMargeMost : public GenCoprimeAbstract<Givaro::Integer>
                 abort();
             }
             Givaro::Integer marge(1);
-            marge <<= (prime_expo % max_bound);
+            marge <<= prime_expo;
             marge--;
             // marge = 2^prime_expo - 1
             this->push_back(marge);
             _product *= marge;
-            _int_prime_domain.prevprimein(prime_expo);
+            expos.push_back(prime_expo);
+            prime_expo = prime_expo > 2 ? PrimeTable::prev_prime(prime_expo) : 0;
         }
 #if CHECK_MMC
-        size_t N = this->count();
-        for (size_t i = 0; i < N; i++)
+        if (!Coprime::marge_exponents_are_distinct_primes(expos))
         {
-            for (size_t j = 0; j < N; j++)
-            {
-                if (i != j && gcd(this->val(i), this->val(j)) != 1)
-                {
-                    cerr << "GenMargeMost is not generating coprimes." << endl
-                         << " - got: " << this->val(i) << " and " << this->val(j) << endl;
-                    abort();
-                }
-            }
+            cerr << "GenMargeMost is not generating coprimes." << endl
+                 << " - got: " << *this << endl;
+            abort();
         }
 #endif
         assert(max() >= 3);
@@ -2,96 +2,148 @@
 #define H_GEN_PARGE_BLOCK
 
 #include <gmp++/gmp++.h>
-#include "gen_prime.h"
-#include <cmath>
+#include "gen_coprime_abstract.h"
+#include "gen_prime_table.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <vector>
-#include <bitset>
 
-// generate parge numbers using the block generation scheme
+// generate parge numbers 2^e_k + 1 using the block generation scheme:
+// the k-th exponent is e_k = 2^L_k - 2^k, a run of ones followed by k zeros in binary,
+// where L_k is the end of the block of block_size bits containing bit k,
+// capped so that every modulus has at most max_bound bits.
+// v2(e_k) = k so the moduli are pairwise coprime (see Coprime::parge_parge).
+// The block size is the smallest one (not less than the requested one) whose moduli
+// reach product_bound, it is computed directly instead of by trial generation.
+// The moduli are emitted largest first, so a prefix of them (as used for small outputs)
+// covers as many bits as possible and Garner's mixed radix digits shrink as it goes.
 class GenPargeBlock : public GenCoprimeAbstract<Givaro::Integer>
 {
   protected:
-    Givaro::IntPrimeDom _int_prime_domain;
     Givaro::Integer _product = 1;
     Givaro::Integer _max = -1;
+    uint_fast64_t _block_size;
+
+    // floor(log2(x)), x > 0
+    static uint_fast64_t log2_floor(uint64_t x)
+    {
+        return 63 - __builtin_clzll(x);
+    }
+
+    // the exponent for v2 = k with the given block size, 0 if there is none below max_expo
+    static uint64_t exponent(uint_fast64_t k, uint_fast64_t block_size, uint64_t max_expo)
+    {
+        uint64_t low = uint64_t(1) << k;
+        if (low > max_expo)
+        {
+            return 0;
+        }
+        // the largest L with 2^L - 2^k <= max_expo
+        uint_fast64_t cap = log2_floor(max_expo + low);
+        uint_fast64_t end = block_size * (k / block_size + 1);
+        return (uint64_t(1) << std::min(end, cap)) - low;
+    }
+
+    // the exponents for a block size, largest first, stopping once their sum reaches product_bound
+    // returns false if all of them together fall short of product_bound
+    static bool exponents(uint_fast64_t product_bound, uint_fast64_t block_size, uint64_t max_expo, std::vector<uint64_t> &expos)
+    {
+        expos.clear();
+        for (uint_fast64_t k = 0; k < 64; k++)
+        {
+            uint64_t e = exponent(k, block_size, max_expo);
+            if (e == 0)
+            {
+                break;
+            }
+            expos.push_back(e);
+        }
+        std::sort(expos.begin(), expos.end(), std::greater<uint64_t>());
+        // 2^e + 1 has more than e bits, so the sum of exponents is a lower bound of the product bitsize
+        uint64_t bits = 0;
+        for (size_t i = 0; i < expos.size(); i++)
+        {
+            if (bits >= product_bound)
+            {
+                expos.resize(i);
+                return true;
+            }
+            bits += expos[i];
+        }
+        return bits >= product_bound;
+    }
 
   public:
     inline virtual Givaro::Integer product() const override { return _product; }
     inline virtual uint_fast64_t product_bitsize() const override { return product().bitsize(); }
     inline virtual uint_fast64_t max_bitsize() const override { return max().bitsize(); }
     inline virtual const Givaro::Integer &max() const override { return _max; }
+    inline uint_fast64_t block_size() const { return _block_size; }
 
-  public:
-    GenPargeBlock(uint_fast64_t product_bound, uint_fast64_t max_bound, uint_fast64_t block_size)
+    /*
+        use this method to get the exponents of the moduli without generating them,
+        block_size is raised to the smallest feasible one, returns false if there is none
+    */
+    static bool exponents_for(uint_fast64_t product_bound, uint_fast64_t max_bound, uint_fast64_t &block_size, std::vector<uint64_t> &expos)
     {
         assert(block_size > 0);
-        assert(block_size < 64);
-        uint_fast64_t mask = (1 << block_size) - 1; // mask = 0xffff... (contains block_size 1s)
-        int_fast64_t n = -1;                        // n = 0xffff... (contains 64 bits of 1s)
-        size_t i_block = 1;
-        bool last_block = false;
-        while (product_bitsize() < product_bound)
+        assert(max_bound >= 2 && max_bound < (uint64_t(1) << 62));
+        const uint64_t max_expo = max_bound - 1;
+        // a block size at least log2(max_expo) + 1 caps every exponent, larger ones give the same moduli
+        const uint_fast64_t widest = log2_floor(max_expo) + 1;
+        block_size = std::min(block_size, widest);
+        while (!exponents(product_bound, block_size, max_expo, expos))
         {
-            uint_fast64_t expo = n & mask;
-            // std::cerr << "mask: " << std::bitset<64>(mask) << std::endl;
-            // std::cerr << "n: " << std::bitset<64>(n) << std::endl;
-            if (expo <= 0)
+            if (block_size >= widest)
             {
-                if (last_block)
-                {
-                    std::cerr << "We ran out of parge numbers, consider increasing block size or max bound." << std::endl;
-                    std::cerr << "Currently generated: " << std::endl
-                              << " - max_bound: " << max_bound << std::endl
-                              << *this << std::endl;
-                    //abort();
-                    // reset 
-                    block_size++;
-                    mask = (1 << block_size) - 1;
-                    n = -1;
-                    i_block = 1;
-                    last_block = false;
-                    _product = 1;
-                    _max = -1;
-                    this->clear();
-                    std::cerr << "Trying block size " << block_size << std::endl;
-                    continue;
-                }
-                i_block++;
-                mask = (1 << i_block * block_size) - 1;
-                if (mask >= max_bound)
-                {
-                    last_block = true;
-                    mask = (1 << max_bound) - 1;
-                }
-                continue;
+                return false;
             }
-            std::cerr << "expo: " << std::bitset<64>(expo) << std::endl;
-            assert(expo > 0);
+            block_size++;
+        }
+        return true;
+    }
+
+    // whether some block size reaches product_bound with moduli of at most max_bound bits
+    static bool feasible(uint_fast64_t product_bound, uint_fast64_t max_bound)
+    {
+        uint_fast64_t block_size = 1;
+        std::vector<uint64_t> expos;
+        return max_bound >= 2 && exponents_for(product_bound, max_bound, block_size, expos);
+    }
+
+  public:
+    GenPargeBlock(uint_fast64_t product_bound, uint_fast64_t max_bound, uint_fast64_t block_size)
+        : _block_size(block_size)
+    {
+        std::vector<uint64_t> expos;
+        if (!exponents_for(product_bound, max_bound, _block_size, expos))
+        {
+            std::cerr << "GenPargeBlock: there are not enough parge numbers of at most " << max_bound
+                      << " bits for a product of " << product_bound << " bits, consider increasing max bound." << std::endl;
+            abort();
+        }
+        for (size_t i = 0; i < expos.size(); i++)
+        {
             Givaro::Integer t = 1;
-            t <<= expo;
+            t <<= expos[i];
             t++;
-            this->push_back(t); // t = 2^(2^n) + 1
+            this->push_back(t); // t = 2^e + 1
             _product *= t;
             if (t > _max)
             {
                 _max = t;
             }
-            n <<= 1; // n = 0xfffffffe
         }
 #if CHECK_MMC
         std::cerr << "CHECK_MMC: checking correctness..." << std::endl;
-        size_t N = this->size();
-        for (size_t i = 0; i < N; i++)
+        if (!Coprime::parge_exponents_coprime(expos))
         {
-            for (size_t j = 0; j < N; j++)
-            {
-                if (i != j && gcd(this->val(i), this->val(j)) != 1)
-                {
-                    std::cerr << "GenPargeBlock is not generating coprimes." << std::endl
-                              << " - got: " << this->val(i) << " and " << this->val(j) << std::endl;
-                    abort();
-                }
-            }
+            std::cerr << "GenPargeBlock is not generating coprimes." << std::endl
+                      << " - got: " << *this << std::endl;
+            abort();
         }
         std::cerr << "CHECK_MMC: passed." << std::endl;
 #endif
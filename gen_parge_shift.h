@@ -3,6 +3,7 @@
 
 #include <gmp++/gmp++.h>
 #include "gen_prime.h"
+#include "gen_prime_table.h"
 #include <cmath>
 #include <vector>
 
@@ -73,10 +74,23 @@ class GenPargeShift : public GenCoprimeAbstract<Givaro::Integer>
             n >>= 1; // max_bound = previous 2^n
         }
 #if CHECK_MMC
+        // the shifted parge numbers are checked structurally, 2^n is coprime to all of them
+        // and only 2^n + 3 and 2039 need a gcd against the rest
         size_t N = this->size();
-        for (size_t i = 0; i < N; i++)
+        std::vector<uint64_t> expos;
+        for (size_t i = 3; i < N; i++)
         {
-            for (size_t j = 0; j < N; j++)
+            expos.push_back((this->val(i) - 1).bitsize() - 1);
+        }
+        if (!Coprime::parge_exponents_coprime(expos))
+        {
+            cerr << "GenPargeShift is not generating coprimes." << endl
+                 << " - current: " << *this << endl;
+            abort();
+        }
+        for (size_t i = 1; i < 3 && i < N; i++)
+        {
+            for (size_t j = 1; j < N; j++)
             {
                 if (i != j && gcd(this->val(i), this->val(j)) != 1)
                 {
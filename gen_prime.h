@@ -11,6 +11,7 @@
 #include <ostream>
 #include <iterator>
 #include "gen_coprime_abstract.h"
+#include "gen_prime_table.h"
 
 // return an array containing unique primes in type T, eg. T = int64_t
 // all primes are exactly B-b   its long, ie, between [2^(B-1), 2^B-1]
@@ -35,20 +36,38 @@ class GenPrimeMost : public GenCoprimeAbstract<T>
     {
         assert(product_bound > max_bound && "The product of moduli must be greater than any moduli.");
         assert(max_bound > 1 && "Any moduli must be at least 2 bits");
-        Givaro::Integer prime_bound = 1;
-        // linbox bug: uint64 could be undefined
-        prime_bound <<= max_bound;
-        _int_prime_domain.prevprimein(prime_bound);
-        while (product_bitsize() < product_bound)
+        if (max_bound <= PRIME_TABLE_MAX_BITSIZE)
         {
-            if (prime_bound < 2)
+            // word-size primes come from the cached sieve
+            for (size_t i = 0; product_bitsize() < product_bound; i++)
             {
-                cerr << "Failure to generate coprimes: We ran out of primes. Consider increasing max bitsize bound." << endl;
-                abort();
+                uint64_t prime = PrimeTable::prime_below_pow2(max_bound, i);
+                if (prime < 2)
+                {
+                    cerr << "Failure to generate coprimes: We ran out of primes. Consider increasing max bitsize bound." << endl;
+                    abort();
+                }
+                vector<T>::push_back(T(prime));
+                _product *= Givaro::Integer(prime);
             }
-            vector<T>::push_back(prime_bound);
-            _product *= prime_bound;
+        }
+        else
+        {
+            Givaro::Integer prime_bound = 1;
+            // linbox bug: uint64 could be undefined
+            prime_bound <<= max_bound;
             _int_prime_domain.prevprimein(prime_bound);
+            while (product_bitsize() < product_bound)
+            {
+                if (prime_bound < 2)
+                {
+                    cerr << "Failure to generate coprimes: We ran out of primes. Consider increasing max bitsize bound." << endl;
+                    abort();
+                }
+                vector<T>::push_back(prime_bound);
+                _product *= prime_bound;
+                _int_prime_domain.prevprimein(prime_bound);
+            }
         }
 
 #if CHECK_MMC
@@ -0,0 +1,220 @@
+#if !defined(H_GEN_PRIME_TABLE)
+#define H_GEN_PRIME_TABLE
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// the word-size prime tables are only used up to this bitsize,
+// above it the generators fall back to Givaro::IntPrimeDom
+#if !defined(PRIME_TABLE_MAX_BITSIZE)
+#define PRIME_TABLE_MAX_BITSIZE 48
+#endif
+
+// Process-wide prime tables shared by the coprime generators.
+//  - small_primes(bound) is a sieve of Eratosthenes (used for exponents and as sieving primes),
+//  - prime_below_pow2(bitsize, i) is the i-th largest prime below 2^bitsize, found by a
+//    segmented sieve walking down from 2^bitsize one window at a time.
+// Both tables only grow and are cached, so building a basis for a new parameter set
+// costs a few sieve windows instead of one primality test per candidate.
+class PrimeTable
+{
+    static const uint64_t WINDOW = 1 << 16;
+
+    static std::mutex &lock()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::vector<uint64_t> &small_table()
+    {
+        static std::vector<uint64_t> t;
+        return t;
+    }
+
+    static uint64_t &small_table_bound()
+    {
+        static uint64_t b = 0;
+        return b;
+    }
+
+    struct Pow2Table
+    {
+        std::vector<uint64_t> primes; // decreasing
+        uint64_t low;                 // every prime in [low, 2^bitsize) is in primes
+    };
+
+    static std::map<uint64_t, Pow2Table> &pow2_tables()
+    {
+        static std::map<uint64_t, Pow2Table> t;
+        return t;
+    }
+
+    // sieve all primes below bound, the caller holds the lock
+    static void grow_small_table(uint64_t bound)
+    {
+        if (bound <= small_table_bound())
+        {
+            return;
+        }
+        // grow geometrically so that repeated requests stay cheap
+        bound = std::max(bound, 2 * small_table_bound());
+        std::vector<bool> composite(bound, false);
+        std::vector<uint64_t> &t = small_table();
+        t.clear();
+        for (uint64_t i = 2; i < bound; i++)
+        {
+            if (composite[i])
+            {
+                continue;
+            }
+            t.push_back(i);
+            for (uint64_t j = i * i; j < bound; j += i)
+            {
+                composite[j] = true;
+            }
+        }
+        small_table_bound() = bound;
+    }
+
+  public:
+    // all primes below bound in increasing order
+    static std::vector<uint64_t> small_primes(uint64_t bound)
+    {
+        std::lock_guard<std::mutex> guard(lock());
+        grow_small_table(bound);
+        const std::vector<uint64_t> &t = small_table();
+        return std::vector<uint64_t>(t.begin(), std::lower_bound(t.begin(), t.end(), bound));
+    }
+
+    // the largest prime below n (n > 2)
+    static uint64_t prev_prime(uint64_t n)
+    {
+        assert(n > 2);
+        std::lock_guard<std::mutex> guard(lock());
+        grow_small_table(n);
+        const std::vector<uint64_t> &t = small_table();
+        return *(std::lower_bound(t.begin(), t.end(), n) - 1);
+    }
+
+    // the smallest prime above n
+    static uint64_t next_prime(uint64_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock());
+        grow_small_table(2 * n + 3);
+        const std::vector<uint64_t> &t = small_table();
+        return *std::upper_bound(t.begin(), t.end(), n);
+    }
+
+    // the index-th (from 0) largest prime below 2^bitsize, or 0 if there is none
+    static uint64_t prime_below_pow2(uint64_t bitsize, size_t index)
+    {
+        assert(bitsize >= 2 && bitsize <= PRIME_TABLE_MAX_BITSIZE);
+        std::lock_guard<std::mutex> guard(lock());
+        uint64_t top = uint64_t(1) << bitsize;
+        std::map<uint64_t, Pow2Table>::iterator it = pow2_tables().find(bitsize);
+        if (it == pow2_tables().end())
+        {
+            Pow2Table fresh;
+            fresh.low = top;
+            it = pow2_tables().insert(std::make_pair(bitsize, fresh)).first;
+        }
+        Pow2Table &table = it->second;
+        // sieving primes up to sqrt(2^bitsize)
+        uint64_t root = (uint64_t(1) << ((bitsize + 1) / 2)) + 1;
+        grow_small_table(root);
+        const std::vector<uint64_t> &sieving = small_table();
+        std::vector<bool> composite(WINDOW);
+        while (table.primes.size() <= index && table.low > 2)
+        {
+            uint64_t high = table.low;
+            uint64_t low = (high > WINDOW + 2) ? high - WINDOW : 2;
+            std::fill(composite.begin(), composite.end(), false);
+            for (size_t k = 0; k < sieving.size() && sieving[k] * sieving[k] < high; k++)
+            {
+                uint64_t p = sieving[k];
+                uint64_t start = std::max(p * p, ((low + p - 1) / p) * p);
+                for (uint64_t j = start; j < high; j += p)
+                {
+                    composite[j - low] = true;
+                }
+            }
+            for (uint64_t n = high; n-- > low;)
+            {
+                if (!composite[n - low])
+                {
+                    table.primes.push_back(n);
+                }
+            }
+            table.low = low;
+        }
+        return index < table.primes.size() ? table.primes[index] : 0;
+    }
+};
+
+// Structural coprimality of numbers of the form 2^a - 1 ("marge") and 2^b + 1 ("parge"),
+// it only looks at the exponents so no big integer gcd is needed:
+//  gcd(2^a - 1, 2^b - 1) = 2^gcd(a, b) - 1
+//  gcd(2^a + 1, 2^b + 1) = 1 iff v2(a) != v2(b)
+//  gcd(2^a - 1, 2^b + 1) = 1 iff v2(a) <= v2(b)
+// where v2 is the 2-adic valuation, all exponents at least 1.
+namespace Coprime
+{
+
+inline uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+inline uint64_t v2(uint64_t a)
+{
+    assert(a > 0);
+    return __builtin_ctzll(a);
+}
+
+inline bool marge_marge(uint64_t a, uint64_t b) { return gcd(a, b) == 1; }
+inline bool parge_parge(uint64_t a, uint64_t b) { return v2(a) != v2(b); }
+inline bool marge_parge(uint64_t a, uint64_t b) { return v2(a) <= v2(b); }
+
+// marge exponents that are distinct primes are pairwise coprime,
+// this checks it in O(N log N) against the prime table
+inline bool marge_exponents_are_distinct_primes(std::vector<uint64_t> expos)
+{
+    if (expos.empty())
+    {
+        return true;
+    }
+    std::sort(expos.begin(), expos.end());
+    if (std::adjacent_find(expos.begin(), expos.end()) != expos.end())
+    {
+        return false;
+    }
+    std::vector<uint64_t> primes = PrimeTable::small_primes(expos.back() + 1);
+    return std::includes(primes.begin(), primes.end(), expos.begin(), expos.end());
+}
+
+// parge numbers are pairwise coprime iff the 2-adic valuations of their exponents are distinct
+inline bool parge_exponents_coprime(const std::vector<uint64_t> &expos)
+{
+    std::vector<uint64_t> v(expos.size());
+    for (size_t i = 0; i < expos.size(); i++)
+    {
+        v[i] = v2(expos[i]);
+    }
+    std::sort(v.begin(), v.end());
+    return std::adjacent_find(v.begin(), v.end()) == v.end();
+}
+
+} // namespace Coprime
+
+#endif // H_GEN_PRIME_TABLE
@@ -0,0 +1,48 @@
+#if !defined(H_GMP_SCRATCH)
+#define H_GMP_SCRATCH
+
+#include <gmp++/gmp++.h>
+#include <cstddef>
+
+/*
+    A block of mpz temporaries preallocated with mpz_init2 to the size they will reach,
+    scoped to one call (eg. one matrix_recover_phase_1) and reused for all its entries,
+    so the hot loop neither initializes nor grows them.
+    GMP's allocator itself is left alone: mp_set_memory_functions is process wide, it would
+    also catch the allocations of Givaro, FFLAS and of any other thread.
+*/
+class GmpScratch
+{
+    size_t m_count;
+    mpz_t *m_vars;
+
+  public:
+    GmpScratch(size_t count, mp_bitcnt_t bitsize) : m_count(count), m_vars(new mpz_t[count])
+    {
+        for (size_t i = 0; i < m_count; i++)
+        {
+            mpz_init2(m_vars[i], bitsize);
+        }
+    }
+
+    ~GmpScratch()
+    {
+        for (size_t i = 0; i < m_count; i++)
+        {
+            mpz_clear(m_vars[i]);
+        }
+        delete[] m_vars;
+    }
+
+    GmpScratch(const GmpScratch &) = delete;
+    GmpScratch &operator=(const GmpScratch &) = delete;
+
+    // the temporaries as an array, as the CNMA kernels take them
+    inline mpz_t *get(size_t offset = 0) { return m_vars + offset; }
+    // read only, eg. a table of constants shared by the threads
+    inline const mpz_t *get(size_t offset = 0) const { return m_vars + offset; }
+    inline mpz_ptr operator[](size_t i) { return m_vars[i]; }
+    inline size_t size() const { return m_count; }
+};
+
+#endif // H_GMP_SCRATCH
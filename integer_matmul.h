@@ -0,0 +1,313 @@
+#if !defined(H_INTEGER_MATMUL)
+#define H_INTEGER_MATMUL
+
+#include "bench_common.h"
+#include "sim_rns.h"
+#include "two_phase_tuner.h"
+#include "plan_cache.h"
+#include "kronecker_fft.h"
+#include <gmp++/gmp++.h>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// the engines IntegerMatMul routes a product to, the two phase ones share TwoPhaseScheme's values
+enum IntegerMatMulEngine
+{
+    INTEGER_MATMUL_AUTO = -1,                        // whatever the decision table says
+    INTEGER_MATMUL_MARGE_MOST = TWO_PHASE_MARGE_MOST, // the two phase schemes, level 1 moduli bitsize tuned
+    INTEGER_MATMUL_MARGE_LEAST = TWO_PHASE_MARGE_LEAST,
+    INTEGER_MATMUL_PARGE_BLOCK = TWO_PHASE_PARGE_BLOCK,
+    INTEGER_MATMUL_PARGE_SHIFT = TWO_PHASE_PARGE_SHIFT,
+    INTEGER_MATMUL_HYBRID = TWO_PHASE_HYBRID,
+    INTEGER_MATMUL_TWO_PHASE = TWO_PHASE_SCHEME_COUNT, // the two phase scheme TwoPhaseTuner picks
+    INTEGER_MATMUL_KRONECKER,                         // Kronecker substitution and FFT primes (KroneckerFFT)
+    INTEGER_MATMUL_FFLAS,                             // SIM_RNS::fflas_mult_integer
+    INTEGER_MATMUL_ENGINE_COUNT
+};
+
+// without a decision table: below this input bitsize FFLAS' own multimodular product is used
+const uint64_t INTEGER_MATMUL_FFLAS_MAX_BITSIZE = 512;
+// without a decision table: from this input bitsize on, with an inner dimension up to
+// INTEGER_MATMUL_KRONECKER_MAX_DIM, the Kronecker-FFT product is used
+const uint64_t INTEGER_MATMUL_KRONECKER_MIN_BITSIZE = 1 << 15;
+const size_t INTEGER_MATMUL_KRONECKER_MAX_DIM = 32;
+// the two phase level 1 moduli bitsize is tuned on square products of at most this dimension
+const size_t INTEGER_MATMUL_TUNE_DIM_MAX = 64;
+
+/*
+    The front door for integer matrix products: multiply routes every product to the engine
+    that is fastest for its shape, entry bitsize and thread count.
+    The routing follows a decision table, the crossover map written by main_benchmark_engines
+    (see bench_crossover), whose nearest configuration (in log scale) to the product wins;
+    without one it falls back to fixed bitsize thresholds. Either can be overridden.
+    The two phase algorithms are built once per plan and kept, their plans persisted in the PlanCache.
+*/
+class IntegerMatMul
+{
+  protected:
+    PlanCache *m_plan_cache;
+    TwoPhaseTuner m_tuner;
+    std::vector<BenchWinner> m_table;
+    IntegerMatMulEngine m_override;
+    std::map<std::string, std::shared_ptr<TwoPhaseAbstract>> m_algorithms;
+    KroneckerFFT m_kronecker;
+    std::mutex m_lock;
+
+  public:
+    IntegerMatMul(PlanCache *plan_cache = NULL)
+        : m_plan_cache(plan_cache), m_tuner(plan_cache), m_override(INTEGER_MATMUL_AUTO) {}
+
+    IntegerMatMul(const IntegerMatMul &) = delete;
+    IntegerMatMul &operator=(const IntegerMatMul &) = delete;
+
+    static const char *engine_name(IntegerMatMulEngine engine)
+    {
+        static const char *names[] = {"marge_most", "marge_least", "parge_block", "parge_shift", "hybrid", "two_phase", "kronecker", "fflas"};
+        return engine == INTEGER_MATMUL_AUTO ? "auto" : names[engine];
+    }
+
+    // returns false on a name that is no engine (eg. flint, which is only benchmarked)
+    static bool parse_engine(const std::string &name, IntegerMatMulEngine &engine)
+    {
+        for (int e = 0; e < INTEGER_MATMUL_ENGINE_COUNT; e++)
+        {
+            if (name == engine_name(IntegerMatMulEngine(e)))
+            {
+                engine = IntegerMatMulEngine(e);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+        use this method to load a crossover map as written by bench_write_crossover,
+        rows of engines this class does not have are skipped, returns false if it cannot be read
+    */
+    bool load_decision_table(const std::string &path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            return false;
+        }
+        std::vector<BenchWinner> table;
+        std::string line;
+        std::getline(file, line); // header
+        while (std::getline(file, line))
+        {
+            std::vector<std::string> fields = bench_split(line);
+            IntegerMatMulEngine engine;
+            if (fields.size() < 7 || !parse_engine(fields[5], engine))
+            {
+                continue;
+            }
+            BenchWinner w;
+            w.dim_m = std::strtoull(fields[0].c_str(), NULL, 10);
+            w.dim_n = std::strtoull(fields[1].c_str(), NULL, 10);
+            w.dim_k = std::strtoull(fields[2].c_str(), NULL, 10);
+            w.input_bitsize = std::strtoull(fields[3].c_str(), NULL, 10);
+            w.threads = std::strtoull(fields[4].c_str(), NULL, 10);
+            w.algorithm = fields[5];
+            w.median = std::strtod(fields[6].c_str(), NULL);
+            w.runner_up = fields.size() > 7 ? fields[7] : "";
+            w.runner_up_median = fields.size() > 8 ? std::strtod(fields[8].c_str(), NULL) : 0;
+            table.push_back(w);
+        }
+        set_decision_table(table);
+        return true;
+    }
+
+    // the same from winners in memory, eg. bench_crossover of a fresh run
+    void set_decision_table(const std::vector<BenchWinner> &table)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_table.clear();
+        for (size_t i = 0; i < table.size(); i++)
+        {
+            IntegerMatMulEngine engine;
+            if (parse_engine(table[i].algorithm, engine))
+            {
+                m_table.push_back(table[i]);
+            }
+        }
+    }
+
+    inline size_t decision_table_size() const { return m_table.size(); }
+
+    /*
+        use this method to route every product to engine regardless of the decision table,
+        INTEGER_MATMUL_AUTO restores the routing
+    */
+    inline void override_engine(IntegerMatMulEngine engine) { m_override = engine; }
+
+    /*
+        use this method to get the engine a dim_m x dim_n by dim_n x dim_k product of entries
+        of input_bitsize bits would be routed to
+    */
+    IntegerMatMulEngine choose(size_t dim_m, size_t dim_n, size_t dim_k, uint64_t input_bitsize, size_t threads = 1) const
+    {
+        if (m_override != INTEGER_MATMUL_AUTO)
+        {
+            return m_override;
+        }
+        if (m_table.empty())
+        {
+            if (input_bitsize < INTEGER_MATMUL_FFLAS_MAX_BITSIZE)
+            {
+                return INTEGER_MATMUL_FFLAS;
+            }
+            if (input_bitsize >= INTEGER_MATMUL_KRONECKER_MIN_BITSIZE && dim_n <= INTEGER_MATMUL_KRONECKER_MAX_DIM)
+            {
+                return INTEGER_MATMUL_KRONECKER;
+            }
+            return INTEGER_MATMUL_TWO_PHASE;
+        }
+        // nearest configuration, every coordinate compared by its log
+        const BenchWinner *nearest = NULL;
+        double best = 0;
+        for (size_t i = 0; i < m_table.size(); i++)
+        {
+            const BenchWinner &w = m_table[i];
+            double d = std::fabs(std::log2(double(w.input_bitsize) / input_bitsize)) +
+                       std::fabs(std::log2(double(w.dim_m) / dim_m)) +
+                       std::fabs(std::log2(double(w.dim_n) / dim_n)) +
+                       std::fabs(std::log2(double(w.dim_k) / dim_k)) +
+                       std::fabs(std::log2(double(w.threads) / threads));
+            if (!nearest || d < best)
+            {
+                nearest = &w;
+                best = d;
+            }
+        }
+        IntegerMatMulEngine engine = INTEGER_MATMUL_TWO_PHASE;
+        parse_engine(nearest->algorithm, engine);
+        return engine;
+    }
+
+    /*
+        use this method to multiply a dim_m x dim_n matrix by a dim_n x dim_k matrix (row major),
+        with threads > 0 the OpenMP thread count is set for this product only;
+        matrices with a negative entry always go to INTEGER_MATMUL_FFLAS
+    */
+    std::vector<Givaro::Integer> multiply(const std::vector<Givaro::Integer> &matrix_a, const std::vector<Givaro::Integer> &matrix_b,
+                                          size_t dim_m, size_t dim_n, size_t dim_k, int threads = 0)
+    {
+        assert(matrix_a.size() == dim_m * dim_n && matrix_b.size() == dim_n * dim_k);
+#ifdef _OPENMP
+        int saved_threads = omp_get_max_threads();
+        if (threads > 0)
+        {
+            omp_set_num_threads(threads);
+        }
+        size_t used_threads = omp_get_max_threads();
+#else
+        size_t used_threads = 1;
+#endif
+        uint64_t input_bitsize = 1;
+        bool negative = false;
+        for (size_t i = 0; i < matrix_a.size(); i++)
+        {
+            input_bitsize = std::max(input_bitsize, uint64_t(matrix_a[i].bitsize()));
+            negative |= matrix_a[i] < 0;
+        }
+        for (size_t i = 0; i < matrix_b.size(); i++)
+        {
+            input_bitsize = std::max(input_bitsize, uint64_t(matrix_b[i].bitsize()));
+            negative |= matrix_b[i] < 0;
+        }
+        IntegerMatMulEngine engine = choose(dim_m, dim_n, dim_k, input_bitsize, used_threads);
+        if (negative && engine != INTEGER_MATMUL_FFLAS)
+        {
+            // KroneckerFFT and the two phase schemes only take nonnegative matrices
+            // (the latter recover into [0, M)), fgemm handles the signs
+            engine = INTEGER_MATMUL_FFLAS;
+        }
+#if DEBUG_MMC || TIME_MMC
+        cerr << "IntegerMatMul: " << dim_m << "x" << dim_n << "x" << dim_k << " " << input_bitsize << " bits, "
+             << used_threads << " threads -> " << engine_name(engine) << endl;
+#endif
+        std::vector<Givaro::Integer> product;
+        switch (engine)
+        {
+        case INTEGER_MATMUL_KRONECKER:
+            product = m_kronecker.matrix_product(matrix_a, matrix_b, dim_m, dim_n, dim_k);
+            break;
+        case INTEGER_MATMUL_FFLAS:
+            product = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, dim_m, dim_n, dim_k);
+            break;
+        default:
+        {
+            std::shared_ptr<TwoPhaseAbstract> algo = algorithm(engine, dim_n, input_bitsize, used_threads);
+            if (algo)
+            {
+                product = algo->matrix_product(matrix_a, matrix_b, dim_m, dim_n, dim_k);
+            }
+            else
+            {
+                // no level 1 moduli fit this shape (inputs of at most 16 bits, or a scheme
+                // that runs out of moduli at this dim_n), fgemm does not need any
+                product = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, dim_m, dim_n, dim_k);
+            }
+        }
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(saved_threads);
+#endif
+        return product;
+    }
+
+  protected:
+    /*
+        the two phase algorithm of engine for an inner dimension dim_n, built on first use:
+        the level 1 moduli bitsize (and with INTEGER_MATMUL_TWO_PHASE the scheme) is tuned
+        on a square product of at most INTEGER_MATMUL_TUNE_DIM_MAX, the level 1 product
+        bound is that of dim_n, NULL if no plan of engine is feasible for this shape
+    */
+    std::shared_ptr<TwoPhaseAbstract> algorithm(IntegerMatMulEngine engine, size_t dim_n, uint64_t input_bitsize, size_t threads)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::vector<TwoPhaseScheme> schemes;
+        if (engine == INTEGER_MATMUL_TWO_PHASE)
+        {
+            for (int s = 0; s < TWO_PHASE_SCHEME_COUNT; s++)
+            {
+                schemes.push_back(TwoPhaseScheme(s));
+            }
+        }
+        else
+        {
+            schemes.push_back(TwoPhaseScheme(engine));
+        }
+        TwoPhasePlan plan;
+        if (!m_tuner.tune(std::min(dim_n, INTEGER_MATMUL_TUNE_DIM_MAX), input_bitsize, threads, schemes, plan))
+        {
+            return std::shared_ptr<TwoPhaseAbstract>();
+        }
+        plan.product_bitsize = std::max(plan.product_bitsize, TwoPhaseTuner::product_bitsize_for(dim_n, input_bitsize));
+        if (!plan.feasible() && !m_tuner.tune(dim_n, input_bitsize, threads, schemes, plan))
+        {
+            // the wider bound ran out of moduli, and tuning on the product itself found none
+            return std::shared_ptr<TwoPhaseAbstract>();
+        }
+        std::string key = std::string(TwoPhasePlan::scheme_name(plan.scheme)) + "/" + std::to_string(plan.product_bitsize) + "/" + std::to_string(plan.moduli_bitsize);
+        std::map<std::string, std::shared_ptr<TwoPhaseAbstract>>::iterator it = m_algorithms.find(key);
+        if (it != m_algorithms.end())
+        {
+            return it->second;
+        }
+        std::shared_ptr<TwoPhaseAbstract> algo(plan.make(m_plan_cache));
+        m_algorithms[key] = algo;
+        return algo;
+    }
+};
+
+#endif // H_INTEGER_MATMUL
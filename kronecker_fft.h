@@ -0,0 +1,433 @@
+#if !defined(H_KRONECKER_FFT)
+#define H_KRONECKER_FFT
+
+#include "limb_matrix.h"
+#include "two_phase_metrics.h"
+#include <gmp++/gmp++.h>
+#include <givaro/modular.h>
+#include <linbox/matrix/polynomial-matrix.h>
+#include <linbox/randiter/random-fftprime.h>
+#include <linbox/algorithms/polynomial-matrix/matpoly-mult-fft.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// the default bound in bytes on what one chunk of rows of the left matrix takes: its packing,
+// its images and products modulo every FFT prime, and the recovered coefficients
+const size_t KRONECKER_FFT_CHUNK_BYTES = size_t(1) << 28;
+// the recovered coefficients are held in 128 bits, which never takes more FFT primes than this
+const size_t KRONECKER_FFT_PRIMES_MAX = 16;
+
+/*
+    Integer matrix product by Kronecker substitution: every entry is written as a polynomial
+    in 2^16 with 16 bit coefficients, the polynomial matrices are multiplied by FFT modulo
+    a few FFT primes, the coefficients of the product are recovered by Garner's algorithm
+    and evaluated back at 2^16.
+    This is the production version of intmatmul in fgemm-mp/BENCH/kroneckerFFT.h:
+    - the primes are multiplied in parallel (OpenMP), each with its own images of the operands,
+    - the coefficients are recovered from any number of primes, in 128 bits,
+    - the left matrix and the product are handled by chunks of rows so their packings stay
+      within a memory bound, the right matrix is packed once.
+    The interface matches TwoPhaseAbstract: matrix_product on vectors or LimbMatrix, where
+    matrix_a is dim_m x dim_n and matrix_b is dim_n x dim_k, both with nonnegative entries,
+    and attach_metrics (the packing is reported as phase 1 reduce, the per prime products as
+    phase 2 mult, Garner as level 2 recover and the evaluation at 2^16 as phase 1 recover).
+*/
+class KroneckerFFT
+{
+  protected:
+    typedef Givaro::Modular<double> Prime_Field;
+    typedef LinBox::PolynomialMatrix<LinBox::PMType::polfirst, LinBox::PMStorage::plain, Prime_Field> Poly_Matrix;
+    typedef unsigned __int128 uint128_t;
+
+    size_t m_chunk_bytes;
+    // see attach_metrics, NULL when no metrics are collected
+    TwoPhaseMetrics *m_metrics = NULL;
+
+  public:
+    KroneckerFFT(size_t chunk_bytes = KRONECKER_FFT_CHUNK_BYTES) : m_chunk_bytes(chunk_bytes) {}
+
+    KroneckerFFT(const KroneckerFFT &) = delete;
+    KroneckerFFT &operator=(const KroneckerFFT &) = delete;
+
+    /*
+        use this method to collect per stage timings of every following product into metrics,
+        NULL detaches them
+    */
+    void attach_metrics(TwoPhaseMetrics *metrics)
+    {
+        m_metrics = metrics;
+    }
+
+    inline TwoPhaseMetrics *metrics() const { return m_metrics; }
+
+    /*
+        use this method to multiply two integer matrices, matrix_a is dim_m x dim_n and
+        matrix_b is dim_n x dim_k, both with nonnegative entries
+    */
+    std::vector<Givaro::Integer> matrix_product(const std::vector<Givaro::Integer> &matrix_a,
+                                                const std::vector<Givaro::Integer> &matrix_b,
+                                                size_t dim_m, size_t dim_n, size_t dim_k) const
+    {
+        assert(matrix_a.size() == dim_m * dim_n && matrix_b.size() == dim_n * dim_k && "input matrix dimension is incorrect");
+        std::vector<mpz_srcptr> a(matrix_a.size()), b(matrix_b.size());
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            a[i] = matrix_a[i].get_mpz();
+        }
+        for (size_t i = 0; i < b.size(); i++)
+        {
+            b[i] = matrix_b[i].get_mpz();
+        }
+        std::vector<Givaro::Integer> c(dim_m * dim_k);
+        multiply(c.data(), a.data(), b.data(), dim_m, dim_n, dim_k);
+        return c;
+    }
+
+    /*
+        use this method to multiply two LimbMatrix, as matrix_product on vectors of integers,
+        the entries are read in place
+    */
+    LimbMatrix matrix_product(const LimbMatrix &matrix_a, const LimbMatrix &matrix_b) const
+    {
+        assert(matrix_a.dim_n == matrix_b.dim_m && "input matrix dimension is incorrect");
+        std::vector<__mpz_struct> views(matrix_a.count() + matrix_b.count());
+        std::vector<mpz_srcptr> a(matrix_a.count()), b(matrix_b.count());
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            a[i] = matrix_a.view(&views[i], i);
+        }
+        for (size_t i = 0; i < b.size(); i++)
+        {
+            b[i] = matrix_b.view(&views[a.size() + i], i);
+        }
+        std::vector<Givaro::Integer> c(matrix_a.dim_m * matrix_b.dim_n);
+        multiply(c.data(), a.data(), b.data(), matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_n);
+        return LimbMatrix::from_integers(c, matrix_a.dim_m, matrix_b.dim_n);
+    }
+
+  protected:
+    /*
+        c = a * b, a is dim_m x dim_n, b is dim_n x dim_k and c is dim_m x dim_k, row major
+    */
+    void multiply(Givaro::Integer *c, const mpz_srcptr *a, const mpz_srcptr *b, size_t dim_m, size_t dim_n, size_t dim_k) const
+    {
+        uint64_t bits_a = 1, bits_b = 1;
+        for (size_t i = 0; i < dim_m * dim_n; i++)
+        {
+            assert(mpz_sgn(a[i]) >= 0 && "KroneckerFFT only multiplies nonnegative matrices");
+            bits_a = std::max(bits_a, uint64_t(mpz_sizeinbase(a[i], 2)));
+        }
+        for (size_t i = 0; i < dim_n * dim_k; i++)
+        {
+            assert(mpz_sgn(b[i]) >= 0 && "KroneckerFFT only multiplies nonnegative matrices");
+            bits_b = std::max(bits_b, uint64_t(mpz_sizeinbase(b[i], 2)));
+        }
+        uint64_t bits_c = bits_a + bits_b + Givaro::Integer(uint64_t(dim_n)).bitsize();
+        // d coefficients in 2^16 hold every entry of c, each below dim_n * d * 2^32
+        uint64_t d = (bits_c + 15) / 16;
+        uint64_t lpts = Givaro::Integer(d).bitsize();
+        size_t pts = size_t(1) << lpts;
+        Givaro::Integer bound = Givaro::Integer(uint64_t(dim_n)) * Givaro::Integer(d) * Givaro::Integer(uint64_t(1) << 32);
+        assert(bound.bitsize() <= 128 && "KroneckerFFT coefficients must fit in 128 bits");
+        bool wide = bound.bitsize() > 64;
+
+        std::vector<uint64_t> primes = fft_primes(std::max(lpts, uint64_t(Givaro::Integer(2 * (d - 1)).bitsize())), bound, dim_n);
+        size_t prime_count = primes.size();
+        assert(prime_count <= KRONECKER_FFT_PRIMES_MAX && "too many FFT primes");
+        std::vector<Prime_Field> fields;
+        fields.reserve(prime_count);
+        for (size_t i = 0; i < prime_count; i++)
+        {
+            fields.push_back(Prime_Field(double(primes[i])));
+        }
+        // inverses[i * prime_count + j] = p_j^-1 mod p_i, j < i
+        std::vector<uint64_t> inverses(prime_count * prime_count);
+        for (size_t i = 0; i < prime_count; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+            {
+                Givaro::Integer inverse;
+                mpz_invert(inverse.get_mpz(), Givaro::Integer(primes[j]).get_mpz(), Givaro::Integer(primes[i]).get_mpz());
+                inverses[i * prime_count + j] = mpz_get_ui(inverse.get_mpz());
+            }
+        }
+#if DEBUG_MMC || TIME_MMC
+        std::cerr << "KroneckerFFT: " << dim_m << "x" << dim_n << "x" << dim_k << ", " << bits_c << " bits output, "
+                  << d << " coefficients, 2^" << lpts << " points, " << prime_count << " FFT primes" << std::endl;
+#endif
+
+        // the right matrix is packed once, its images are shared by all the chunks
+        std::vector<std::unique_ptr<Poly_Matrix>> images_b(prime_count);
+        {
+            TwoPhaseMetrics::Scope scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_REDUCE, dim_n * dim_k);
+            std::vector<double> packed_b(dim_n * dim_k * pts);
+            pack(packed_b.data(), b, dim_n * dim_k, pts);
+            for (size_t i = 0; i < prime_count; i++)
+            {
+                images_b[i].reset(new Poly_Matrix(fields[i], dim_n, dim_k, pts));
+                FFLAS::fassign(fields[i], dim_n * dim_k * pts, packed_b.data(), 1, images_b[i]->getWritePointer(), 1);
+            }
+        }
+
+        size_t rows = chunk_rows(dim_m, dim_n, dim_k, pts, prime_count);
+        std::vector<double> packed_a(rows * dim_n * pts);
+        std::vector<uint64_t> coeffs_lo(rows * dim_k * pts), coeffs_hi(wide ? rows * dim_k * pts : 0);
+        for (size_t row = 0; row < dim_m; row += rows)
+        {
+            size_t chunk = std::min(rows, dim_m - row);
+            {
+                TwoPhaseMetrics::Scope scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_REDUCE, chunk * dim_n);
+                pack(packed_a.data(), a + row * dim_n, chunk * dim_n, pts);
+            }
+
+            std::vector<std::unique_ptr<Poly_Matrix>> images_c(prime_count);
+            {
+                TwoPhaseMetrics::Scope scope(m_metrics, TWO_PHASE_STAGE_PHASE_2_MULT, chunk * dim_k * pts * prime_count);
+#pragma omp parallel for schedule(dynamic)
+                for (long i = 0; i < long(prime_count); i++)
+                {
+                    Poly_Matrix image_a(fields[i], chunk, dim_n, pts);
+                    FFLAS::fassign(fields[i], chunk * dim_n * pts, packed_a.data(), 1, image_a.getWritePointer(), 1);
+                    images_c[i].reset(new Poly_Matrix(fields[i], chunk, dim_k, pts));
+                    LinBox::PolynomialMatrixFFTPrimeMulDomain<Prime_Field> fft_domain(fields[i]);
+                    fft_domain.mul_fft(lpts, *images_c[i], image_a, *images_b[i]);
+                }
+            }
+
+            {
+                TwoPhaseMetrics::Scope scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_RECOVER, chunk * dim_k * pts * prime_count);
+                std::vector<const double *> residues(prime_count);
+                for (size_t i = 0; i < prime_count; i++)
+                {
+                    residues[i] = images_c[i]->getPointer();
+                }
+                garner(coeffs_lo.data(), wide ? coeffs_hi.data() : NULL, residues, primes, inverses, chunk * dim_k * pts);
+            }
+            images_c.clear();
+
+            {
+                TwoPhaseMetrics::Scope scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_RECOVER, chunk * dim_k);
+#pragma omp parallel for
+                for (long e = 0; e < long(chunk * dim_k); e++)
+                {
+                    from_kronecker_16(c[row * dim_k + e], coeffs_lo.data() + e * pts, wide ? coeffs_hi.data() + e * pts : NULL, d);
+                }
+            }
+        }
+    }
+
+    /*
+        FFT primes allowing 2^lpts point transforms whose product exceeds bound, small enough
+        for the dot products of length dim_n of the evaluations to be exact in doubles
+    */
+    static std::vector<uint64_t> fft_primes(uint64_t lpts, const Givaro::Integer &bound, size_t dim_n)
+    {
+        uint64_t prime_max = std::sqrt(double(uint64_t(1) << 53) / dim_n) + 1;
+        if (prime_max > (1 << 26))
+        {
+            prime_max = (1 << 26) - 1;
+        }
+        LinBox::RandomFFTPrime generator(prime_max);
+        std::vector<Givaro::Integer> found;
+        if (!generator.generatePrimes(lpts, bound, found))
+        {
+            std::cerr << "KroneckerFFT: not enough FFT primes below " << prime_max << " for 2^" << lpts << " points" << std::endl;
+            abort();
+        }
+        std::vector<uint64_t> primes(found.size());
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            primes[i] = mpz_get_ui(found[i].get_mpz());
+        }
+        return primes;
+    }
+
+    // the number of rows of the left matrix per chunk that keeps a chunk within m_chunk_bytes, at least one
+    size_t chunk_rows(size_t dim_m, size_t dim_n, size_t dim_k, size_t pts, size_t prime_count) const
+    {
+        // the packing and images of a row of a, the images of a row of c and its recovered coefficients
+        size_t row_bytes = pts * sizeof(double) * (dim_n * (1 + prime_count) + dim_k * (prime_count + 2));
+        return std::max(size_t(1), std::min(dim_m, m_chunk_bytes / row_bytes));
+    }
+
+    // writes the 16 bit limbs of count entries as polynomials of pts coefficients
+    static void pack(double *out, const mpz_srcptr *entries, size_t count, size_t pts)
+    {
+#pragma omp parallel for
+        for (long i = 0; i < long(count); i++)
+        {
+            to_kronecker_16(out + i * pts, entries[i], pts);
+        }
+    }
+
+    static void to_kronecker_16(double *out, mpz_srcptr in, size_t pts)
+    {
+        const uint16_t *limbs = reinterpret_cast<const uint16_t *>(mpz_limbs_read(in));
+        size_t count = std::min(pts, mpz_size(in) * sizeof(mp_limb_t) / sizeof(uint16_t));
+        size_t l = 0;
+#if defined(__AVX512F__)
+        for (; l + 16 <= count; l += 16)
+        {
+            __m512i w = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(limbs + l)));
+            _mm512_storeu_pd(out + l, _mm512_cvtepi32_pd(_mm512_castsi512_si256(w)));
+            _mm512_storeu_pd(out + l + 8, _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(w, 1)));
+        }
+#elif defined(__AVX2__)
+        for (; l + 8 <= count; l += 8)
+        {
+            __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(limbs + l)));
+            _mm256_storeu_pd(out + l, _mm256_cvtepi32_pd(_mm256_castsi256_si128(w)));
+            _mm256_storeu_pd(out + l + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(w, 1)));
+        }
+#endif
+        for (; l < count; l++)
+        {
+            out[l] = limbs[l];
+        }
+        for (; l < pts; l++)
+        {
+            out[l] = 0.;
+        }
+    }
+
+    /*
+        the coefficients from their residues modulo the primes, in mixed radix:
+        v_i = (((r_i - v_0) p_0^-1 - v_1) p_1^-1 - ...) mod p_i, then
+        v_0 + p_0 (v_1 + p_1 (v_2 + ...)) in 128 bits, whose high half goes to hi (if not NULL)
+    */
+    static void garner(uint64_t *lo, uint64_t *hi, const std::vector<const double *> &residues,
+                       const std::vector<uint64_t> &primes, const std::vector<uint64_t> &inverses, size_t count)
+    {
+        size_t prime_count = primes.size();
+#pragma omp parallel for
+        for (long e = 0; e < long(count); e++)
+        {
+            uint64_t v[KRONECKER_FFT_PRIMES_MAX];
+            for (size_t i = 0; i < prime_count; i++)
+            {
+                uint64_t p = primes[i];
+                v[i] = uint64_t(residues[i][e]);
+                for (size_t j = 0; j < i; j++)
+                {
+                    v[i] = (v[i] + p - v[j] % p) % p * inverses[i * prime_count + j] % p;
+                }
+            }
+            uint128_t x = v[prime_count - 1];
+            for (size_t i = prime_count - 1; i-- > 0;)
+            {
+                x = x * primes[i] + v[i];
+            }
+            lo[e] = uint64_t(x);
+            if (hi)
+            {
+                hi[e] = uint64_t(x >> 64);
+            }
+        }
+    }
+
+    /*
+        low = the sum of c[j] 2^(16 j) mod 2^64 over a group of four coefficients (up to 66 bits)
+        and spill = the sum of their bits above 2^64, which belong to the next limb
+    */
+    static inline void group_sums(const uint64_t *c, uint128_t &low, uint64_t &spill)
+    {
+#if defined(__AVX2__)
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(c));
+        alignas(32) uint64_t lo[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lo), _mm256_sllv_epi64(v, _mm256_setr_epi64x(0, 16, 32, 48)));
+        // a shift by 64 gives 0
+        __m256i hi = _mm256_srlv_epi64(v, _mm256_setr_epi64x(64, 48, 32, 16));
+        __m128i h = _mm_add_epi64(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1));
+        spill = uint64_t(_mm_cvtsi128_si64(h)) + uint64_t(_mm_extract_epi64(h, 1));
+        low = uint128_t(lo[0]) + lo[1] + lo[2] + lo[3];
+#else
+        low = uint128_t(c[0]) + (c[1] << 16) + (c[2] << 32) + (c[3] << 48);
+        spill = (c[1] >> 48) + (c[2] >> 32) + (c[3] >> 16);
+#endif
+    }
+
+    // the same on a group of the low halves and the group of the high halves at once
+    static inline void group_sums(const uint64_t *c, const uint64_t *d, uint128_t &low_c, uint64_t &spill_c, uint128_t &low_d, uint64_t &spill_d)
+    {
+#if defined(__AVX512F__)
+        __m512i v = _mm512_inserti64x4(_mm512_zextsi256_si512(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(c))),
+                                       _mm256_loadu_si256(reinterpret_cast<const __m256i *>(d)), 1);
+        alignas(64) uint64_t lo[8], hi[8];
+        _mm512_store_si512(lo, _mm512_sllv_epi64(v, _mm512_setr_epi64(0, 16, 32, 48, 0, 16, 32, 48)));
+        _mm512_store_si512(hi, _mm512_srlv_epi64(v, _mm512_setr_epi64(64, 48, 32, 16, 64, 48, 32, 16)));
+        low_c = uint128_t(lo[0]) + lo[1] + lo[2] + lo[3];
+        low_d = uint128_t(lo[4]) + lo[5] + lo[6] + lo[7];
+        spill_c = hi[1] + hi[2] + hi[3];
+        spill_d = hi[5] + hi[6] + hi[7];
+#else
+        group_sums(c, low_c, spill_c);
+        group_sums(d, low_d, spill_d);
+#endif
+    }
+
+    /*
+        out = the sum of (lo[l] + 2^64 hi[l]) 2^(16 l) over the d coefficients (hi may be NULL),
+        written limb by limb into out in a single pass: limb w takes the group w of the low
+        halves, the spill of the group before, and with hi the group w - 1 of the high halves
+        and the spill of the group before that, plus the carry
+    */
+    static void from_kronecker_16(Givaro::Integer &out, const uint64_t *lo, const uint64_t *hi, uint64_t d)
+    {
+        static_assert(GMP_NUMB_BITS == 64, "from_kronecker_16 writes 64 bit limbs");
+        size_t groups = (d + 3) / 4;
+        size_t n = groups + (hi ? 2 : 1);
+        mp_limb_t *limbs = mpz_limbs_write(out.get_mpz(), n);
+        uint128_t acc = 0, low_hi_prev = 0;
+        uint64_t spill_lo = 0, spill_hi = 0, spill_hi_prev = 0;
+        for (size_t w = 0; w < n; w++)
+        {
+            uint128_t low_lo = 0, low_hi = 0;
+            uint64_t next_spill_lo = 0, next_spill_hi = 0;
+            if (w < groups)
+            {
+                const uint64_t *c = lo + 4 * w, *h = hi ? hi + 4 * w : NULL;
+                uint64_t tail_lo[4] = {0, 0, 0, 0}, tail_hi[4] = {0, 0, 0, 0};
+                if (4 * w + 4 > d)
+                {
+                    // the last group is partial, the coefficients past d are not read
+                    std::copy(c, lo + d, tail_lo);
+                    c = tail_lo;
+                    if (h)
+                    {
+                        std::copy(h, hi + d, tail_hi);
+                        h = tail_hi;
+                    }
+                }
+                if (h)
+                {
+                    group_sums(c, h, low_lo, next_spill_lo, low_hi, next_spill_hi);
+                }
+                else
+                {
+                    group_sums(c, low_lo, next_spill_lo);
+                }
+            }
+            acc += low_lo + spill_lo + low_hi_prev + spill_hi_prev;
+            limbs[w] = mp_limb_t(acc);
+            acc >>= 64;
+            spill_lo = next_spill_lo;
+            low_hi_prev = low_hi;
+            spill_hi_prev = spill_hi;
+            spill_hi = next_spill_hi;
+        }
+        mpz_limbs_finish(out.get_mpz(), n);
+    }
+};
+
+#endif // H_KRONECKER_FFT
@@ -0,0 +1,111 @@
+#if !defined(H_LIMB_MATRIX)
+#define H_LIMB_MATRIX
+
+#include <gmp++/gmp++.h>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/*
+    A dense dim_m x dim_n integer matrix (row major) in one contiguous block of limbs:
+    every entry takes stride() limbs, least significant first and zero padded, and keeps
+    its signed size in limbs as an mpz does (negative for negative entries).
+    Entries are read through read-only mpz views (mpz_roinit_n) without copying, so a matrix
+    is two allocations whatever its size, and data() can be handed to SIMD code or written out.
+*/
+class LimbMatrix
+{
+  public:
+    size_t dim_m = 0;
+    size_t dim_n = 0;
+
+  protected:
+    size_t m_stride = 0;
+    std::vector<mp_limb_t> m_limbs;
+    std::vector<int> m_sizes;
+
+  public:
+    LimbMatrix() {}
+    LimbMatrix(size_t dim_m, size_t dim_n, size_t stride)
+        : dim_m(dim_m), dim_n(dim_n), m_stride(stride), m_limbs(dim_m * dim_n * stride), m_sizes(dim_m * dim_n) {}
+
+    /*
+        use this method to pack a row major vector of integers, the stride fits the largest entry
+    */
+    static LimbMatrix from_integers(const std::vector<Givaro::Integer> &entries, size_t dim_m, size_t dim_n)
+    {
+        assert(entries.size() == dim_m * dim_n && "input matrix dimension is incorrect");
+        size_t stride = 1;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            stride = std::max(stride, mpz_size(entries[i].get_mpz()));
+        }
+        LimbMatrix mat(dim_m, dim_n, stride);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            mat.set(i, entries[i].get_mpz());
+        }
+        return mat;
+    }
+
+    std::vector<Givaro::Integer> to_integers() const
+    {
+        std::vector<Givaro::Integer> entries(count());
+        mpz_t v;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            mpz_set(entries[i].get_mpz(), view(v, i));
+        }
+        return entries;
+    }
+
+    inline size_t count() const { return m_sizes.size(); }
+    inline size_t stride() const { return m_stride; }
+    inline const mp_limb_t *data() const { return m_limbs.data(); }
+    inline const mp_limb_t *limbs(size_t i) const { return m_limbs.data() + i * m_stride; }
+    inline int size(size_t i) const { return m_sizes[i]; }
+
+    // the entry i as a read-only mpz, valid as long as the matrix is not modified
+    inline mpz_srcptr view(mpz_t v, size_t i) const
+    {
+        return mpz_roinit_n(v, limbs(i), m_sizes[i]);
+    }
+
+    inline mpz_srcptr view(mpz_t v, size_t r, size_t c) const
+    {
+        return view(v, r * dim_n + c);
+    }
+
+    void set(size_t i, mpz_srcptr a)
+    {
+        size_t n = mpz_size(a);
+        assert(n <= m_stride && "entry does not fit in the stride of the LimbMatrix");
+        mp_limb_t *p = m_limbs.data() + i * m_stride;
+        const mp_limb_t *src = mpz_limbs_read(a);
+        std::copy(src, src + n, p);
+        std::fill(p + n, p + m_stride, 0);
+        m_sizes[i] = mpz_sgn(a) < 0 ? -int(n) : int(n);
+    }
+
+    bool nonnegative() const
+    {
+        return std::find_if(m_sizes.begin(), m_sizes.end(), [](int size) { return size < 0; }) == m_sizes.end();
+    }
+
+    size_t max_bitsize() const
+    {
+        size_t bitsize = 0;
+        mpz_t v;
+        for (size_t i = 0; i < count(); i++)
+        {
+            if (m_sizes[i])
+            {
+                bitsize = std::max(bitsize, mpz_sizeinbase(view(v, i), 2));
+            }
+        }
+        return bitsize;
+    }
+};
+
+#endif // H_LIMB_MATRIX
@@ -0,0 +1,189 @@
+
+using namespace std;
+
+#include "bench_common.h"
+#include "blas_crt.h"
+#include "gen_prime.h"
+#include "sim_rns.h"
+#include <gmp++/gmp++.h>
+#include <fflas-ffpack/field/rns-double.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <omp.h>
+
+// Benchmarks the level 2 simultaneous reduction and CRT of the two phase algorithms:
+// BlasCRT's matrix products against FFLAS' finit_rns / fconvert_rns, on the level 2 basis
+// TwoPhaseAbstract builds for level 1 residues of the given bitsizes, over the number of
+// integers converted at once. Both backends must agree, the report has one record per
+// backend and phase with dim_m the number of integers and dim_n the number of level 2 moduli:
+//
+//   ./bench -b 1024,4096,16384 -n 1024,65536 -f csv -o blas_crt.csv
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " [options]" << endl
+         << "  -b B,...   level 1 residue bitsizes (default: 1024,4096,16384)" << endl
+         << "  -n N,...   integers converted at once (default: 1024,16384)" << endl
+         << "  -i R       repetitions (default: 5)" << endl
+         << "  -f F       report format, json or csv (default: json)" << endl
+         << "  -o FILE    write the report to FILE (default: stdout)" << endl
+         << "  -r SEED    random seed" << endl;
+}
+
+static BenchRecord make_record(const string &algorithm, const string &phase, size_t len, size_t count, uint64_t input_bitsize)
+{
+    BenchRecord record;
+    record.algorithm = algorithm;
+    record.phase = phase;
+    record.dim_m = len;
+    record.dim_n = count;
+    record.dim_k = 1;
+    record.input_bitsize = input_bitsize;
+    record.moduli_bitsize = 0;
+    // BlasCRT's split and combine loops run on the OpenMP threads (set with OMP_NUM_THREADS)
+    record.threads = omp_get_max_threads();
+    return record;
+}
+
+int main(int argc, char **argv)
+{
+    vector<uint64_t> input_bitsizes;
+    vector<uint64_t> lengths;
+    size_t reps = 5;
+    string format = "json";
+    string output;
+    unsigned long seed = time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "b:n:i:f:o:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            input_bitsizes = bench_parse_numbers(optarg);
+            break;
+        case 'n':
+            lengths = bench_parse_numbers(optarg);
+            break;
+        case 'i':
+            reps = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (input_bitsizes.empty())
+    {
+        input_bitsizes = bench_parse_numbers("1024,4096,16384");
+    }
+    if (lengths.empty())
+    {
+        lengths = bench_parse_numbers("1024,16384");
+    }
+    if (reps == 0 || (format != "json" && format != "csv"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    Givaro::Integer::seeding(seed);
+
+    typedef FFPACK::RNSInteger<FFPACK::rns_double> RNS_Field;
+    typedef Givaro::Modular<Givaro::Integer> Int_Field;
+    vector<BenchRecord> records;
+    for (size_t b = 0; b < input_bitsizes.size(); b++)
+    {
+        uint64_t input_bitsize = input_bitsizes[b];
+        // the level 2 basis of TwoPhaseAbstract for level 1 moduli of input_bitsize bits
+        GenPrimeMost<double> moduli(2 * input_bitsize + 10, 21);
+        FFPACK::rns_double rns{moduli};
+        RNS_Field rns_field(rns);
+        Int_Field int_field(moduli.product());
+        BlasCRT crt(moduli, input_bitsize);
+        for (size_t l = 0; l < lengths.size(); l++)
+        {
+            size_t len = lengths[l];
+            vector<Givaro::Integer> inputs(len);
+            for (size_t i = 0; i < len; i++)
+            {
+                inputs[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+            }
+            BenchRecord blas_reduce = make_record("blas_crt", "reduce", len, moduli.count(), input_bitsize);
+            BenchRecord blas_recover = make_record("blas_crt", "recover", len, moduli.count(), input_bitsize);
+            BenchRecord fflas_reduce = make_record("fflas", "reduce", len, moduli.count(), input_bitsize);
+            BenchRecord fflas_recover = make_record("fflas", "recover", len, moduli.count(), input_bitsize);
+            for (size_t r = 0; r < reps; r++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                RNS_Field::Element_ptr blas_residues = SIM_RNS::blas_new_sim_reduce<Int_Field>(crt, inputs, rns_field);
+                blas_reduce.stats.add(bench_seconds_since(start));
+                start = chrono::steady_clock::now();
+                vector<Givaro::Integer> blas_outputs = SIM_RNS::blas_new_sim_recover(crt, rns_field, blas_residues, len, int_field);
+                blas_recover.stats.add(bench_seconds_since(start));
+
+                start = chrono::steady_clock::now();
+                RNS_Field::Element_ptr fflas_residues = SIM_RNS::fflas_new_sim_reduce(int_field, inputs, rns_field);
+                fflas_reduce.stats.add(bench_seconds_since(start));
+                start = chrono::steady_clock::now();
+                vector<Givaro::Integer> fflas_outputs = SIM_RNS::fflas_new_sim_recover(rns_field, fflas_residues, len, int_field);
+                fflas_recover.stats.add(bench_seconds_since(start));
+
+                if (r == 0)
+                {
+                    // FFLAS may leave its residues in the symmetric range
+                    bool residues_agree = true;
+                    for (size_t i = 0; i < len * moduli.count(); i++)
+                    {
+                        residues_agree = residues_agree && fmod(blas_residues._ptr[i] - fflas_residues._ptr[i], moduli.val(i / len)) == 0;
+                    }
+                    if (!residues_agree || !equals(blas_outputs, inputs) || !equals(fflas_outputs, inputs))
+                    {
+                        cerr << "ERROR! RESULT IS INCORRECT for " << len << " integers of " << input_bitsize << " bits" << endl;
+                        return 2;
+                    }
+                }
+                FFLAS::fflas_delete(blas_residues);
+                FFLAS::fflas_delete(fflas_residues);
+            }
+            records.push_back(blas_reduce);
+            records.push_back(blas_recover);
+            records.push_back(fflas_reduce);
+            records.push_back(fflas_recover);
+            cerr << len << " integers of " << input_bitsize << " bits, " << moduli.count() << " moduli: reduce blas_crt "
+                 << blas_reduce.stats.median() << "s fflas " << fflas_reduce.stats.median() << "s, recover blas_crt "
+                 << blas_recover.stats.median() << "s fflas " << fflas_recover.stats.median() << "s" << endl;
+        }
+    }
+
+    ofstream file;
+    if (!output.empty())
+    {
+        file.open(output.c_str());
+        if (!file)
+        {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+    }
+    ostream &out = output.empty() ? cout : file;
+    if (format == "csv")
+    {
+        bench_write_csv(out, records);
+    }
+    else
+    {
+        bench_write_json(out, records);
+    }
+    return 0;
+}
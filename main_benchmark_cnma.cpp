@@ -0,0 +1,584 @@
+
+using namespace std;
+
+#include "bench_common.h"
+#include "perf_counters.h"
+#include "two_phase_tuner.h"
+#include <gmp++/gmp++.h>
+#include "cnma/marge_num.h"
+#include "cnma/parge_num.h"
+#include "cnma/reconstruct_marge.h"
+#include "cnma/reconstruct_parge_block.h"
+#include "cnma/reconstruct_parge_shift.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Microbenchmarks of the CNMA kernels against the plain GMP / textbook code they replace:
+//  - dc_reduce_minus and dc_reduce_plus against mpz_mod by 2^n - 1 and 2^n + 1,
+//    over the input bitsizes and moduli exponents n
+//  - garner_marge, garner_parge_block and garner_parge_shift_mixed against garner_simple_*,
+//    on the first level 1 moduli the generators of their schemes yield, over the moduli
+//    exponents and level 1 counts
+// the dc_reduce kernels work in place, so their ops include the mpz_set of the input as
+// in the recovery loops. Each configuration runs a calibrated number of ops per repetition,
+// after warmup, on a pinned CPU, and is reported as min / median / p95 ns per op and
+// the bytes per cycle of its input (reduce) or output (Garner) as JSON or CSV:
+//
+//   ./bench -k dc_reduce_minus,garner_marge -b 1024,65536 -e 64,1024 -l 4,16 -f csv -o cnma.csv
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " [options]" << endl
+         << "  -k K,...   kernels among dc_reduce_minus, dc_reduce_plus, garner_marge, garner_parge_block," << endl
+         << "             garner_parge_shift_mixed (default: all)" << endl
+         << "  -b B,...   reduce input bitsizes (default: 2^10, 2^12, ..., 2^20)" << endl
+         << "  -e E,...   moduli exponents (default: 64,256,1024,4096)" << endl
+         << "  -l L,...   Garner level 1 moduli counts (default: 4,8,16)" << endl
+         << "  -i R       timed repetitions (default: 7)" << endl
+         << "  -w W       warmup repetitions (default: 2)" << endl
+         << "  -m MS      minimum milliseconds per repetition (default: 10)" << endl
+         << "  -p CPU     pin to CPU, -1 not to pin (default: 0)" << endl
+         << "  -f F       report format, json or csv (default: json)" << endl
+         << "  -o FILE    write the report to FILE (default: stdout)" << endl
+         << "  -r SEED    random seed" << endl;
+}
+
+// one row of the report: a kernel or its baseline on one configuration
+struct CnmaRecord
+{
+    string kernel;
+    string variant; // "kernel" or "baseline"
+    string baseline;
+    uint64_t input_bitsize;
+    uint64_t moduli_exponent;
+    size_t level_1_count; // 0 for the reductions
+    size_t ops;           // per repetition
+    double bytes_per_op;
+    uint64_t cycles; // over all timed repetitions, 0 if no cycle counter
+    BenchStats stats;  // seconds per op
+};
+
+// cycles from the hardware counters, or the time stamp counter (reference cycles) without them
+class CycleClock
+{
+    bool m_perf;
+
+  public:
+    CycleClock() : m_perf(PerfCounters::for_this_thread().available(PERF_EVENT_CYCLES)) {}
+
+    const char *source() const
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return m_perf ? "perf" : "tsc";
+#else
+        return m_perf ? "perf" : "none";
+#endif
+    }
+
+    uint64_t now() const
+    {
+        if (m_perf)
+        {
+            return PerfCounters::for_this_thread().read().val[PERF_EVENT_CYCLES];
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+};
+
+struct BenchConfig
+{
+    size_t reps;
+    size_t warmup;
+    double min_seconds;
+};
+
+/*
+    use this method to time op(0), op(1), ... into record: the ops per repetition are doubled
+    until one repetition takes min_seconds, then warmup repetitions are discarded
+*/
+template <typename Op>
+void measure(Op op, const BenchConfig &config, const CycleClock &clock, CnmaRecord &record)
+{
+    size_t ops = 1;
+    while (true)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; i++)
+        {
+            op(i);
+        }
+        if (bench_seconds_since(start) >= config.min_seconds || ops >= (size_t(1) << 30))
+        {
+            break;
+        }
+        ops <<= 1;
+    }
+    record.ops = ops;
+    record.cycles = 0;
+    for (size_t r = 0; r < config.warmup + config.reps; r++)
+    {
+        uint64_t c0 = clock.now();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; i++)
+        {
+            op(i);
+        }
+        double seconds = bench_seconds_since(start);
+        uint64_t c1 = clock.now();
+        if (r >= config.warmup)
+        {
+            record.stats.add(seconds / ops);
+            record.cycles += c1 - c0;
+        }
+    }
+}
+
+// the number of distinct inputs cycled through, so that one op does not see the last one's output in cache
+const size_t BENCH_CNMA_INPUTS = 16;
+
+/*
+    use this method to benchmark a dc_reduce kernel (sign -1: 2^n - 1, +1: 2^n + 1) and mpz_mod
+*/
+static void bench_reduce(const string &kernel, int sign, uint64_t input_bitsize, uint64_t n,
+                         const BenchConfig &config, const CycleClock &clock, vector<CnmaRecord> &records)
+{
+    vector<Givaro::Integer> inputs(BENCH_CNMA_INPUTS);
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        inputs[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+    }
+    Givaro::Integer m = (Givaro::Integer(1) << n) + sign;
+    mpz_t a, t, r;
+    mpz_init2(a, input_bitsize + GMP_NUMB_BITS);
+    mpz_init2(t, input_bitsize + GMP_NUMB_BITS);
+    mpz_init2(r, n + GMP_NUMB_BITS);
+
+    // both must agree before anything is timed
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        mpz_set(a, inputs[i].get_mpz());
+        sign < 0 ? CNMA::dc_reduce_minus(a, n, t) : CNMA::dc_reduce_plus(a, n, t);
+        mpz_mod(r, inputs[i].get_mpz(), m.get_mpz());
+        mpz_mod(a, a, m.get_mpz());
+        if (mpz_cmp(a, r) != 0)
+        {
+            cerr << kernel << " disagrees with mpz_mod on a " << input_bitsize << " bits input, n = " << n << endl;
+            abort();
+        }
+    }
+
+    CnmaRecord record;
+    record.kernel = kernel;
+    record.baseline = "mpz_mod";
+    record.input_bitsize = input_bitsize;
+    record.moduli_exponent = n;
+    record.level_1_count = 0;
+    record.bytes_per_op = input_bitsize / 8.0;
+    CnmaRecord kernel_record = record, baseline_record = record;
+    kernel_record.variant = "kernel";
+    baseline_record.variant = "baseline";
+    if (sign < 0)
+    {
+        measure([&](size_t i) { mpz_set(a, inputs[i % BENCH_CNMA_INPUTS].get_mpz()); CNMA::dc_reduce_minus(a, n, t); },
+                config, clock, kernel_record);
+    }
+    else
+    {
+        measure([&](size_t i) { mpz_set(a, inputs[i % BENCH_CNMA_INPUTS].get_mpz()); CNMA::dc_reduce_plus(a, n, t); },
+                config, clock, kernel_record);
+    }
+    measure([&](size_t i) { mpz_mod(r, inputs[i % BENCH_CNMA_INPUTS].get_mpz(), m.get_mpz()); },
+            config, clock, baseline_record);
+    records.push_back(kernel_record);
+    records.push_back(baseline_record);
+    mpz_clear(a);
+    mpz_clear(t);
+    mpz_clear(r);
+}
+
+/*
+    use this method to get the first level_1_count moduli the generator of scheme yields
+    with moduli of moduli_exponent bits, empty if it runs out of them
+*/
+static vector<Givaro::Integer> level_1_moduli(TwoPhaseScheme scheme, uint64_t moduli_exponent, size_t level_1_count)
+{
+    TwoPhasePlan plan;
+    plan.scheme = scheme;
+    plan.moduli_bitsize = moduli_exponent;
+    plan.seconds = 0;
+    // the smallest product bound giving that many moduli
+    vector<uint64_t> expos;
+    for (plan.product_bitsize = 2 * moduli_exponent + 1;; plan.product_bitsize += moduli_exponent / 4 + 1)
+    {
+        if (!plan.feasible())
+        {
+            return vector<Givaro::Integer>();
+        }
+        plan.level_1_exponents(expos);
+        if (expos.size() >= level_1_count)
+        {
+            break;
+        }
+    }
+    vector<Givaro::Integer> moduli;
+    switch (scheme)
+    {
+    case TWO_PHASE_MARGE_MOST:
+    {
+        GenMargeMost gen(plan.product_bitsize, plan.moduli_bitsize);
+        moduli.assign(gen.begin(), gen.end());
+        break;
+    }
+    case TWO_PHASE_PARGE_BLOCK:
+    {
+        GenPargeBlock gen(plan.product_bitsize, plan.moduli_bitsize, TWO_PHASE_PARGE_BLOCK_SIZE);
+        moduli.assign(gen.begin(), gen.end());
+        break;
+    }
+    case TWO_PHASE_PARGE_SHIFT:
+    {
+        GenPargeShift gen(plan.product_bitsize, plan.moduli_bitsize, TWO_PHASE_PARGE_SHIFT_COEFFICIENT);
+        moduli.assign(gen.begin(), gen.end());
+        break;
+    }
+    default:
+        assert(false && "no Garner kernel for this scheme");
+    }
+    if (moduli.size() > level_1_count)
+    {
+        moduli.resize(level_1_count);
+    }
+    return moduli;
+}
+
+/*
+    use this method to benchmark the Garner kernel of scheme and garner_simple_*
+*/
+static void bench_garner(const string &kernel, TwoPhaseScheme scheme, uint64_t moduli_exponent, size_t level_1_count,
+                         const BenchConfig &config, const CycleClock &clock, vector<CnmaRecord> &records)
+{
+    vector<Givaro::Integer> moduli = level_1_moduli(scheme, moduli_exponent, level_1_count);
+    if (moduli.size() < 2)
+    {
+        cerr << "skipping " << kernel << " with " << moduli_exponent << " bits moduli: not enough moduli" << endl;
+        return;
+    }
+    const size_t N = moduli.size();
+    Givaro::Integer product = 1;
+    for (size_t f = 0; f < N; f++)
+    {
+        product *= moduli[f];
+    }
+    const mp_bitcnt_t product_bitsize = product.bitsize() + 2 * moduli[0].bitsize();
+
+    // the moduli, their exponents and Mi as the two phase schemes set them up
+    vector<uint64_t> expo(N);
+    mpz_t *m = new mpz_t[N], *Mi = new mpz_t[N], *work = new mpz_t[N], *residues = new mpz_t[N * BENCH_CNMA_INPUTS];
+    mpz_t scratch[2], a, check;
+    Givaro::Integer prefix = 1;
+    for (size_t f = 0; f < N; f++)
+    {
+        mpz_init_set(m[f], moduli[f].get_mpz());
+        mpz_init(Mi[f]);
+        if (f > 0)
+        {
+            mpz_invert(Mi[f], prefix.get_mpz(), m[f]);
+        }
+        prefix *= moduli[f];
+        mpz_init2(work[f], product_bitsize);
+        switch (scheme)
+        {
+        case TWO_PHASE_MARGE_MOST:
+            expo[f] = (moduli[f] + 1).bitsize() - 1;
+            break;
+        case TWO_PHASE_PARGE_BLOCK:
+            expo[f] = (moduli[f] - 1).bitsize() - 1;
+            break;
+        default:
+            expo[f] = moduli[f].bitsize() - 1;
+        }
+    }
+    mpz_init2(scratch[0], product_bitsize);
+    mpz_init2(scratch[1], product_bitsize);
+    mpz_init2(a, product_bitsize);
+    mpz_init2(check, product_bitsize);
+    vector<Givaro::Integer> inputs(BENCH_CNMA_INPUTS);
+    for (size_t i = 0; i < BENCH_CNMA_INPUTS; i++)
+    {
+        inputs[i] = Givaro::Integer::random_lessthan(product);
+        for (size_t f = 0; f < N; f++)
+        {
+            mpz_init(residues[i * N + f]);
+            mpz_mod(residues[i * N + f], inputs[i].get_mpz(), m[f]);
+        }
+    }
+
+    auto run_kernel = [&](size_t i) {
+        const mpz_t *r = residues + (i % BENCH_CNMA_INPUTS) * N;
+        switch (scheme)
+        {
+        case TWO_PHASE_MARGE_MOST:
+            CNMA::garner_marge(a, N, r, expo.data(), m, Mi, work, scratch);
+            break;
+        case TWO_PHASE_PARGE_BLOCK:
+            CNMA::garner_parge_block(a, N, r, expo.data(), m, Mi, work, scratch);
+            break;
+        default:
+            CNMA::garner_parge_shift_mixed(a, N, r, expo.data(), m, Mi, TWO_PHASE_PARGE_SHIFT_COEFFICIENT, work, scratch);
+        }
+    };
+    auto run_baseline = [&](size_t i) {
+        const mpz_t *r = residues + (i % BENCH_CNMA_INPUTS) * N;
+        if (scheme == TWO_PHASE_MARGE_MOST)
+        {
+            CNMA::garner_simple_marge(check, N, r, m, Mi);
+        }
+        else
+        {
+            CNMA::garner_simple_parge_block(check, N, r, m, Mi);
+        }
+    };
+
+    // both must recover the inputs before anything is timed
+    for (size_t i = 0; i < BENCH_CNMA_INPUTS; i++)
+    {
+        run_kernel(i);
+        mpz_mod(a, a, product.get_mpz());
+        run_baseline(i);
+        if (mpz_cmp(a, inputs[i].get_mpz()) != 0 || mpz_cmp(check, inputs[i].get_mpz()) != 0)
+        {
+            cerr << kernel << " does not recover its input with " << N << " moduli of " << moduli_exponent << " bits" << endl;
+            abort();
+        }
+    }
+
+    CnmaRecord record;
+    record.kernel = kernel;
+    record.baseline = scheme == TWO_PHASE_MARGE_MOST ? "garner_simple_marge" : "garner_simple_parge_block";
+    record.input_bitsize = product.bitsize();
+    record.moduli_exponent = moduli_exponent;
+    record.level_1_count = N;
+    record.bytes_per_op = product.bitsize() / 8.0;
+    CnmaRecord kernel_record = record, baseline_record = record;
+    kernel_record.variant = "kernel";
+    baseline_record.variant = "baseline";
+    measure(run_kernel, config, clock, kernel_record);
+    measure(run_baseline, config, clock, baseline_record);
+    records.push_back(kernel_record);
+    records.push_back(baseline_record);
+
+    for (size_t i = 0; i < N * BENCH_CNMA_INPUTS; i++)
+    {
+        mpz_clear(residues[i]);
+    }
+    for (size_t f = 0; f < N; f++)
+    {
+        mpz_clear(m[f]);
+        mpz_clear(Mi[f]);
+        mpz_clear(work[f]);
+    }
+    mpz_clear(scratch[0]);
+    mpz_clear(scratch[1]);
+    mpz_clear(a);
+    mpz_clear(check);
+    delete[] m;
+    delete[] Mi;
+    delete[] work;
+    delete[] residues;
+}
+
+static double bytes_per_cycle(const CnmaRecord &r)
+{
+    return r.cycles ? r.bytes_per_op * r.ops * r.stats.count() / r.cycles : 0;
+}
+
+static void write_json(ostream &out, const vector<CnmaRecord> &records, const char *cycles_source)
+{
+    out << "[" << endl;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const CnmaRecord &r = records[i];
+        out << "  {\"kernel\": \"" << r.kernel << "\", \"variant\": \"" << r.variant << "\", \"baseline\": \"" << r.baseline << "\""
+            << ", \"input_bitsize\": " << r.input_bitsize << ", \"moduli_exponent\": " << r.moduli_exponent
+            << ", \"level_1_count\": " << r.level_1_count << ", \"ops\": " << r.ops << ", \"reps\": " << r.stats.count()
+            << ", \"min_ns\": " << r.stats.min() * 1e9 << ", \"median_ns\": " << r.stats.median() * 1e9 << ", \"p95_ns\": " << r.stats.p95() * 1e9
+            << ", \"bytes_per_cycle\": " << bytes_per_cycle(r) << ", \"cycles_source\": \"" << cycles_source << "\""
+            << "}" << (i + 1 < records.size() ? "," : "") << endl;
+    }
+    out << "]" << endl;
+}
+
+static void write_csv(ostream &out, const vector<CnmaRecord> &records, const char *cycles_source)
+{
+    out << "kernel,variant,baseline,input_bitsize,moduli_exponent,level_1_count,ops,reps,min_ns,median_ns,p95_ns,bytes_per_cycle,cycles_source" << endl;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const CnmaRecord &r = records[i];
+        out << r.kernel << "," << r.variant << "," << r.baseline << "," << r.input_bitsize << "," << r.moduli_exponent << ","
+            << r.level_1_count << "," << r.ops << "," << r.stats.count() << "," << r.stats.min() * 1e9 << ","
+            << r.stats.median() * 1e9 << "," << r.stats.p95() * 1e9 << "," << bytes_per_cycle(r) << "," << cycles_source << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> kernels;
+    vector<uint64_t> input_bitsizes;
+    vector<uint64_t> exponents;
+    vector<uint64_t> level_1_counts;
+    BenchConfig config = {7, 2, 0.01};
+    int cpu = 0;
+    string format = "json";
+    string output;
+    unsigned long seed = time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "k:b:e:l:i:w:m:p:f:o:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'k':
+            kernels = bench_split(optarg);
+            break;
+        case 'b':
+            input_bitsizes = bench_parse_numbers(optarg);
+            break;
+        case 'e':
+            exponents = bench_parse_numbers(optarg);
+            break;
+        case 'l':
+            level_1_counts = bench_parse_numbers(optarg);
+            break;
+        case 'i':
+            config.reps = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            config.warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            config.min_seconds = strtod(optarg, NULL) / 1000;
+            break;
+        case 'p':
+            cpu = atoi(optarg);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    const char *all_kernels[] = {"dc_reduce_minus", "dc_reduce_plus", "garner_marge", "garner_parge_block", "garner_parge_shift_mixed"};
+    if (kernels.empty())
+    {
+        kernels.assign(all_kernels, all_kernels + 5);
+    }
+    if (input_bitsizes.empty())
+    {
+        for (uint64_t b = 1 << 10; b <= (1 << 20); b <<= 2)
+        {
+            input_bitsizes.push_back(b);
+        }
+    }
+    if (exponents.empty())
+    {
+        uint64_t defaults[] = {64, 256, 1024, 4096};
+        exponents.assign(defaults, defaults + 4);
+    }
+    if (level_1_counts.empty())
+    {
+        uint64_t defaults[] = {4, 8, 16};
+        level_1_counts.assign(defaults, defaults + 3);
+    }
+    if (config.reps == 0 || (format != "json" && format != "csv"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+        if (find(all_kernels, all_kernels + 5, kernels[k]) == all_kernels + 5)
+        {
+            cerr << "unknown kernel: " << kernels[k] << endl;
+            return 1;
+        }
+    }
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        {
+            cerr << "cannot pin to CPU " << cpu << ", running unpinned" << endl;
+        }
+    }
+    Givaro::Integer::seeding(seed);
+
+    // the cycle counter is opened after pinning, on the thread that runs the kernels
+    CycleClock clock;
+    vector<CnmaRecord> records;
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+        const string &kernel = kernels[k];
+        for (size_t e = 0; e < exponents.size(); e++)
+        {
+            if (kernel == "dc_reduce_minus" || kernel == "dc_reduce_plus")
+            {
+                for (size_t b = 0; b < input_bitsizes.size(); b++)
+                {
+                    // inputs below the modulus are already reduced
+                    if (input_bitsizes[b] > exponents[e])
+                    {
+                        bench_reduce(kernel, kernel == "dc_reduce_minus" ? -1 : +1, input_bitsizes[b], exponents[e], config, clock, records);
+                    }
+                }
+                continue;
+            }
+            TwoPhaseScheme scheme = kernel == "garner_marge" ? TWO_PHASE_MARGE_MOST : kernel == "garner_parge_block" ? TWO_PHASE_PARGE_BLOCK : TWO_PHASE_PARGE_SHIFT;
+            for (size_t l = 0; l < level_1_counts.size(); l++)
+            {
+                bench_garner(kernel, scheme, exponents[e], level_1_counts[l], config, clock, records);
+            }
+        }
+        cerr << kernel << " done" << endl;
+    }
+
+    ofstream file;
+    if (!output.empty())
+    {
+        file.open(output.c_str());
+        if (!file)
+        {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+    }
+    ostream &out = output.empty() ? cout : file;
+    if (format == "csv")
+    {
+        write_csv(out, records, clock.source());
+    }
+    else
+    {
+        write_json(out, records, clock.source());
+    }
+    return 0;
+}
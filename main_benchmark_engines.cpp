@@ -0,0 +1,337 @@
+
+using namespace std;
+
+#include "bench_common.h"
+#include "sim_rns.h"
+#include "two_phase_tuner.h"
+#include "kronecker_fft.h"
+#include <gmp++/gmp++.h>
+#ifdef BENCH_FLINT
+#include "flint/flint.h"
+#include "flint/fmpz.h"
+#include "flint/fmpz_mat.h"
+#endif
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Benchmarks every integer matrix product engine on identical inputs: the two phase schemes,
+// the Kronecker substitution + FFT primes KroneckerFFT, FLINT's fmpz_mat_mul (built with
+// -DBENCH_FLINT) and FFLAS-FFPACK's fgemm over the integers, over shapes, input bitsizes and
+// thread counts. Each engine takes and returns Givaro integers, conversions included.
+// Besides the per engine report, it writes the crossover map: the fastest engine of
+// every configuration, which IntegerMatMul loads as its decision table:
+//
+//   ./bench -s 16,64,256 -b 256,4096,65536 -t 1,8 -x crossover.csv -o engines.json
+//
+// the inputs are non negative, as KroneckerFFT requires
+
+static const char *engine_names[] = {"marge_most", "marge_least", "parge_block", "parge_shift", "hybrid", "kronecker", "flint", "fflas"};
+static const size_t engine_count = 8;
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " [options]" << endl
+         << "  -a A,...   engines among marge_most, marge_least, parge_block, parge_shift, hybrid, kronecker," << endl
+         << "             flint (built with -DBENCH_FLINT), fflas (default: all built ones)" << endl
+         << "  -s S,...   shapes MxNxK or D for DxDxD (default: 16,64)" << endl
+         << "  -b B,...   input bitsizes (default: 256,1024,4096)" << endl
+         << "  -t T,...   thread counts (default: 1)" << endl
+         << "  -i R       repetitions (default: 3)" << endl
+         << "  -e E       two phase level 1 moduli bitsize 2^E, 0 to auto-tune (default: 0)" << endl
+         << "  -f F       report format, json or csv (default: json)" << endl
+         << "  -o FILE    write the report to FILE (default: stdout)" << endl
+         << "  -x FILE    write the crossover map (CSV) to FILE" << endl
+         << "  -c         check every product against the fflas one" << endl
+         << "  -r SEED    random seed" << endl;
+}
+
+#ifdef BENCH_FLINT
+// a * b with FLINT, a is dim_m x dim_n and b is dim_n x dim_k
+static vector<Givaro::Integer> flint_mult_integer(const vector<Givaro::Integer> &a, const vector<Givaro::Integer> &b, size_t dim_m, size_t dim_n, size_t dim_k)
+{
+    fmpz_mat_t fa, fb, fc;
+    fmpz_mat_init(fa, dim_m, dim_n);
+    fmpz_mat_init(fb, dim_n, dim_k);
+    fmpz_mat_init(fc, dim_m, dim_k);
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        fmpz_set_mpz(fmpz_mat_entry(fa, i / dim_n, i % dim_n), a[i].get_mpz());
+    }
+    for (size_t i = 0; i < b.size(); i++)
+    {
+        fmpz_set_mpz(fmpz_mat_entry(fb, i / dim_k, i % dim_k), b[i].get_mpz());
+    }
+    fmpz_mat_mul(fc, fa, fb);
+    vector<Givaro::Integer> c(dim_m * dim_k);
+    for (size_t i = 0; i < c.size(); i++)
+    {
+        fmpz_get_mpz(c[i].get_mpz(), fmpz_mat_entry(fc, i / dim_k, i % dim_k));
+    }
+    fmpz_mat_clear(fa);
+    fmpz_mat_clear(fb);
+    fmpz_mat_clear(fc);
+    return c;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    vector<string> engines;
+    vector<BenchShape> shapes;
+    vector<uint64_t> input_bitsizes;
+    vector<uint64_t> thread_counts(1, 1);
+    size_t reps = 3;
+    size_t e = 0;
+    string format = "json";
+    string output, crossover_output;
+    bool check = false;
+    unsigned long seed = time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "a:s:b:t:i:e:f:o:x:cr:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            engines = bench_split(optarg);
+            break;
+        case 's':
+            if (!bench_parse_shapes(optarg, shapes))
+            {
+                cerr << "malformed shape list: " << optarg << endl;
+                return 1;
+            }
+            break;
+        case 'b':
+            input_bitsizes = bench_parse_numbers(optarg);
+            break;
+        case 't':
+            thread_counts = bench_parse_numbers(optarg);
+            break;
+        case 'i':
+            reps = strtoul(optarg, NULL, 10);
+            break;
+        case 'e':
+            e = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'x':
+            crossover_output = optarg;
+            break;
+        case 'c':
+            check = true;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (engines.empty())
+    {
+        for (size_t i = 0; i < engine_count; i++)
+        {
+#ifndef BENCH_FLINT
+            if (string(engine_names[i]) == "flint")
+            {
+                continue;
+            }
+#endif
+            engines.push_back(engine_names[i]);
+        }
+    }
+    if (shapes.empty())
+    {
+        bench_parse_shapes("16,64", shapes);
+    }
+    if (input_bitsizes.empty())
+    {
+        input_bitsizes = bench_parse_numbers("256,1024,4096");
+    }
+    if (reps == 0 || (format != "json" && format != "csv"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    for (size_t a = 0; a < engines.size(); a++)
+    {
+        if (find(engine_names, engine_names + engine_count, engines[a]) == engine_names + engine_count)
+        {
+            cerr << "unknown engine: " << engines[a] << endl;
+            return 1;
+        }
+#ifndef BENCH_FLINT
+        if (engines[a] == "flint")
+        {
+            cerr << "flint is not built in, rebuild with -DBENCH_FLINT" << endl;
+            return 1;
+        }
+#endif
+    }
+    Givaro::Integer::seeding(seed);
+
+    PlanCache plan_cache("mmc_plans.bin");
+    TwoPhaseTuner tuner(&plan_cache);
+    KroneckerFFT kronecker;
+    vector<BenchRecord> records;
+    for (size_t t = 0; t < thread_counts.size(); t++)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(thread_counts[t]);
+#endif
+        for (size_t s = 0; s < shapes.size(); s++)
+        {
+            const BenchShape &shape = shapes[s];
+            for (size_t b = 0; b < input_bitsizes.size(); b++)
+            {
+                uint64_t input_bitsize = input_bitsizes[b];
+                vector<Givaro::Integer> matrix_a(shape.dim_m * shape.dim_n), matrix_b(shape.dim_n * shape.dim_k);
+                for (size_t i = 0; i < matrix_a.size(); i++)
+                {
+                    matrix_a[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                }
+                for (size_t i = 0; i < matrix_b.size(); i++)
+                {
+                    matrix_b[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                }
+                vector<Givaro::Integer> expect;
+                if (check)
+                {
+                    expect = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                }
+                for (size_t a = 0; a < engines.size(); a++)
+                {
+                    const string &engine = engines[a];
+                    BenchRecord total;
+                    total.algorithm = engine;
+                    total.phase = "total";
+                    total.dim_m = shape.dim_m;
+                    total.dim_n = shape.dim_n;
+                    total.dim_k = shape.dim_k;
+                    total.input_bitsize = input_bitsize;
+                    total.moduli_bitsize = 0;
+                    total.threads = thread_counts[t];
+
+                    unique_ptr<TwoPhaseAbstract> algo;
+                    int scheme = -1;
+                    for (int sc = 0; sc < TWO_PHASE_SCHEME_COUNT; sc++)
+                    {
+                        if (engine == TwoPhasePlan::scheme_name(TwoPhaseScheme(sc)))
+                        {
+                            scheme = sc;
+                        }
+                    }
+                    if (scheme >= 0)
+                    {
+                        TwoPhasePlan plan;
+                        plan.scheme = TwoPhaseScheme(scheme);
+                        plan.product_bitsize = TwoPhaseTuner::product_bitsize_for(shape.dim_n, input_bitsize);
+                        TwoPhasePlan tuned;
+                        if (e > 0)
+                        {
+                            plan.moduli_bitsize = uint_fast64_t(1) << e;
+                        }
+                        else if (tuner.tune(shape.dim_n, input_bitsize, thread_counts[t], vector<TwoPhaseScheme>(1, plan.scheme), tuned))
+                        {
+                            plan.moduli_bitsize = tuned.moduli_bitsize;
+                        }
+                        else
+                        {
+                            cerr << "skipping " << engine << ", no feasible level 1 moduli" << endl;
+                            continue;
+                        }
+                        plan.seconds = 0;
+                        if (!plan.feasible())
+                        {
+                            cerr << "skipping infeasible " << plan << endl;
+                            continue;
+                        }
+                        algo.reset(plan.make(&plan_cache));
+                        total.moduli_bitsize = plan.moduli_bitsize;
+                    }
+
+                    for (size_t r = 0; r < reps; r++)
+                    {
+                        vector<Givaro::Integer> product;
+                        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                        if (algo)
+                        {
+                            product = algo->matrix_product(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                        }
+                        else if (engine == "kronecker")
+                        {
+                            product = kronecker.matrix_product(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                        }
+#ifdef BENCH_FLINT
+                        else if (engine == "flint")
+                        {
+                            product = flint_mult_integer(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                        }
+#endif
+                        else
+                        {
+                            product = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                        }
+                        total.stats.add(bench_seconds_since(start));
+                        if (check && r == 0 && !equals(product, expect))
+                        {
+                            cerr << "ERROR! RESULT IS INCORRECT for " << engine << " on " << shape.dim_m << "x" << shape.dim_n << "x" << shape.dim_k
+                                 << " " << input_bitsize << " bits" << endl;
+                            return 2;
+                        }
+                    }
+                    records.push_back(total);
+                    cerr << engine << " " << shape.dim_m << "x" << shape.dim_n << "x" << shape.dim_k
+                         << " " << input_bitsize << " bits, " << thread_counts[t] << " threads: median " << total.stats.median() << "s" << endl;
+                }
+            }
+        }
+    }
+
+    vector<BenchWinner> winners = bench_crossover(records);
+    bench_print_crossover(cerr, winners);
+    if (!crossover_output.empty())
+    {
+        ofstream crossover_file(crossover_output.c_str());
+        if (!crossover_file)
+        {
+            cerr << "cannot write " << crossover_output << endl;
+            return 1;
+        }
+        bench_write_crossover(crossover_file, winners);
+    }
+
+    ofstream file;
+    if (!output.empty())
+    {
+        file.open(output.c_str());
+        if (!file)
+        {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+    }
+    ostream &out = output.empty() ? cout : file;
+    if (format == "csv")
+    {
+        bench_write_csv(out, records);
+    }
+    else
+    {
+        bench_write_json(out, records);
+    }
+    return 0;
+}
@@ -55,6 +55,7 @@ using namespace std;
 #include "two_phase_marge_most.h"
 #include "two_phase_parge_block.h"
 #include "two_phase_parge_shift.h"
+#include "two_phase_tuner.h"
 #include <ostream>
 
 #include "containers.h"
@@ -90,7 +91,7 @@ static size_t seed = time(NULL);
 static Argument as[] = {
     {'q', "-q Q", "Set the field characteristic (-1 for random).", TYPE_INTEGER, &q},
     {'b', "-b B", "Set the bitsize of the random characteristic.", TYPE_INT, &b},
-    {'e', "-e E", "Set the bitsize of the level 1 moduli.", TYPE_INT, &e},
+    {'e', "-e E", "Set the bitsize of the level 1 moduli to 2^E (0 to auto-tune).", TYPE_INT, &e},
     {'d', "-d D", "Set the dimension of matrices.", TYPE_INT, &d},
     // {'m', "-m M", "Set the dimension m of the matrix.", TYPE_INT, &m},
     // {'k', "-k K", "Set the dimension k of the matrix.", TYPE_INT, &k},
@@ -100,6 +101,25 @@ static Argument as[] = {
     {'s', "-s S", "Sets seed.", TYPE_INT, &seed},
     END_OF_ARGUMENTS};
 
+// the level 1 moduli bitsize of a scheme, 2^e or the one picked by TwoPhaseTuner when e is 0
+static uint_fast64_t level_1_moduli_bitsize(TwoPhaseScheme scheme, uint_fast64_t input_bitsize)
+{
+    if (e > 0)
+    {
+        return uint_fast64_t(1) << e;
+    }
+    static PlanCache plan_cache("mmc_plans.bin");
+    TwoPhaseTuner tuner(&plan_cache);
+    TwoPhasePlan plan;
+    if (!tuner.tune(d, input_bitsize, MAX_THREADS, std::vector<TwoPhaseScheme>(1, scheme), plan))
+    {
+        cerr << "no feasible level 1 moduli for " << TwoPhasePlan::scheme_name(scheme) << " at " << input_bitsize << " bits, set them with -e" << endl;
+        abort();
+    }
+    cerr << "auto-tuned: " << plan << endl;
+    return plan.moduli_bitsize;
+}
+
 template <typename Ints>
 int tmain()
 {
@@ -246,9 +266,11 @@ int tmain()
             cerr << "===========================================" << endl;
             cerr << "======= Benchmark TwoPhasePargeShift =======" << endl;
             cerr << "===========================================" << endl;
+            // tuning (with -e 0) happens before the timer starts
+            const uint_fast64_t moduli_bitsize = level_1_moduli_bitsize(TWO_PHASE_PARGE_SHIFT, uint64_t(input_bitsize));
             chrono.clear();
             chrono.start();
-            TwoPhasePargeShift algo(2 * input_bitsize, input_bitsize / 2, 1);
+            TwoPhasePargeShift algo(2 * input_bitsize, moduli_bitsize, TWO_PHASE_PARGE_SHIFT_COEFFICIENT);
             auto a = algo.matrix_reduce(A_, m, k);
             auto b = algo.matrix_reduce(B_, k, n);
             auto c = algo.phase2_mult(a, b);
@@ -271,9 +293,10 @@ int tmain()
             cerr << "===========================================" << endl;
             cerr << "====== Benchmark TwoPhasePargeBlock =======" << endl;
             cerr << "===========================================" << endl;
+            const uint_fast64_t moduli_bitsize = level_1_moduli_bitsize(TWO_PHASE_PARGE_BLOCK, uint64_t(input_bitsize));
             chrono.clear();
             chrono.start();
-            TwoPhasePargeBlock algo(2 * input_bitsize, 1 << e, 4);
+            TwoPhasePargeBlock algo(2 * input_bitsize, moduli_bitsize, 4);
             auto a = algo.matrix_reduce(A_, m, k);
             auto b = algo.matrix_reduce(B_, k, n);
             auto c = algo.phase2_mult(a, b);
@@ -296,9 +319,10 @@ int tmain()
             cerr << "===========================================" << endl;
             cerr << "======= Benchmark TwoPhaseMargeLeast ======" << endl;
             cerr << "===========================================" << endl;
+            const uint_fast64_t moduli_bitsize = level_1_moduli_bitsize(TWO_PHASE_MARGE_LEAST, uint64_t(input_bitsize));
             chrono.clear();
             chrono.start();
-            TwoPhaseMargeLeast algo(2 * input_bitsize, 1 << e);
+            TwoPhaseMargeLeast algo(2 * input_bitsize, moduli_bitsize);
             auto matrices = algo.matrix_reduce(M_, M_s);
             auto a = matrices[0];
             auto b = matrices[1];
@@ -322,9 +346,10 @@ int tmain()
             cerr << "===========================================" << endl;
             cerr << "======= Benchmark TwoPhaseMargeMost =======" << endl;
             cerr << "===========================================" << endl;
+            const uint_fast64_t moduli_bitsize = level_1_moduli_bitsize(TWO_PHASE_MARGE_MOST, uint64_t(input_bitsize));
             chrono.clear();
             chrono.start();
-            TwoPhaseMargeMost algo(input_bitsize << 1, 1 << e);
+            TwoPhaseMargeMost algo(input_bitsize << 1, moduli_bitsize);
             auto a = algo.matrix_reduce(A_, m, k);
             auto b = algo.matrix_reduce(B_, k, n);
             auto c = algo.phase2_mult(a, b);
@@ -0,0 +1,281 @@
+
+using namespace std;
+
+#include "bench_common.h"
+#include "sim_rns.h"
+#include "two_phase_tuner.h"
+#include <gmp++/gmp++.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Benchmarks the two phase schemes (and FFLAS-FFPACK's fgemm over the integers as a baseline)
+// on every combination of the algorithms, shapes, input bitsizes and thread counts given on
+// the command line, and reports min / median / p95 wall time per phase as JSON or CSV:
+//
+//   ./bench -a marge_most,hybrid,fflas -s 32,16x64x32 -b 1024,4096 -t 1,4 -i 5 -f csv -o out.csv
+//
+// the phases are reduce (both operands), mult, recover and total; the thread count applies to
+// the OpenMP loops of the level 1 reduction, the slice products and BlasCRT, the level 1
+// recovery runs on one thread
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " [options]" << endl
+         << "  -a A,...   algorithms among marge_most, marge_least, parge_block, parge_shift, hybrid, fflas (default: all)" << endl
+         << "  -s S,...   shapes MxNxK or D for DxDxD (default: 32)" << endl
+         << "  -b B,...   input bitsizes (default: 1024)" << endl
+         << "  -t T,...   thread counts (default: 1)" << endl
+         << "  -i R       repetitions (default: 3)" << endl
+         << "  -e E       level 1 moduli bitsize 2^E, 0 to auto-tune (default: 0)" << endl
+         << "  -f F       report format, json or csv (default: json)" << endl
+         << "  -o FILE    write the report to FILE (default: stdout)" << endl
+         << "  -c         check every product against the fflas baseline" << endl
+         << "  -r SEED    random seed" << endl;
+}
+
+static bool parse_algorithm(const string &name, int &scheme)
+{
+    if (name == "fflas")
+    {
+        scheme = -1;
+        return true;
+    }
+    for (int s = 0; s < TWO_PHASE_SCHEME_COUNT; s++)
+    {
+        if (name == TwoPhasePlan::scheme_name(TwoPhaseScheme(s)))
+        {
+            scheme = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    vector<string> algorithms;
+    vector<BenchShape> shapes;
+    vector<uint64_t> input_bitsizes(1, 1024);
+    vector<uint64_t> thread_counts(1, 1);
+    size_t reps = 3;
+    size_t e = 0;
+    string format = "json";
+    string output;
+    bool check = false;
+    unsigned long seed = time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "a:s:b:t:i:e:f:o:cr:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            algorithms = bench_split(optarg);
+            break;
+        case 's':
+            if (!bench_parse_shapes(optarg, shapes))
+            {
+                cerr << "malformed shape list: " << optarg << endl;
+                return 1;
+            }
+            break;
+        case 'b':
+            input_bitsizes = bench_parse_numbers(optarg);
+            break;
+        case 't':
+            thread_counts = bench_parse_numbers(optarg);
+            break;
+        case 'i':
+            reps = strtoul(optarg, NULL, 10);
+            break;
+        case 'e':
+            e = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            format = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            check = true;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (algorithms.empty())
+    {
+        for (int s = 0; s < TWO_PHASE_SCHEME_COUNT; s++)
+        {
+            algorithms.push_back(TwoPhasePlan::scheme_name(TwoPhaseScheme(s)));
+        }
+        algorithms.push_back("fflas");
+    }
+    if (shapes.empty())
+    {
+        BenchShape shape = {32, 32, 32};
+        shapes.push_back(shape);
+    }
+    if (reps == 0 || (format != "json" && format != "csv"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    vector<int> schemes(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); a++)
+    {
+        if (!parse_algorithm(algorithms[a], schemes[a]))
+        {
+            cerr << "unknown algorithm: " << algorithms[a] << endl;
+            return 1;
+        }
+    }
+    Givaro::Integer::seeding(seed);
+
+    PlanCache plan_cache("mmc_plans.bin");
+    TwoPhaseTuner tuner(&plan_cache);
+    vector<BenchRecord> records;
+    for (size_t t = 0; t < thread_counts.size(); t++)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(thread_counts[t]);
+#endif
+        for (size_t s = 0; s < shapes.size(); s++)
+        {
+            const BenchShape &shape = shapes[s];
+            for (size_t b = 0; b < input_bitsizes.size(); b++)
+            {
+                uint64_t input_bitsize = input_bitsizes[b];
+                vector<Givaro::Integer> matrix_a(shape.dim_m * shape.dim_n), matrix_b(shape.dim_n * shape.dim_k);
+                for (size_t i = 0; i < matrix_a.size(); i++)
+                {
+                    matrix_a[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                }
+                for (size_t i = 0; i < matrix_b.size(); i++)
+                {
+                    matrix_b[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                }
+                vector<Givaro::Integer> expect;
+                if (check)
+                {
+                    expect = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                }
+                for (size_t a = 0; a < algorithms.size(); a++)
+                {
+                    BenchRecord record;
+                    record.algorithm = algorithms[a];
+                    record.dim_m = shape.dim_m;
+                    record.dim_n = shape.dim_n;
+                    record.dim_k = shape.dim_k;
+                    record.input_bitsize = input_bitsize;
+                    record.moduli_bitsize = 0;
+                    record.threads = thread_counts[t];
+                    BenchRecord reduce = record, mult = record, recover = record, total = record;
+                    reduce.phase = "reduce";
+                    mult.phase = "mult";
+                    recover.phase = "recover";
+                    total.phase = "total";
+                    if (schemes[a] < 0)
+                    {
+                        for (size_t r = 0; r < reps; r++)
+                        {
+                            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                            vector<Givaro::Integer> product = SIM_RNS::fflas_mult_integer(matrix_a, matrix_b, shape.dim_m, shape.dim_n, shape.dim_k);
+                            total.stats.add(bench_seconds_since(start));
+                        }
+                        records.push_back(total);
+                        continue;
+                    }
+                    TwoPhasePlan plan;
+                    plan.scheme = TwoPhaseScheme(schemes[a]);
+                    plan.product_bitsize = TwoPhaseTuner::product_bitsize_for(shape.dim_n, input_bitsize);
+                    if (e > 0)
+                    {
+                        plan.moduli_bitsize = uint_fast64_t(1) << e;
+                    }
+                    else if (TwoPhaseTuner::candidates(shape.dim_n, input_bitsize, vector<TwoPhaseScheme>(1, plan.scheme)).empty())
+                    {
+                        cerr << "skipping " << algorithms[a] << ", no feasible level 1 moduli for " << shape.dim_n << " x "
+                             << input_bitsize << " bits" << endl;
+                        continue;
+                    }
+                    else
+                    {
+                        // the tuner times square products, the inner dimension sets the output bound
+                        TwoPhasePlan tuned;
+                        tuner.tune(shape.dim_n, input_bitsize, thread_counts[t], vector<TwoPhaseScheme>(1, plan.scheme), tuned);
+                        plan.moduli_bitsize = tuned.moduli_bitsize;
+                    }
+                    plan.seconds = 0;
+                    if (!plan.feasible())
+                    {
+                        cerr << "skipping infeasible " << plan << endl;
+                        continue;
+                    }
+                    unique_ptr<TwoPhaseAbstract> algo(plan.make(&plan_cache));
+                    reduce.moduli_bitsize = mult.moduli_bitsize = recover.moduli_bitsize = total.moduli_bitsize = plan.moduli_bitsize;
+                    for (size_t r = 0; r < reps; r++)
+                    {
+                        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+                        TwoPhaseAbstract::Phase2_Matrix reduced_a = algo->matrix_reduce(matrix_a, shape.dim_m, shape.dim_n);
+                        TwoPhaseAbstract::Phase2_Matrix reduced_b = algo->matrix_reduce(matrix_b, shape.dim_n, shape.dim_k);
+                        double t_reduce = bench_seconds_since(t0);
+                        chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+                        TwoPhaseAbstract::Phase2_Matrix reduced_c = algo->phase2_mult(reduced_a, reduced_b);
+                        double t_mult = bench_seconds_since(t1);
+                        chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+                        vector<Givaro::Integer> product = algo->matrix_recover(reduced_c);
+                        double t_recover = bench_seconds_since(t2);
+                        reduce.stats.add(t_reduce);
+                        mult.stats.add(t_mult);
+                        recover.stats.add(t_recover);
+                        total.stats.add(t_reduce + t_mult + t_recover);
+                        if (check && r == 0 && !equals(product, expect))
+                        {
+                            cerr << "ERROR! RESULT IS INCORRECT for " << plan << endl;
+                            return 2;
+                        }
+                    }
+                    records.push_back(reduce);
+                    records.push_back(mult);
+                    records.push_back(recover);
+                    records.push_back(total);
+                    cerr << algorithms[a] << " " << shape.dim_m << "x" << shape.dim_n << "x" << shape.dim_k
+                         << " " << input_bitsize << " bits, " << thread_counts[t] << " threads: median " << total.stats.median() << "s" << endl;
+                }
+            }
+        }
+    }
+
+    ofstream file;
+    if (!output.empty())
+    {
+        file.open(output.c_str());
+        if (!file)
+        {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+    }
+    ostream &out = output.empty() ? cout : file;
+    if (format == "csv")
+    {
+        bench_write_csv(out, records);
+    }
+    else
+    {
+        bench_write_json(out, records);
+    }
+    return 0;
+}
@@ -6,6 +6,9 @@ using namespace std;
 #include "two_phase_marge_most.h"
 #include "two_phase_parge_shift.h"
 #include "two_phase_parge_block.h"
+#include "two_phase_hybrid.h"
+#include "two_phase_tuner.h"
+#include "integer_matmul.h"
 #include <array>
 #include <gmp++/gmp++.h>
 #include <ostream>
@@ -13,8 +16,18 @@ using namespace std;
 
 #define TEST_MARGE_MOST 1
 #define TEST_MARGE_LEAST 0
-#define TEST_PARGE_BLOCK 0
-#define TEST_PARGE_SHIFT 0
+#define TEST_PARGE_BLOCK 1
+#define TEST_PARGE_SHIFT 1
+#define TEST_HYBRID 1
+#define TEST_LIMB_MATRIX 1
+#define TEST_METRICS 1
+#define TEST_FIXED_LIMBS 1
+#define TEST_PLAN_CACHE 1
+#define TEST_TUNER 1
+#define TEST_COST_MODEL 1
+#define TEST_INTEGER_MATMUL 1
+#define TEST_KRONECKER 1
+#define TEST_BLAS_CRT 1
 
 using namespace LinBox;
 using namespace SIM_RNS;
@@ -45,6 +58,7 @@ void test()
     cerr << "===========================================" << endl;
     {
         TwoPhaseMargeMost algo(2 * input_bitsize, input_bitsize / 2);
+        algo.enable_verification(-1, true);
 
         auto r = algo.matrix_reduce(a, 2, 2);
         vector<Givaro::Integer> a_ = algo.matrix_recover(r);
@@ -80,6 +94,126 @@ void test()
                  << " - got: " << got << endl;
             abort();
         }
+        assert(algo.verification_failures() == 0);
+        // a corrupted residue must be caught by the Freivalds check on all slices,
+        // every time since the random vector has no zero coordinate
+        t.data()._ptr[0] += 1;
+        assert(!algo.phase2_verify(r, s, t));
+
+        // a * b * a, the intermediate product is left unreduced
+        TwoPhaseMargeMost chain_algo(4 * input_bitsize, input_bitsize / 2);
+        vector<TwoPhaseAbstract::Phase2_Matrix> chain;
+        chain.push_back(chain_algo.matrix_reduce(a, 2, 2));
+        chain.push_back(chain_algo.matrix_reduce(b, 2, 2));
+        chain.push_back(chain_algo.matrix_reduce(a, 2, 2));
+        auto chain_got = chain_algo.matrix_recover(chain_algo.phase2_chain_mult(chain));
+        vector<Givaro::Integer> chain_expect = SIM_RNS::fflas_mult_integer(expect, a, 2, 2, 2);
+        if (!equals(chain_got, chain_expect))
+        {
+            cerr << "TwoPhaseMargeMost phase2_chain_mult failed" << endl
+                 << " - expect: " << chain_expect << endl
+                 << " - got: " << chain_got << endl;
+            abort();
+        }
+
+        // residue domain operations: (a + b) - b and 2 * a * b - b
+        auto ra = chain_algo.matrix_reduce(a, 2, 2);
+        auto rb = chain_algo.matrix_reduce(b, 2, 2);
+        auto sum_got = chain_algo.matrix_recover(chain_algo.phase2_sub(chain_algo.phase2_add(ra, rb), rb));
+        assert(equals(sum_got, a));
+        auto rc = chain_algo.matrix_reduce(b, 2, 2);
+        chain_algo.phase2_gemm(2, ra, rb, -1, rc);
+        auto gemm_got = chain_algo.matrix_recover(rc);
+        vector<Givaro::Integer> gemm_expect(4);
+        for (size_t i = 0; i < 4; i++)
+        {
+            gemm_expect[i] = 2 * expect[i] - b[i];
+        }
+        if (!equals(gemm_got, gemm_expect))
+        {
+            cerr << "TwoPhaseMargeMost phase2_gemm failed" << endl
+                 << " - expect: " << gemm_expect << endl
+                 << " - got: " << gemm_got << endl;
+            abort();
+        }
+        // a negative alpha: b - a * b + a * b, computed as (-1) * a * b + 1 * (b + a * b)
+        {
+            auto rd = chain_algo.phase2_add(rb, chain_algo.phase2_mult(ra, rb));
+            chain_algo.phase2_gemm(-1, ra, rb, 1, rd);
+            assert(equals(chain_algo.matrix_recover(rd), b));
+        }
+
+        // in place updates of a product must not be checked against the product's factors
+        {
+            chain_algo.enable_verification(-1, true);
+            auto va = chain_algo.matrix_reduce(a, 2, 2);
+            auto vb = chain_algo.matrix_reduce(b, 2, 2);
+            vector<Givaro::Integer> sum_expect(4), twice_expect(4);
+            for (size_t i = 0; i < 4; i++)
+            {
+                sum_expect[i] = expect[i] + a[i];
+                twice_expect[i] = 2 * expect[i];
+            }
+            auto vd = chain_algo.phase2_mult(va, vb);
+            chain_algo.phase2_axpy(1, va, vd);
+            assert(equals(chain_algo.matrix_recover(vd), sum_expect));
+            auto ve = chain_algo.phase2_mult(va, vb);
+            chain_algo.phase2_gemm(1, va, vb, 1, ve);
+            assert(equals(chain_algo.matrix_recover(ve), twice_expect));
+            // nor may their stale images reach a later product
+            auto vf = chain_algo.phase2_mult(vd, vb);
+            assert(equals(chain_algo.matrix_recover(vf), SIM_RNS::fflas_mult_integer(sum_expect, b, 2, 2, 2)));
+            assert(chain_algo.verification_failures() == 0);
+            chain_algo.enable_verification(0);
+        }
+
+        // scalars wider than the room left in the level 2 moduli, and negative ones
+        {
+            auto product = chain_algo.phase2_mult(ra, rb);
+            Givaro::Integer big = LInteger::random_exact(input_bitsize);
+            auto scaled_got = chain_algo.matrix_recover(chain_algo.phase2_scale(big, product));
+            vector<Givaro::Integer> scaled_expect(4);
+            for (size_t i = 0; i < 4; i++)
+            {
+                scaled_expect[i] = big * expect[i];
+            }
+            assert(equals(scaled_got, scaled_expect));
+            auto twice = chain_algo.phase2_scale(2, product);
+            chain_algo.phase2_axpy(-1, product, twice);
+            assert(equals(chain_algo.matrix_recover(twice), expect));
+            // big * (a * b) - (big - 1) * (a * b), both scalars wider than the room left
+            auto difference = chain_algo.phase2_scale(big, product);
+            chain_algo.phase2_axpy(Givaro::Integer(1) - big, product, difference);
+            assert(equals(chain_algo.matrix_recover(difference), expect));
+        }
+
+        // small inputs only use a prefix of the level 1 moduli
+        vector<Givaro::Integer> small_a(4), small_b(4);
+        for (size_t i = 0; i < 4; i++)
+        {
+            small_a[i] = LInteger::random_exact(8);
+            small_b[i] = LInteger::random_exact(8);
+        }
+        assert(chain_algo.level_1_moduli_count_for(8 + 8 + 2) == 1);
+        auto small_got = chain_algo.matrix_product(small_a, small_b, 2, 2, 2);
+        assert(equals(small_got, SIM_RNS::fflas_mult_integer(small_a, small_b, 2, 2, 2)));
+
+        // an inner dimension over BATCHED_FGEMM_MAX_DIM falls back to one FFLAS::fgemm per slice
+        {
+            const size_t wide_n = BATCHED_FGEMM_MAX_DIM + 1;
+            vector<Givaro::Integer> wide_a(3 * wide_n), wide_b(wide_n * 2);
+            for (size_t i = 0; i < wide_a.size(); i++)
+            {
+                wide_a[i] = LInteger::random_exact(input_bitsize);
+            }
+            for (size_t i = 0; i < wide_b.size(); i++)
+            {
+                wide_b[i] = LInteger::random_exact(input_bitsize);
+            }
+            auto wide_got = chain_algo.matrix_product(wide_a, wide_b, 3, wide_n, 2);
+            assert(equals(wide_got, SIM_RNS::fflas_mult_integer(wide_a, wide_b, 3, wide_n, 2)));
+        }
+
         cerr << "TwoPhaseMargeMost passed!" << endl;
     }
 #endif
@@ -89,7 +223,8 @@ void test()
     cerr << "======= Testing TwoPhasePargeBlock ========" << endl;
     cerr << "===========================================" << endl;
     {
-        TwoPhasePargeBlock algo_parge_block(2 * input_bitsize, input_bitsize / 2, 4);
+        // the level 1 product must exceed the 2 * input_bitsize + 1 bits of the product entries
+        TwoPhasePargeBlock algo_parge_block(4 * input_bitsize, input_bitsize, 4);
 
         auto r = algo_parge_block.matrix_reduce(a, 2, 2);
         vector<Givaro::Integer> a_ = algo_parge_block.matrix_recover(r);
@@ -109,6 +244,7 @@ void test()
                  << " - got: " << got << endl;
             abort();
         }
+        assert(equals(algo_parge_block.matrix_product(a, b, 2, 2, 2), expect));
         cerr << "TwoPhasePargeBlock passed!" << endl;
     }
 #endif
@@ -118,7 +254,23 @@ void test()
     cerr << "======= Testing TwoPhasePargeShift ========" << endl;
     cerr << "===========================================" << endl;
     {
-        TwoPhasePargeShift algo_parge_shift(2 * input_bitsize, input_bitsize / 2, 1);
+        // 2^n + 3 is reduced by folding blocks of n bits with powers of -3
+        for (uint64_t n : {4, 61, 64})
+        {
+            Givaro::Integer m = (Givaro::Integer(1) << n) + 3;
+            Givaro::Integer x = LInteger::random_exact(16 * n + 5), r = x;
+            CNMA::dc_reduce_plus3(r.get_mpz(), m.get_mpz(), n);
+            assert(r == x % m);
+            // a table of powers too short for the input only costs more folds
+            GmpScratch pow3(2, GMP_NUMB_BITS), t(1, 17 * n);
+            CNMA::pow3_squares(pow3.get(), pow3.size());
+            r = x;
+            CNMA::dc_reduce_plus3(r.get_mpz(), m.get_mpz(), n, pow3.get(), pow3.size(), t[0]);
+            assert(r == x % m);
+        }
+
+        // the level 1 product must exceed the 2 * input_bitsize + 1 bits of the product entries
+        TwoPhasePargeShift algo_parge_shift(4 * input_bitsize, input_bitsize, 1);
 
         auto r = algo_parge_shift.matrix_reduce(a, 2, 2);
         vector<Givaro::Integer> a_ = algo_parge_shift.matrix_recover(r);
@@ -138,10 +290,310 @@ void test()
                  << " - got: " << got << endl;
             abort();
         }
+        assert(equals(algo_parge_shift.matrix_product(a, b, 2, 2, 2), expect));
+
+        // small products only use the first three moduli, 2^n, 2^n + 3 and the prime
+        vector<Givaro::Integer> small_a(4), small_b(4);
+        for (size_t i = 0; i < 4; i++)
+        {
+            small_a[i] = LInteger::random_exact(8);
+            small_b[i] = LInteger::random_exact(8);
+        }
+        assert(algo_parge_shift.level_1_moduli_count_for(8 + 8 + 2) == 3);
+        assert(equals(algo_parge_shift.matrix_product(small_a, small_b, 2, 2, 2), SIM_RNS::fflas_mult_integer(small_a, small_b, 2, 2, 2)));
         cerr << "TwoPhasePargeShift passed!" << endl;
     }
 #endif
 
+#if TEST_HYBRID
+    cerr << "===========================================" << endl;
+    cerr << "========= Testing TwoPhaseHybrid ==========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        TwoPhaseHybrid algo_hybrid(2 * input_bitsize, input_bitsize / 2);
+
+        auto r = algo_hybrid.matrix_reduce(a, 2, 2);
+        vector<Givaro::Integer> a_ = algo_hybrid.matrix_recover(r);
+        assert(equals(a, a_));
+
+        auto s = algo_hybrid.matrix_reduce(b, 2, 2);
+        vector<Givaro::Integer> b_ = algo_hybrid.matrix_recover(s);
+        assert(equals(b, b_));
+
+        auto t = algo_hybrid.phase2_mult(r, s);
+        auto got = algo_hybrid.matrix_recover(t);
+
+        if (!equals(got, expect))
+        {
+            cerr << "TwoPhaseHybrid failed" << endl
+                 << " - expect: " << expect << endl
+                 << " - got: " << got << endl;
+            abort();
+        }
+        cerr << "TwoPhaseHybrid passed!" << endl;
+    }
+#endif
+
+#if TEST_LIMB_MATRIX
+    cerr << "===========================================" << endl;
+    cerr << "=========== Testing LimbMatrix ============" << endl;
+    cerr << "===========================================" << endl;
+    {
+        TwoPhaseMargeMost algo(4 * input_bitsize, input_bitsize / 2);
+
+        // the same product on contiguous limb matrices
+        LimbMatrix limb_a = LimbMatrix::from_integers(a, 2, 2);
+        LimbMatrix limb_b = LimbMatrix::from_integers(b, 2, 2);
+        assert(equals(limb_a.to_integers(), a));
+        assert(equals(algo.matrix_recover(algo.matrix_reduce(limb_a)), a));
+        assert(equals(algo.matrix_recover_limbs(algo.matrix_reduce(limb_a)).to_integers(), a));
+        assert(equals(algo.matrix_product(limb_a, limb_b).to_integers(), expect));
+        cerr << "LimbMatrix passed!" << endl;
+    }
+#endif
+
+#if TEST_METRICS
+    cerr << "===========================================" << endl;
+    cerr << "========= Testing TwoPhaseMetrics =========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        TwoPhaseMargeMost algo(4 * input_bitsize, input_bitsize / 2);
+
+        // attached metrics see every stage of a product, and nothing once detached
+        TwoPhaseMetrics::install_gmp_hooks();
+        TwoPhaseMetrics metrics;
+        bool perf = metrics.enable_perf_counters();
+        algo.attach_metrics(&metrics);
+        assert(equals(algo.matrix_product(a, b, 2, 2, 2), expect));
+        algo.attach_metrics(NULL);
+        for (size_t s = 0; s < TWO_PHASE_STAGE_COUNT; s++)
+        {
+            assert(metrics.total(TwoPhaseStage(s)).calls > 0);
+            assert(metrics.last(TwoPhaseStage(s)).residues > 0);
+        }
+        assert(metrics.total(TWO_PHASE_STAGE_PHASE_1_RECOVER).residues == 4);
+        assert(metrics.total(TWO_PHASE_STAGE_PHASE_1_RECOVER).gmp_allocations > 0);
+        // hardware counters are only there on machines that expose them, and each event on its own
+        assert(!perf || !PerfCounters::for_this_thread().available(PERF_EVENT_INSTRUCTIONS) || metrics.total(TWO_PHASE_STAGE_PHASE_2_MULT).perf.val[PERF_EVENT_INSTRUCTIONS] > 0);
+        algo.matrix_product(a, b, 2, 2, 2);
+        assert(metrics.total(TWO_PHASE_STAGE_PHASE_1_RECOVER).calls == 1);
+        cerr << "TwoPhaseMetrics passed!" << endl;
+    }
+#endif
+
+#if TEST_FIXED_LIMBS
+    cerr << "===========================================" << endl;
+    cerr << "====== Testing fixed limb reduction =======" << endl;
+    cerr << "===========================================" << endl;
+    {
+        // the fixed size reduction agrees with mpz_mod, inputs over FIXED_LIMBS_MAX limbs are left to the mpz kernels
+        const uint64_t expos[3] = {61, 127, 1000};
+        const int signs[3] = {-1, +1, +1};
+        vector<Givaro::Integer> residues(3);
+        Givaro::Integer big = LInteger::random_exact(3000);
+        bool fixed = CNMA::fixed_reduce_dispatch(residues.data(), big.get_mpz(), 3, expos, signs);
+        assert(fixed);
+        for (size_t f = 0; f < 3; f++)
+        {
+            Givaro::Integer m = (Givaro::Integer(1) << expos[f]) + signs[f];
+            assert(residues[f] % m == big % m);
+        }
+        Givaro::Integer huge = LInteger::random_exact(GMP_NUMB_BITS * FIXED_LIMBS_MAX + 1);
+        fixed = CNMA::fixed_reduce_dispatch(residues.data(), huge.get_mpz(), 3, expos, signs);
+        assert(!fixed);
+        cerr << "fixed limb reduction passed!" << endl;
+    }
+#endif
+
+#if TEST_PLAN_CACHE
+    cerr << "===========================================" << endl;
+    cerr << "============ Testing PlanCache ============" << endl;
+    cerr << "===========================================" << endl;
+    {
+        // the second instance loads its moduli and Mi from the plan cache written by the first
+        const char *plan_path = "main_test.plan";
+        unlink(plan_path);
+        {
+            PlanCache cold_cache(plan_path);
+            TwoPhaseMargeMost cold_algo(4 * input_bitsize, input_bitsize / 2, &cold_cache);
+        }
+        {
+            PlanCache warm_cache(plan_path);
+            PlanCache::Entry plan;
+            bool found = warm_cache.lookup("marge_most/" + to_string(4 * input_bitsize) + "/" + to_string(input_bitsize / 2) + "/0", plan);
+            assert(found);
+            TwoPhaseMargeMost warm_algo(4 * input_bitsize, input_bitsize / 2, &warm_cache);
+            assert(equals(warm_algo.matrix_product(a, b, 2, 2, 2), expect));
+        }
+        {
+            // a plan whose Mi do not invert the prefix products is regenerated, not used
+            PlanCache stale_cache(plan_path);
+            std::string key = "marge_most/" + to_string(4 * input_bitsize) + "/" + to_string(input_bitsize / 2) + "/0";
+            PlanCache::Entry plan;
+            bool found = stale_cache.lookup(key, plan);
+            assert(found && plan.size() == 3 && plan[2].size() > 1);
+            Givaro::Integer good_mi = plan[2][1];
+            plan[2][1] += 1;
+            stale_cache.store(key, plan);
+            TwoPhaseMargeMost stale_algo(4 * input_bitsize, input_bitsize / 2, &stale_cache);
+            assert(equals(stale_algo.matrix_product(a, b, 2, 2, 2), expect));
+            found = stale_cache.lookup(key, plan);
+            assert(found && plan.size() == 3 && plan[2].size() > 1 && plan[2][1] == good_mi);
+        }
+        unlink(plan_path);
+        cerr << "PlanCache passed!" << endl;
+    }
+#endif
+
+#if TEST_TUNER
+    cerr << "===========================================" << endl;
+    cerr << "========== Testing TwoPhaseTuner ==========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        const char *plan_path = "main_test.plan";
+        unlink(plan_path);
+        // the tuner's winner is persisted and handed back as a ready algorithm
+        {
+            PlanCache tuner_cache(plan_path);
+            TwoPhaseTuner tuner(&tuner_cache);
+            TwoPhasePlan plan, cached, none;
+            bool tuned = tuner.tune(2, input_bitsize, 1, plan);
+            assert(tuned && plan.feasible());
+            tuned = tuner.tune(2, input_bitsize, 1, cached);
+            assert(tuned);
+            assert(cached.scheme == plan.scheme && cached.moduli_bitsize == plan.moduli_bitsize);
+            // no level 1 moduli bitsize is tried for inputs of 16 bits, tuning fails without aborting
+            assert(TwoPhaseTuner::candidates(2, 16, vector<TwoPhaseScheme>(1, TWO_PHASE_MARGE_MOST)).empty());
+            tuned = tuner.tune(2, 16, 1, none);
+            assert(!tuned);
+            TwoPhaseAbstract *tuned_algo = plan.make(&tuner_cache);
+            assert(equals(tuned_algo->matrix_product(a, b, 2, 2, 2), expect));
+            delete tuned_algo;
+        }
+        unlink(plan_path);
+        cerr << "TwoPhaseTuner passed!" << endl;
+    }
+#endif
+
+#if TEST_COST_MODEL
+    cerr << "===========================================" << endl;
+    cerr << "======== Testing TwoPhaseCostModel ========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        TwoPhaseMargeMost algo(4 * input_bitsize, input_bitsize / 2);
+
+        // a cost model fitted to exact synthetic timings recovers its coefficients and ranks the plans
+        TwoPhaseCostModel model;
+        model.m_reduce = 1e-9;
+        model.m_gemm = 2e-9;
+        model.m_recover = 3e-9;
+        vector<TwoPhaseShape> shapes;
+        vector<double> reduce_t, gemm_t, recover_t;
+        for (size_t dim = 2; dim <= 8; dim <<= 1)
+        {
+            shapes.push_back(algo.shape(dim, dim, dim, input_bitsize));
+            reduce_t.push_back(model.predict_reduce(shapes.back()));
+            gemm_t.push_back(model.predict_gemm(shapes.back()));
+            recover_t.push_back(model.predict_recover(shapes.back()));
+        }
+        TwoPhaseCostModel fitted;
+        fitted.fit(shapes, reduce_t, gemm_t, recover_t);
+        assert(fitted.calibrated());
+        double predicted = algo.predict_cost(fitted, 4, 4, 4, input_bitsize);
+        assert(fabs(predicted - algo.predict_cost(model, 4, 4, 4, input_bitsize)) < 1e-6 * predicted);
+        cerr << "TwoPhaseCostModel passed!" << endl;
+    }
+#endif
+
+#if TEST_INTEGER_MATMUL
+    cerr << "===========================================" << endl;
+    cerr << "========== Testing IntegerMatMul ==========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        // inputs too small for any level 1 moduli bitsize the tuner tries
+        vector<Givaro::Integer> small_a(4), small_b(4);
+        for (size_t i = 0; i < 4; i++)
+        {
+            small_a[i] = LInteger::random_exact(8);
+            small_b[i] = LInteger::random_exact(8);
+        }
+        // the dispatcher follows its decision table, unless overridden
+        IntegerMatMul matmul;
+        assert(matmul.choose(2, 2, 2, 64) == INTEGER_MATMUL_FFLAS);
+        BenchWinner cell = {2, 2, 2, input_bitsize, 1, "marge_most", 0, "", 0};
+        BenchWinner flint_cell = {2, 2, 2, 64, 1, "flint", 0, "", 0};
+        matmul.set_decision_table({cell, flint_cell});
+        assert(matmul.decision_table_size() == 1);
+        assert(matmul.choose(2, 2, 2, input_bitsize / 2) == INTEGER_MATMUL_MARGE_MOST);
+        assert(equals(matmul.multiply(a, b, 2, 2, 2, 1), expect));
+        matmul.override_engine(INTEGER_MATMUL_FFLAS);
+        assert(matmul.choose(2, 2, 2, input_bitsize) == INTEGER_MATMUL_FFLAS);
+        assert(equals(matmul.multiply(a, b, 2, 2, 2), expect));
+        matmul.override_engine(INTEGER_MATMUL_KRONECKER);
+        assert(equals(matmul.multiply(a, b, 2, 2, 2), expect));
+        // a two phase engine without feasible level 1 moduli (16 bit inputs) falls back to fgemm
+        matmul.override_engine(INTEGER_MATMUL_MARGE_MOST);
+        assert(equals(matmul.multiply(small_a, small_b, 2, 2, 2), SIM_RNS::fflas_mult_integer(small_a, small_b, 2, 2, 2)));
+
+        // signed matrices go to fgemm whatever the engine
+        vector<Givaro::Integer> signed_a(a), signed_b(b);
+        signed_a[1] = -signed_a[1];
+        signed_b[2] = -signed_b[2];
+        vector<Givaro::Integer> signed_expect = SIM_RNS::fflas_mult_integer(signed_a, signed_b, 2, 2, 2);
+        assert(equals(matmul.multiply(signed_a, signed_b, 2, 2, 2), signed_expect));
+        matmul.override_engine(INTEGER_MATMUL_MARGE_MOST);
+        assert(equals(matmul.multiply(signed_a, signed_b, 2, 2, 2), signed_expect));
+        cerr << "IntegerMatMul passed!" << endl;
+    }
+#endif
+
+#if TEST_KRONECKER
+    cerr << "===========================================" << endl;
+    cerr << "========== Testing KroneckerFFT ===========" << endl;
+    cerr << "===========================================" << endl;
+    {
+        // the Kronecker product by chunks of one row agrees with the unchunked one
+        KroneckerFFT kronecker(1);
+        assert(equals(kronecker.matrix_product(a, b, 2, 2, 2), expect));
+        LimbMatrix limb_a = LimbMatrix::from_integers(a, 2, 2);
+        LimbMatrix limb_b = LimbMatrix::from_integers(b, 2, 2);
+        assert(equals(kronecker.matrix_product(limb_a, limb_b).to_integers(), expect));
+        cerr << "KroneckerFFT passed!" << endl;
+    }
+#endif
+
+#if TEST_BLAS_CRT
+    cerr << "===========================================" << endl;
+    cerr << "============= Testing BlasCRT =============" << endl;
+    cerr << "===========================================" << endl;
+    {
+        // BlasCRT's level 2 reduction and CRT agree with mpz_mod and with FFLAS'
+        GenPrimeMost<double> moduli(2 * input_bitsize + 10, 21);
+        BlasCRT crt(moduli, input_bitsize);
+        vector<double> residues(a.size() * moduli.count());
+        crt.reduce(residues.data(), a.data(), a.size());
+        for (size_t i = 0; i < moduli.count(); i++)
+        {
+            for (size_t j = 0; j < a.size(); j++)
+            {
+                Givaro::Integer r;
+                mpz_mod(r.get_mpz(), a[j].get_mpz(), Givaro::Integer(moduli.val(i)).get_mpz());
+                assert(r == Givaro::Integer(residues[i * a.size() + j]));
+            }
+        }
+        vector<Givaro::Integer> a_(a.size());
+        crt.recover(a_.data(), residues.data(), a.size());
+        assert(equals(a, a_));
+
+        TwoPhaseMargeMost blas_algo(2 * input_bitsize, input_bitsize / 2);
+        blas_algo.enable_blas_crt();
+        assert(blas_algo.blas_crt_enabled());
+        assert(equals(blas_algo.matrix_recover(blas_algo.matrix_reduce(a, 2, 2)), a));
+        assert(equals(blas_algo.matrix_product(a, b, 2, 2, 2), expect));
+        cerr << "BlasCRT passed!" << endl;
+    }
+#endif
+
     cerr << "All tests passed!" << endl;
 }
 
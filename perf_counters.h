@@ -0,0 +1,148 @@
+#if !defined(H_PERF_COUNTERS)
+#define H_PERF_COUNTERS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// the hardware events counted by PerfCounters
+enum PerfEvent
+{
+    PERF_EVENT_CYCLES = 0,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_LLC_MISSES,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+};
+
+struct PerfCounts
+{
+    uint64_t val[PERF_EVENT_COUNT] = {0, 0, 0, 0};
+
+    PerfCounts operator-(const PerfCounts &other) const
+    {
+        PerfCounts diff;
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            diff.val[e] = val[e] - other.val[e];
+        }
+        return diff;
+    }
+
+    PerfCounts &operator+=(const PerfCounts &other)
+    {
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            val[e] += other.val[e];
+        }
+        return *this;
+    }
+
+    // instructions per cycle, 0 if cycles were not counted
+    double ipc() const
+    {
+        return val[PERF_EVENT_CYCLES] ? double(val[PERF_EVENT_INSTRUCTIONS]) / val[PERF_EVENT_CYCLES] : 0;
+    }
+};
+
+/*
+    Free running user space hardware counters of the calling thread, read through perf_event_open.
+    Each event is opened on its own, so a machine (or VM) lacking one still counts the others,
+    and where perf_event_open is refused (eg. kernel.perf_event_paranoid > 2, seccomp, non Linux)
+    nothing is counted and reads return zeros.
+    Counters are per thread: use for_this_thread rather than sharing an instance.
+*/
+class PerfCounters
+{
+    int m_fds[PERF_EVENT_COUNT];
+
+  public:
+    PerfCounters()
+    {
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            m_fds[e] = -1;
+        }
+#if defined(__linux__)
+        static const uint64_t configs[PERF_EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[e];
+            // user space only, so the default perf_event_paranoid level allows it
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fds[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            if (m_fds[e] >= 0)
+            {
+                close(m_fds[e]);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // the counters of the calling thread, opened on first use
+    static PerfCounters &for_this_thread()
+    {
+        static thread_local PerfCounters counters;
+        return counters;
+    }
+
+    inline bool available(PerfEvent e) const { return m_fds[e] >= 0; }
+
+    bool available() const
+    {
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            if (m_fds[e] >= 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+        use this method to read the counts since the counters were opened,
+        take the difference of two reads to scope them
+    */
+    PerfCounts read() const
+    {
+        PerfCounts counts;
+#if defined(__linux__)
+        for (size_t e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            uint64_t value;
+            if (m_fds[e] >= 0 && ::read(m_fds[e], &value, sizeof(value)) == sizeof(value))
+            {
+                counts.val[e] = value;
+            }
+        }
+#endif
+        return counts;
+    }
+};
+
+#endif // H_PERF_COUNTERS
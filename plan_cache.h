@@ -0,0 +1,267 @@
+#if !defined(H_PLAN_CACHE)
+#define H_PLAN_CACHE
+
+#include <gmp++/gmp++.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+    An on-disk cache of precomputed plans (level 1 moduli, level 2 moduli, Mi, ...)
+    keyed by scheme and parameters, so that short-lived processes skip the generation.
+
+    The file is a sequence of append-only records:
+
+        [magic u32][version u32][key length u32][reserved u32][payload length u64][checksum u64]
+        [key bytes][payload bytes]
+
+    where the checksum is FNV-1a over key and payload. A payload is a list of sections,
+    each section a list of nonnegative integers:
+
+        [section count u64] { [integer count u64] { [byte count u64][bytes, little endian] } }
+
+    The file is mapped read-only at construction; records with a bad magic, version or
+    checksum are skipped, a truncated tail ends the scan, and the last record of a key wins.
+    New records are appended with a single write(2) so concurrent writers don't interleave.
+*/
+class PlanCache
+{
+  public:
+    typedef std::vector<std::vector<Givaro::Integer>> Entry;
+
+    static const uint32_t MAGIC = 0x504d4d43; // "CMMP"
+    // bumped whenever the generators change what they yield for a key (2: GenPargeBlock's
+    // generation and ordering), records of another version are skipped
+    static const uint32_t VERSION = 2;
+
+  protected:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t key_length;
+        uint32_t reserved;
+        uint64_t payload_length;
+        uint64_t checksum;
+    };
+
+    std::string m_path;
+    const unsigned char *m_map = NULL;
+    size_t m_map_size = 0;
+    // key -> (offset, length) of the payload in the mapped file
+    std::map<std::string, std::pair<size_t, size_t>> m_index;
+    // entries stored by this process after the file was mapped
+    std::map<std::string, Entry> m_stored;
+    mutable std::mutex m_lock;
+
+  public:
+    PlanCache(const std::string &path) : m_path(path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return; // no cache yet
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                m_map = static_cast<const unsigned char *>(p);
+                m_map_size = st.st_size;
+            }
+        }
+        close(fd);
+        scan();
+    }
+
+    ~PlanCache()
+    {
+        if (m_map)
+        {
+            munmap(const_cast<unsigned char *>(m_map), m_map_size);
+        }
+    }
+
+    PlanCache(const PlanCache &) = delete;
+    PlanCache &operator=(const PlanCache &) = delete;
+
+    /*
+        use this method to look up a plan, returns false if the key is not cached
+    */
+    bool lookup(const std::string &key, Entry &entry) const
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::map<std::string, Entry>::const_iterator s = m_stored.find(key);
+        if (s != m_stored.end())
+        {
+            entry = s->second;
+            return true;
+        }
+        std::map<std::string, std::pair<size_t, size_t>>::const_iterator i = m_index.find(key);
+        if (i == m_index.end())
+        {
+            return false;
+        }
+        return decode(m_map + i->second.first, i->second.second, entry);
+    }
+
+    /*
+        use this method to append a plan to the cache file, returns false if it cannot be written
+        (the entry is still remembered by this PlanCache)
+    */
+    bool store(const std::string &key, const Entry &entry)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stored[key] = entry;
+        std::string payload = encode(entry);
+        Header h;
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.key_length = key.size();
+        h.reserved = 0;
+        h.payload_length = payload.size();
+        h.checksum = fnv1a(payload.data(), payload.size(), fnv1a(key.data(), key.size()));
+        std::string record(reinterpret_cast<const char *>(&h), sizeof(h));
+        record += key;
+        record += payload;
+        int fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+        {
+#if DEBUG_MMC
+            std::cerr << "PlanCache: cannot open " << m_path << " for writing" << std::endl;
+#endif
+            return false;
+        }
+        bool ok = write(fd, record.data(), record.size()) == (ssize_t)record.size();
+        close(fd);
+        return ok;
+    }
+
+    static uint64_t fnv1a(const void *data, size_t length, uint64_t hash = 14695981039346656037ULL)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+  protected:
+    void scan()
+    {
+        size_t offset = 0;
+        while (offset + sizeof(Header) <= m_map_size)
+        {
+            Header h;
+            std::memcpy(&h, m_map + offset, sizeof(h));
+            size_t body = offset + sizeof(Header);
+            if (h.magic != MAGIC || h.key_length > m_map_size - body || h.payload_length > m_map_size - body - h.key_length)
+            {
+                break; // corrupted or truncated tail
+            }
+            const char *key = reinterpret_cast<const char *>(m_map + body);
+            const unsigned char *payload = m_map + body + h.key_length;
+            uint64_t checksum = fnv1a(payload, h.payload_length, fnv1a(key, h.key_length));
+            if (h.version == VERSION && checksum == h.checksum)
+            {
+                m_index[std::string(key, h.key_length)] = std::make_pair(body + h.key_length, (size_t)h.payload_length);
+            }
+#if DEBUG_MMC
+            else
+            {
+                std::cerr << "PlanCache: skipping stale record " << std::string(key, h.key_length) << std::endl;
+            }
+#endif
+            offset = body + h.key_length + h.payload_length;
+        }
+    }
+
+    static void put_u64(std::string &out, uint64_t v)
+    {
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+
+    static bool get_u64(const unsigned char *&p, const unsigned char *end, uint64_t &v)
+    {
+        if (end - p < (ptrdiff_t)sizeof(v))
+        {
+            return false;
+        }
+        std::memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return true;
+    }
+
+    static std::string encode(const Entry &entry)
+    {
+        std::string out;
+        put_u64(out, entry.size());
+        for (size_t s = 0; s < entry.size(); s++)
+        {
+            put_u64(out, entry[s].size());
+            for (size_t i = 0; i < entry[s].size(); i++)
+            {
+                const Givaro::Integer &v = entry[s][i];
+                assert(v >= 0 && "PlanCache only stores nonnegative integers");
+                size_t bytes = (mpz_sizeinbase(v.get_mpz(), 2) + 7) / 8;
+                std::string buf(bytes, '\0');
+                size_t written = 0;
+                if (bytes)
+                {
+                    mpz_export(&buf[0], &written, -1, 1, 0, 0, v.get_mpz());
+                }
+                buf.resize(written);
+                put_u64(out, written);
+                out += buf;
+            }
+        }
+        return out;
+    }
+
+    static bool decode(const unsigned char *p, size_t length, Entry &entry)
+    {
+        const unsigned char *end = p + length;
+        uint64_t sections;
+        if (!get_u64(p, end, sections))
+        {
+            return false;
+        }
+        entry.assign(sections, std::vector<Givaro::Integer>());
+        for (size_t s = 0; s < sections; s++)
+        {
+            uint64_t count;
+            if (!get_u64(p, end, count))
+            {
+                return false;
+            }
+            entry[s].resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                uint64_t bytes;
+                if (!get_u64(p, end, bytes) || (uint64_t)(end - p) < bytes)
+                {
+                    return false;
+                }
+                mpz_import(entry[s][i].get_mpz(), bytes, -1, 1, 0, 0, p);
+                p += bytes;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // H_PLAN_CACHE
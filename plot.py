@@ -1,10 +1,52 @@
+import csv
+import json
+import sys
+
 import matplotlib.pyplot as plt
 
-plt.figure(1)
-plt.title("Product of two 32 by 32 matrices with 2^16 bits integers")
-plt.ylabel('Time (s)')
-plt.xlabel('Level 1 moduli bitsize upper bound')
-input_bitsize = [11,12,13,14,15]
-time = [15.2, 9.2, 8.5, 10.1, 16.3]
-plt.plot(input_bitsize, time)
-plt.show()
+# plots a report of main_benchmark_two_phase.cpp (JSON or CSV):
+#   python plot.py results.json [x] [phase]
+# one line per algorithm, shape and thread count with the median wall time against x
+# (input_bitsize by default, or moduli_bitsize, threads, m, n, k) and min / p95 as error bars,
+# phase is total by default
+
+
+def load(path):
+    with open(path) as f:
+        if path.endswith('.csv'):
+            return list(csv.DictReader(f))
+        return json.load(f)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('usage: python plot.py results.json|results.csv [x] [phase]')
+        sys.exit(1)
+    records = load(sys.argv[1])
+    x = sys.argv[2] if len(sys.argv) > 2 else 'input_bitsize'
+    phase = sys.argv[3] if len(sys.argv) > 3 else 'total'
+    lines = {}
+    for r in records:
+        if r['phase'] != phase:
+            continue
+        key = '%s %sx%sx%s' % (r['algorithm'], r['m'], r['n'], r['k'])
+        if x != 'threads':
+            key += ' %s threads' % r['threads']
+        lines.setdefault(key, []).append((float(r[x]), float(r['median']), float(r['min']), float(r['p95'])))
+
+    plt.figure(1)
+    plt.title('Median %s time' % phase)
+    plt.ylabel('Time (s)')
+    plt.xlabel(x)
+    for key, points in sorted(lines.items()):
+        points.sort()
+        xs = [p[0] for p in points]
+        plt.errorbar(xs, [p[1] for p in points],
+                     yerr=[[p[1] - p[2] for p in points], [p[3] - p[1] for p in points]],
+                     label=key, capsize=3)
+    plt.legend()
+    plt.show()
+
+
+if __name__ == '__main__':
+    main()
@@ -3,9 +3,20 @@
 
 #include "containers.h"
 #include "gen_coprime_abstract.h"
+#include "gen_coprime_list.h"
+#include "gmp_scratch.h"
+#include "limb_matrix.h"
+#include "plan_cache.h"
+#include "two_phase_cost_model.h"
+#include "two_phase_metrics.h"
 #include "sim_rns.h"
+#include "batched_fgemm.h"
+#include "blas_crt.h"
+#include "freivalds.h"
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <gmp++/gmp++.h>
 #include <fflas-ffpack/field/rns-double.h>
 #include <fflas-ffpack/fflas/fflas_fgemm/fgemm_classical_mp.inl>
@@ -35,10 +46,29 @@ class TwoPhaseAbstract
     const GenCoprimeAbstract<double> *m_level_2_moduli;
     size_t m_level_1_moduli_count;
     size_t m_level_2_moduli_count;
+    // m_level_1_prefix_products[n] is the product of the first n level 1 moduli,
+    // Garner's recovery only needs a prefix of the level 1 moduli when the result is small enough
+    std::vector<Givaro::Integer> m_level_1_prefix_products;
+    // Mi[i] = (m_0 * ... * m_(i-1))^-1 mod m_i used by Garner's recovery, Mi[0] is unused,
+    // computed once per instance (or loaded from a PlanCache)
+    mpz_t *m_level_1_Mi;
+    // see attach_metrics, NULL when no metrics are collected
+    TwoPhaseMetrics *m_metrics = NULL;
+    // see enable_verification
+    size_t m_verify_slices = 0;
+    bool m_verify_check_prime = false;
+    mutable size_t m_verify_failures = 0;
+    mutable std::mt19937_64 m_verify_rng;
+    // see enable_blas_crt, NULL when level 2 uses FFLAS' finit_rns / fconvert_rns
+    std::unique_ptr<BlasCRT> m_blas_crt;
 
   public:
+    // with a plan_cache, the level 2 moduli and Mi are loaded from plan_key if present,
+    // otherwise they are generated and stored there together with the level 1 moduli
     TwoPhaseAbstract(const GenCoprimeAbstract<Givaro::Integer> *m_level_1_moduli,
-                     const GenCoprimeAbstract<double> *m_level_2_moduli)
+                     const GenCoprimeAbstract<double> *m_level_2_moduli,
+                     PlanCache *plan_cache = NULL,
+                     const std::string &plan_key = "")
         : m_level_1_moduli(m_level_1_moduli),
           m_level_2_moduli(m_level_2_moduli),
           m_level_1_moduli_count(m_level_1_moduli->count())
@@ -46,6 +76,22 @@ class TwoPhaseAbstract
 #if DEBUG_MMC || TIME_MMC
         cerr << "########## TwoPhaseAlgo constructor ##########" << endl;
 #endif
+        PlanCache::Entry plan;
+        bool found = plan_cache && plan_cache->lookup(plan_key, plan);
+        // a plan of other level 1 moduli (or a corrupt one) is regenerated and overwritten
+        bool cached = found && plan_valid(plan) && plan[0].size() == m_level_1_moduli_count &&
+                      std::equal(plan[0].begin(), plan[0].end(), m_level_1_moduli->begin()) &&
+                      plan_level_2_sufficient(plan[1], m_level_1_moduli->max_bitsize());
+#if DEBUG_MMC || TIME_MMC
+        if (found && !cached)
+        {
+            cerr << "stale plan " << plan_key << " is regenerated" << endl;
+        }
+#endif
+        if (!m_level_2_moduli && cached)
+        {
+            m_level_2_moduli = new GenCoprimeList<double>(plan[1]);
+        }
         if (!m_level_2_moduli)
         {
             // The reason for having level 2 product bitsize > 2 * level 1 moduli bitsize is that
@@ -60,6 +106,41 @@ class TwoPhaseAbstract
         cerr << "m_level_2_moduli:" << endl << *m_level_2_moduli;
 #endif
         assert(m_level_1_moduli->product() > m_level_2_moduli->product() && "chosen RNS size must make sense.");
+        m_level_1_prefix_products.resize(m_level_1_moduli_count + 1);
+        m_level_1_prefix_products[0] = 1;
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            m_level_1_prefix_products[f + 1] = m_level_1_prefix_products[f] * m_level_1_moduli->val(f);
+        }
+        m_level_1_Mi = new mpz_t[m_level_1_moduli_count];
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            mpz_init(m_level_1_Mi[f]);
+            if (cached)
+            {
+                mpz_set(m_level_1_Mi[f], plan[2][f].get_mpz());
+            }
+            else if (f > 0)
+            {
+                mpz_invert(m_level_1_Mi[f], m_level_1_prefix_products[f].get_mpz(), m_level_1_moduli->val(f).get_mpz());
+            }
+        }
+        if (plan_cache && !cached)
+        {
+            plan.assign(3, std::vector<Givaro::Integer>());
+            plan[0].assign(m_level_1_moduli->begin(), m_level_1_moduli->end());
+            for (size_t j = 0; j < m_level_2_moduli_count; j++)
+            {
+                plan[1].push_back(Givaro::Integer(m_level_2_moduli->val(j)));
+            }
+            for (size_t f = 0; f < m_level_1_moduli_count; f++)
+            {
+                Givaro::Integer mi;
+                mpz_set(mi.get_mpz(), m_level_1_Mi[f]);
+                plan[2].push_back(mi);
+            }
+            plan_cache->store(plan_key, plan);
+        }
         // m_level_2_moduli repeats m_level_1_moduli_count times
         std::vector<Givaro::Integer> tmp(m_level_2_moduli_count * m_level_1_moduli_count);
         for (size_t i = 0; i < m_level_1_moduli_count; i++)
@@ -95,6 +176,11 @@ class TwoPhaseAbstract
 
     virtual ~TwoPhaseAbstract()
     {
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            mpz_clear(m_level_1_Mi[f]);
+        }
+        delete[] m_level_1_Mi;
         delete m_phase1_field;
         delete m_phase2_rns_rep;
         delete m_phase2_rns_field;
@@ -105,7 +191,115 @@ class TwoPhaseAbstract
     TwoPhaseAbstract(const TwoPhaseAbstract &) = delete;
     TwoPhaseAbstract &operator=(const TwoPhaseAbstract &) = delete;
 
+  protected:
+    /*
+        use this method in the constructor of a scheme to get its level 1 moduli,
+        from plan_cache if plan_key is cached there, otherwise from make()
+    */
+    template <typename Make>
+    static const GenCoprimeAbstract<Givaro::Integer> *plan_level_1_moduli(PlanCache *plan_cache, const std::string &plan_key, Make make)
+    {
+        PlanCache::Entry plan;
+        if (plan_cache && plan_cache->lookup(plan_key, plan) && plan_valid(plan))
+        {
+            return new GenCoprimeList<Givaro::Integer>(plan[0]);
+        }
+        return make();
+    }
+
+    /*
+        a cached plan is used only if it is well formed and its Mi are the inverses
+        of the prefix products of its level 1 moduli: Mi[f] * m_0 * ... * m_(f-1) = 1 mod m_f
+    */
+    static bool plan_valid(const PlanCache::Entry &plan)
+    {
+        if (plan.size() != 3 || plan[0].empty() || plan[1].empty() || plan[2].size() != plan[0].size())
+        {
+            return false;
+        }
+        Givaro::Integer prefix(1), check;
+        for (size_t f = 0; f < plan[0].size(); f++)
+        {
+            if (plan[0][f] <= 1)
+            {
+                return false;
+            }
+            if (f > 0)
+            {
+                mpz_mul(check.get_mpz(), plan[2][f].get_mpz(), prefix.get_mpz());
+                mpz_mod(check.get_mpz(), check.get_mpz(), plan[0][f].get_mpz());
+                if (mpz_cmp_ui(check.get_mpz(), 1) != 0)
+                {
+                    return false;
+                }
+            }
+            prefix *= plan[0][f];
+        }
+        return true;
+    }
+
+    // the cached level 2 moduli must leave room for the product of two level 1 residues, as generated below
+    static bool plan_level_2_sufficient(const std::vector<Givaro::Integer> &level_2_moduli, uint64_t level_1_max_bitsize)
+    {
+        Givaro::Integer product(1);
+        for (size_t j = 0; j < level_2_moduli.size(); j++)
+        {
+            product *= level_2_moduli[j];
+        }
+        return product.bitsize() >= 2 * level_1_max_bitsize + 10;
+    }
+
+    static std::string plan_key(const std::string &scheme, uint64_t a, uint64_t b, uint64_t c = 0)
+    {
+        return scheme + "/" + std::to_string(a) + "/" + std::to_string(b) + "/" + std::to_string(c);
+    }
+
   public:
+    /*
+        where matrix_recover_phase_1 writes the integers it recovers: entry(i) is the integer
+        entry i is recovered into and commit(i) is called once it holds its value, a LimbMatrix
+        output reuses one scratch integer for all entries and packs each into its limbs
+    */
+    class Phase1_Output
+    {
+        std::vector<Givaro::Integer> *m_integers;
+        LimbMatrix *m_limbs;
+        Givaro::Integer m_scratch;
+
+        static inline mp_bitcnt_t mpz_t_alloc_bits(mpz_srcptr t) { return mp_bitcnt_t(t->_mp_alloc) * GMP_NUMB_BITS; }
+
+      public:
+        Phase1_Output(std::vector<Givaro::Integer> &integers) : m_integers(&integers), m_limbs(NULL) {}
+        Phase1_Output(LimbMatrix &limbs) : m_integers(NULL), m_limbs(&limbs) {}
+
+        inline size_t size() const { return m_integers ? m_integers->size() : m_limbs->count(); }
+        // the integer entry i is recovered into, with room for bitsize bits
+        inline mpz_ptr entry(size_t i, mp_bitcnt_t bitsize)
+        {
+            mpz_ptr t = m_integers ? (*m_integers)[i].get_mpz() : m_scratch.get_mpz();
+            if (mpz_t_alloc_bits(t) < bitsize)
+            {
+                mpz_realloc2(t, bitsize);
+            }
+            return t;
+        }
+        inline void commit(size_t i)
+        {
+            if (m_limbs)
+            {
+                m_limbs->set(i, m_scratch.get_mpz());
+            }
+        }
+    };
+
+    // an integer matrix modulo SIM_RNS::FREIVALDS_CHECK_PRIME (see enable_verification)
+    struct Check_Image
+    {
+        size_t dim_m;
+        size_t dim_n;
+        std::vector<uint64_t> val;
+    };
+
     class Phase2_Matrix
     {
         // shared ptr will be deleted when no Phase2_Matrix holds the FFLAS_Mem
@@ -118,18 +312,33 @@ class TwoPhaseAbstract
         size_t count;
         size_t m_level_1_moduli_count;
         size_t m_level_2_moduli_count;
+        // false if the residues are only known to be in [0, residue_bound]
+        // rather than reduced modulo their level 2 moduli (see phase2_mult(..., lazy))
+        bool reduced = true;
+        double residue_bound = 0;
+        // bound on the bitsize of the integer each level 1 residue stands for,
+        // it must stay below the level 2 product bitsize to be recoverable
+        size_t value_bitsize = 0;
+        // with check prime verification: the image of a reduced matrix, or the images
+        // of the factors of a product, checked when the product is recovered
+        std::shared_ptr<const Check_Image> check_image;
+        std::shared_ptr<const Check_Image> check_left;
+        std::shared_ptr<const Check_Image> check_right;
         inline Phase2_RNS_Int_Ptr &data() { return m_data->data; }
         inline const Phase2_RNS_Int_Ptr &data() const { return m_data->data; }
 
         Phase2_Matrix() = default;
 
-        Phase2_Matrix(const TwoPhaseAbstract &f, size_t dim_m, size_t dim_n)
-            : m_data(std::make_shared<FFLAS_Mem<Phase2_RNS_Field>>(FFLAS::fflas_new(*(f.m_phase2_rns_field), f.m_level_1_moduli_count * dim_m * dim_n))),
+        // level_1_moduli_count is the number of level 1 moduli in use, 0 means all of them
+        Phase2_Matrix(const TwoPhaseAbstract &f, size_t dim_m, size_t dim_n, size_t level_1_moduli_count = 0)
+            : m_data(std::make_shared<FFLAS_Mem<Phase2_RNS_Field>>(FFLAS::fflas_new(*(f.m_phase2_rns_field), (level_1_moduli_count ? level_1_moduli_count : f.m_level_1_moduli_count) * dim_m * dim_n))),
               dim_m(dim_m),
               dim_n(dim_n),
               count(dim_n * dim_m),
-              m_level_1_moduli_count(f.m_level_1_moduli_count),
-              m_level_2_moduli_count(f.m_level_2_moduli_count)
+              m_level_1_moduli_count(level_1_moduli_count ? level_1_moduli_count : f.m_level_1_moduli_count),
+              m_level_2_moduli_count(f.m_level_2_moduli_count),
+              residue_bound(f.m_level_2_moduli->max() - 1),
+              value_bitsize(f.m_level_1_moduli->max_bitsize())
         {
             m_data->data._stride = this->count;
             assert(this->data()._stride == this->count);
@@ -137,13 +346,15 @@ class TwoPhaseAbstract
 
         Phase2_Matrix(const TwoPhaseAbstract &f,
                       const Phase2_RNS_Int_Ptr &arr,
-                      size_t dim_m, size_t dim_n)
+                      size_t dim_m, size_t dim_n, size_t level_1_moduli_count = 0)
             : m_data(std::make_shared<FFLAS_Mem<Phase2_RNS_Field>>(arr)),
               dim_m(dim_m),
               dim_n(dim_n),
               count(dim_n * dim_m),
-              m_level_1_moduli_count(f.m_level_1_moduli_count),
-              m_level_2_moduli_count(f.m_level_2_moduli_count)
+              m_level_1_moduli_count(level_1_moduli_count ? level_1_moduli_count : f.m_level_1_moduli_count),
+              m_level_2_moduli_count(f.m_level_2_moduli_count),
+              residue_bound(f.m_level_2_moduli->max() - 1),
+              value_bitsize(f.m_level_1_moduli->max_bitsize())
         {
             m_data->data._stride = this->count;
             assert(this->data()._stride == this->count);
@@ -216,22 +427,72 @@ class TwoPhaseAbstract
 
   protected:
     /*
-        this helper method is used by matrix_product(...)
+        use this method to reduce one input by the first level_1_moduli_count level 1 moduli
+        into out[0], ..., out[level_1_moduli_count - 1]
+    */
+    virtual void reduce_phase_1_entry(mpz_srcptr input, Phase1_Int *out, size_t level_1_moduli_count) const = 0;
+
+    /*
+        this helper method is used by matrix_product(...),
+        only the first level_1_moduli_count level 1 moduli are used
     */
-    virtual const std::vector<Phase1_Int> matrix_reduce_phase_1(const std::vector<Givaro::Integer> &inputs) const = 0;
+    const std::vector<Phase1_Int> matrix_reduce_phase_1(const std::vector<Givaro::Integer> &inputs, size_t level_1_moduli_count) const
+    {
+        size_t len_inputs = inputs.size();
+        TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_REDUCE, len_inputs * level_1_moduli_count);
+        // phase 1 begins
+        // p1_reduced stores multi-moduli representation of each input
+        // the entries are reduced independently, on the OpenMP threads
+        std::vector<Phase1_Int> p1_reduced(len_inputs * level_1_moduli_count);
+#pragma omp parallel for schedule(dynamic, 16)
+        for (long entry = 0; entry < long(len_inputs); entry++)
+        {
+            size_t i = entry;
+            reduce_phase_1_entry(inputs[i].get_mpz(), &p1_reduced[i * level_1_moduli_count], level_1_moduli_count);
+        }
+        return p1_reduced;
+    }
+
+    // the same, reading the entries in place and packing the residues of entry i into the row i
+    // of a LimbMatrix, every entry is reduced into the same level_1_moduli_count scratch integers
+    LimbMatrix matrix_reduce_phase_1(const LimbMatrix &inputs, size_t level_1_moduli_count) const
+    {
+        size_t len_inputs = inputs.count();
+        TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_REDUCE, len_inputs * level_1_moduli_count);
+        size_t bitsize = max_level_1_moduli_bitsize(level_1_moduli_count);
+        LimbMatrix p1_reduced(len_inputs, level_1_moduli_count, (bitsize + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+        std::vector<Phase1_Int> residues(level_1_moduli_count);
+        mpz_t v;
+        for (size_t i = 0; i < len_inputs; i++)
+        {
+            reduce_phase_1_entry(inputs.view(v, i), residues.data(), level_1_moduli_count);
+            for (size_t f = 0; f < level_1_moduli_count; f++)
+            {
+                p1_reduced.set(i * level_1_moduli_count + f, residues[f].get_mpz());
+            }
+        }
+        return p1_reduced;
+    }
 
   protected:
     /* 
-        use this method to recover from a phase 1 representations to integers
+        use this method to recover from a phase 1 representations to integers written to out,
+        the representations use the first level_1_moduli_count level 1 moduli
     */
-    virtual const std::vector<Givaro::Integer> matrix_recover_phase_1(const std::vector<Phase1_Int> &phase2_recovered) const = 0;
+    virtual void matrix_recover_phase_1(const std::vector<Phase1_Int> &phase2_recovered, size_t level_1_moduli_count, Phase1_Output &out) const = 0;
 
   public:
     /* 
-        use this method to reduce a single matrix to level 2
+        use this method to reduce a single matrix to level 2,
+        with level_1_moduli_count > 0 only that many level 1 moduli are used (see matrix_product)
     */
-    Phase2_Matrix matrix_reduce(const std::vector<Givaro::Integer> &inputs, size_t dim_m, size_t dim_n) const
+    Phase2_Matrix matrix_reduce(const std::vector<Givaro::Integer> &inputs, size_t dim_m, size_t dim_n, size_t level_1_moduli_count = 0) const
     {
+        if (!level_1_moduli_count)
+        {
+            level_1_moduli_count = m_level_1_moduli_count;
+        }
+        assert(level_1_moduli_count <= m_level_1_moduli_count);
         size_t len_inputs = inputs.size();
         assert(len_inputs == dim_m * dim_n && "input matrix dimension is incorrect");
         assert(dim_m > 0 && "input matrix dimension is incorrect");
@@ -256,11 +517,91 @@ class TwoPhaseAbstract
         Givaro::Timer timer;
         timer.start();
 #endif
-        std::vector<Phase1_Int> p1_reduced = matrix_reduce_phase_1(inputs);
+        std::vector<Phase1_Int> p1_reduced = matrix_reduce_phase_1(inputs, level_1_moduli_count);
+#if TIME_MMC
+        timer.stop();
+        cerr << "Timer: " << timer << endl;
+#endif
+        Phase2_Matrix mat = matrix_reduce_phase_2(p1_reduced, dim_m, dim_n, level_1_moduli_count);
+        if (m_verify_check_prime)
+        {
+            mat.check_image = make_check_image(inputs, 0, dim_m, dim_n);
+        }
+#if DEBUG_MMC
+        cerr << "phase 2 reduced: " << endl
+             << mat << endl;
+#endif
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_reduce ends ##########" << endl;
+#endif
+        return mat;
+    }
+
+  public:
+    /*
+        use this method to reduce a single LimbMatrix to level 2, its entries are read in place
+    */
+    Phase2_Matrix matrix_reduce(const LimbMatrix &inputs, size_t level_1_moduli_count = 0) const
+    {
+        if (!level_1_moduli_count)
+        {
+            level_1_moduli_count = m_level_1_moduli_count;
+        }
+        assert(level_1_moduli_count <= m_level_1_moduli_count);
+        assert(inputs.dim_m > 0 && inputs.dim_n > 0 && "input matrix dimension is incorrect");
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_reduce (limbs) ##########" << endl;
+#endif
+#if TIME_MMC
+        Givaro::Timer timer;
+        timer.start();
+#endif
+        LimbMatrix p1_reduced = matrix_reduce_phase_1(inputs, level_1_moduli_count);
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
 #endif
+        Phase2_Matrix mat = matrix_reduce_phase_2(p1_reduced, inputs.dim_m, inputs.dim_n, level_1_moduli_count);
+        if (m_verify_check_prime)
+        {
+            mat.check_image = make_check_image(inputs);
+        }
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_reduce ends ##########" << endl;
+#endif
+        return mat;
+    }
+
+  protected:
+    /*
+        this helper method reduces phase 1 representations modulo every level 2 moduli,
+        with BlasCRT when enabled
+    */
+    Phase2_RNS_Int_Ptr level_2_sim_reduce(const std::vector<Phase1_Int> &p1_reduced) const
+    {
+        if (m_blas_crt)
+        {
+            return SIM_RNS::blas_new_sim_reduce<Phase1_Field>(*m_blas_crt, p1_reduced, *m_phase2_rns_field);
+        }
+        return SIM_RNS::fflas_new_sim_reduce(*m_phase1_field, p1_reduced, *m_phase2_rns_field);
+    }
+
+    // the same from residues packed in a LimbMatrix, FFLAS reads Givaro integers so they are unpacked for it
+    Phase2_RNS_Int_Ptr level_2_sim_reduce(const LimbMatrix &p1_reduced) const
+    {
+        if (m_blas_crt)
+        {
+            return SIM_RNS::blas_new_sim_reduce(*m_blas_crt, p1_reduced, *m_phase2_rns_field);
+        }
+        return SIM_RNS::fflas_new_sim_reduce(*m_phase1_field, p1_reduced.to_integers(), *m_phase2_rns_field);
+    }
+
+    /*
+        this helper method is used by matrix_reduce(...),
+        reduces phase 1 representations of a dim_m x dim_n matrix to level 2
+    */
+    Phase2_Matrix matrix_reduce_phase_2(const std::vector<Phase1_Int> &p1_reduced, size_t dim_m, size_t dim_n, size_t level_1_moduli_count) const
+    {
 #if DEBUG_MMC
         cerr << "phase 1 reduced: " << endl
              << p1_reduced << endl;
@@ -270,10 +611,14 @@ class TwoPhaseAbstract
         cerr << "..... phase 2 reduce ....." << endl;
 #endif
 #if TIME_MMC
-        timer.clear();
+        Givaro::Timer timer;
         timer.start();
 #endif
-        Phase2_RNS_Int_Ptr phase2_outputs = SIM_RNS::fflas_new_sim_reduce(*m_phase1_field, p1_reduced, *m_phase2_rns_field);
+        Phase2_RNS_Int_Ptr phase2_outputs;
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_REDUCE, p1_reduced.size() * m_level_2_moduli_count);
+            phase2_outputs = level_2_sim_reduce(p1_reduced);
+        }
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
@@ -281,29 +626,45 @@ class TwoPhaseAbstract
 #if DEBUG_MMC || TIME_MMC
         cerr << "..... phase 2 reduce ends ....." << endl;
 #endif
-        Phase2_Matrix mat(*this, dim_m, dim_n);
+        return matrix_layout_phase_2(phase2_outputs, dim_m, dim_n, level_1_moduli_count);
+    }
+
+    // the same from residues packed in a LimbMatrix (see matrix_reduce_phase_1)
+    Phase2_Matrix matrix_reduce_phase_2(const LimbMatrix &p1_reduced, size_t dim_m, size_t dim_n, size_t level_1_moduli_count) const
+    {
+        Phase2_RNS_Int_Ptr phase2_outputs;
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_REDUCE, p1_reduced.count() * m_level_2_moduli_count);
+            phase2_outputs = level_2_sim_reduce(p1_reduced);
+        }
+        return matrix_layout_phase_2(phase2_outputs, dim_m, dim_n, level_1_moduli_count);
+    }
+
+    /*
+        this helper method moves the level 2 residues of the phase 1 representations of a
+        dim_m x dim_n matrix, as the level 2 reduce writes them, into a Phase2_Matrix
+        and frees them
+    */
+    Phase2_Matrix matrix_layout_phase_2(Phase2_RNS_Int_Ptr phase2_outputs, size_t dim_m, size_t dim_n, size_t level_1_moduli_count) const
+    {
+        Phase2_Matrix mat(*this, dim_m, dim_n, level_1_moduli_count);
+        TwoPhaseMetrics::Scope layout_scope(m_metrics, TWO_PHASE_STAGE_REDUCE_LAYOUT, mat.count * level_1_moduli_count * m_level_2_moduli_count);
         for (size_t r = 0; r < dim_m; r++)
         {
             for (size_t c = 0; c < dim_n; c++)
             {
                 size_t i = r * mat.dim_n + c;
-                for (size_t f = 0; f < m_level_1_moduli_count; f++)
+                for (size_t f = 0; f < level_1_moduli_count; f++)
                 {
                     for (size_t m = 0; m < m_level_2_moduli_count; m++)
                     {
-                        mat.ref(r, c, f, m)._ptr[0] = phase2_outputs[m * (mat.count * m_level_1_moduli_count) + (i * m_level_1_moduli_count) + f]._ptr[0];
+                        mat.ref(r, c, f, m)._ptr[0] = phase2_outputs[m * (mat.count * level_1_moduli_count) + (i * level_1_moduli_count) + f]._ptr[0];
                     }
                 }
             }
         }
+        layout_scope.stop();
         FFLAS::fflas_delete(phase2_outputs);
-#if DEBUG_MMC
-        cerr << "phase 2 reduced: " << endl
-             << mat << endl;
-#endif
-#if DEBUG_MMC || TIME_MMC
-        cerr << "########## matrix_reduce ends ##########" << endl;
-#endif
         return mat;
     }
 
@@ -312,8 +673,13 @@ class TwoPhaseAbstract
         use this method to reduce multiple matrices to level 2
         shoule be faster than reducing one by one
     */
-    const std::vector<Phase2_Matrix> matrix_reduce(const std::vector<Givaro::Integer> &matrices, const std::vector<size_t> &dimensions)
+    const std::vector<Phase2_Matrix> matrix_reduce(const std::vector<Givaro::Integer> &matrices, const std::vector<size_t> &dimensions, size_t level_1_moduli_count = 0)
     {
+        if (!level_1_moduli_count)
+        {
+            level_1_moduli_count = m_level_1_moduli_count;
+        }
+        assert(level_1_moduli_count <= m_level_1_moduli_count);
         size_t len_inputs = matrices.size();
         size_t num_matrices = dimensions.size() - 1;
 #if DEBUG_MMC || TIME_MMC
@@ -342,7 +708,7 @@ class TwoPhaseAbstract
         Givaro::Timer timer;
         timer.start();
 #endif
-        const std::vector<Phase1_Int> p1_reduced = matrix_reduce_phase_1(matrices);
+        const std::vector<Phase1_Int> p1_reduced = matrix_reduce_phase_1(matrices, level_1_moduli_count);
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
@@ -361,7 +727,11 @@ class TwoPhaseAbstract
         timer.clear();
         timer.start();
 #endif
-        Phase2_RNS_Int_Ptr phase2_outputs = SIM_RNS::fflas_new_sim_reduce(*m_phase1_field, p1_reduced, *m_phase2_rns_field);
+        Phase2_RNS_Int_Ptr phase2_outputs;
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_REDUCE, p1_reduced.size() * m_level_2_moduli_count);
+            phase2_outputs = level_2_sim_reduce(p1_reduced);
+        }
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
@@ -370,25 +740,33 @@ class TwoPhaseAbstract
         cerr << "..... phase 2 reduce ends ....." << endl;
 #endif
         std::vector<Phase2_Matrix> outputs(num_matrices);
+        size_t offset = 0;
         for (size_t o = 0; o < num_matrices; o++)
         {
             size_t dim_m = dimensions[o];
             size_t dim_n = dimensions[o + 1];
-            Phase2_Matrix mat(*this, dim_m, dim_n);
+            Phase2_Matrix mat(*this, dim_m, dim_n, level_1_moduli_count);
+            TwoPhaseMetrics::Scope layout_scope(m_metrics, TWO_PHASE_STAGE_REDUCE_LAYOUT, mat.count * level_1_moduli_count * m_level_2_moduli_count);
             for (size_t r = 0; r < dim_m; r++)
             {
                 for (size_t c = 0; c < dim_n; c++)
                 {
                     size_t i = r * mat.dim_n + c;
-                    for (size_t f = 0; f < m_level_1_moduli_count; f++)
+                    for (size_t f = 0; f < level_1_moduli_count; f++)
                     {
                         for (size_t m = 0; m < m_level_2_moduli_count; m++)
                         {
-                            mat.ref(r, c, f, m)._ptr[0] = phase2_outputs[m * num_matrices * mat.count * m_level_1_moduli_count + o * mat.count * m_level_1_moduli_count + i * m_level_1_moduli_count + f]._ptr[0];
+                            mat.ref(r, c, f, m)._ptr[0] = phase2_outputs[m * num_matrices * mat.count * level_1_moduli_count + o * mat.count * level_1_moduli_count + i * level_1_moduli_count + f]._ptr[0];
                         }
                     }
                 }
             }
+            layout_scope.stop();
+            if (m_verify_check_prime)
+            {
+                mat.check_image = make_check_image(matrices, offset, dim_m, dim_n);
+            }
+            offset += mat.count;
             outputs[o] = mat;
         }
         FFLAS::fflas_delete(phase2_outputs);
@@ -408,28 +786,39 @@ class TwoPhaseAbstract
     */
     virtual std::vector<Phase1_Int> matrix_recover_phase_2(const Phase2_Matrix &mat) const
     {
-        Phase2_RNS_Int_Ptr phase2_inputs = FFLAS::fflas_new(*m_phase2_rns_field, m_level_1_moduli_count * mat.count);
+        size_t level_1_moduli_count = mat.m_level_1_moduli_count;
+        Phase2_RNS_Int_Ptr phase2_inputs = FFLAS::fflas_new(*m_phase2_rns_field, level_1_moduli_count * mat.count);
+        TwoPhaseMetrics::Scope layout_scope(m_metrics, TWO_PHASE_STAGE_RECOVER_LAYOUT, mat.count * level_1_moduli_count * m_level_2_moduli_count);
         for (size_t r = 0; r < mat.dim_m; r++)
         {
             for (size_t c = 0; c < mat.dim_n; c++)
             {
                 size_t i = r * mat.dim_n + c;
-                for (size_t f = 0; f < m_level_1_moduli_count; f++)
+                for (size_t f = 0; f < level_1_moduli_count; f++)
                 {
                     for (size_t m = 0; m < m_level_2_moduli_count; m++)
                     {
                         // phase2_inputs[(m_level_2_moduli_count * m_level_1_moduli_count) * i + f * m_level_2_moduli_count + m]._ptr[0] = mat.ref(r, c, f, m)._ptr[0];
-                        phase2_inputs[m * (mat.count * m_level_1_moduli_count) + (i * m_level_1_moduli_count) + f]._ptr[0] = mat.ref(r, c, f, m)._ptr[0];
+                        double v = mat.ref(r, c, f, m)._ptr[0];
+                        if (!mat.reduced)
+                        {
+                            // finish a lazy product on the fly
+                            double p = m_phase2_rns_field->rns()._basis[m];
+                            v = SIM_RNS::batched_reduce(v, p, 1.0 / p);
+                        }
+                        phase2_inputs[m * (mat.count * level_1_moduli_count) + (i * level_1_moduli_count) + f]._ptr[0] = v;
                     }
                 }
             }
         }
+        layout_scope.stop();
 
 #if DEBUG_MMC || TIME_MMC
         cerr << ".......... fflas_new_sim_recover .........." << endl;
 #endif
         // phase 2 recovery begins
-        auto result = SIM_RNS::fflas_new_sim_recover(*m_phase2_rns_field, phase2_inputs, mat.count * m_level_1_moduli_count, *m_phase1_field);
+        auto result = m_blas_crt ? SIM_RNS::blas_new_sim_recover(*m_blas_crt, *m_phase2_rns_field, phase2_inputs, mat.count * level_1_moduli_count, *m_phase1_field)
+                                 : SIM_RNS::fflas_new_sim_recover(*m_phase2_rns_field, phase2_inputs, mat.count * level_1_moduli_count, *m_phase1_field);
 #if DEBUG_MMC || TIME_MMC
         cerr << ".......... fflas_new_sim_recover ends .........." << endl;
 #endif
@@ -449,6 +838,55 @@ class TwoPhaseAbstract
 #if DEBUG_MMC
         cerr << mat << endl;
 #endif
+        std::vector<Givaro::Integer> phase1_recovered(mat.count);
+        Phase1_Output out(phase1_recovered);
+        matrix_recover(mat, out);
+#if DEBUG_MMC
+        cerr << phase1_recovered << endl;
+#endif
+        if (m_verify_check_prime && mat.check_left && mat.check_right)
+        {
+            verify_check_prime(*mat.check_left, *mat.check_right, phase1_recovered);
+        }
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_recover ends ##########" << endl;
+#endif
+        return phase1_recovered;
+    }
+
+  public:
+    /*
+        use this method to recover a single reduced matrix into a LimbMatrix,
+        the entries are recovered straight into its limbs
+    */
+    LimbMatrix matrix_recover_limbs(const Phase2_Matrix &mat) const
+    {
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_recover (limbs) ##########" << endl;
+#endif
+        // the entries are below the product of the level 1 moduli in use
+        size_t bitsize = m_level_1_prefix_products[mat.m_level_1_moduli_count].bitsize();
+        LimbMatrix limbs(mat.dim_m, mat.dim_n, std::max<size_t>(1, (bitsize + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS));
+        Phase1_Output out(limbs);
+        matrix_recover(mat, out);
+        if (m_verify_check_prime && mat.check_left && mat.check_right)
+        {
+            verify_check_prime(*mat.check_left, *mat.check_right, limbs);
+        }
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## matrix_recover ends ##########" << endl;
+#endif
+        return limbs;
+    }
+
+  protected:
+    /*
+        this helper method is used by matrix_recover(...) and matrix_recover_limbs(...),
+        recovers mat through both phases into out
+    */
+    void matrix_recover(const Phase2_Matrix &mat, Phase1_Output &out) const
+    {
+        assert(out.size() == mat.count);
 #if DEBUG_MMC || TIME_MMC
         cerr << "..... phase 2 recovery ....." << endl;
 #endif
@@ -456,7 +894,11 @@ class TwoPhaseAbstract
         Givaro::Timer timer;
         timer.start();
 #endif
-        const std::vector<Phase1_Int> phase2_recovered = matrix_recover_phase_2(mat);
+        std::vector<Phase1_Int> phase2_recovered;
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_RECOVER, mat.count * mat.m_level_1_moduli_count);
+            phase2_recovered = matrix_recover_phase_2(mat);
+        }
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
@@ -472,7 +914,10 @@ class TwoPhaseAbstract
         timer.clear();
         timer.start();
 #endif
-        const std::vector<Givaro::Integer> phase1_recovered = matrix_recover_phase_1(phase2_recovered);
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_RECOVER, mat.count);
+            matrix_recover_phase_1(phase2_recovered, mat.m_level_1_moduli_count, out);
+        }
 #if TIME_MMC
         timer.stop();
         cerr << "Timer: " << timer << endl;
@@ -480,62 +925,890 @@ class TwoPhaseAbstract
 #if DEBUG_MMC || TIME_MMC
         cerr << "..... phase 1 recovery ends ....." << endl;
 #endif
-#if DEBUG_MMC
-        cerr << phase1_recovered << endl;
-#endif
-#if DEBUG_MMC || TIME_MMC
-        cerr << "########## matrix_recover ends ##########" << endl;
-#endif
-        return phase1_recovered;
     }
 
   public:
-    /* 
-        use this method to multiply two reduced matrices
+    /*
+        use this method to multiply two integer matrices, matrix_a is dim_m x dim_n and
+        matrix_b is dim_n x dim_k, both with nonnegative entries
+        the entries of the product are bounded by max|a| * max|b| * dim_n, so only enough level 1
+        moduli to hold that bound are used in all three phases, which pays off when the inputs
+        are much smaller than the level 1 product
     */
-    Phase2_Matrix phase2_mult(const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b) const
+    std::vector<Givaro::Integer> matrix_product(const std::vector<Givaro::Integer> &matrix_a,
+                                                const std::vector<Givaro::Integer> &matrix_b,
+                                                size_t dim_m, size_t dim_n, size_t dim_k) const
     {
 #if DEBUG_MMC || TIME_MMC
-        cerr << "########## phase2_mult ##########" << endl;
-#endif
-#if DEBUG_MMC
-        cerr << " - matrix_a: " << endl;
-        cerr << matrix_a << endl;
-        cerr << " - matrix_b: " << endl;
-        cerr << matrix_b << endl;
+        cerr << "########## matrix_product ##########" << endl;
 #endif
-        assert(matrix_a.dim_n == matrix_b.dim_m);
-        Phase2_Matrix matrix_c = phase2_matrix_fgemm(matrix_a.data(), matrix_b.data(), matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_m);
-#if DEBUG_MMC
-        cerr << " - matrix product:" << endl;
-        cerr << matrix_c;
+        assert(matrix_a.size() == dim_m * dim_n && matrix_b.size() == dim_n * dim_k && "input matrix dimension is incorrect");
+        assert(nonnegative(matrix_a) && nonnegative(matrix_b) && "matrix_product needs nonnegative entries");
+        size_t bound_bitsize = max_bitsize(matrix_a) + max_bitsize(matrix_b) + Givaro::Integer(uint64_t(dim_n)).bitsize();
+        assert(bound_bitsize < m_level_1_prefix_products[m_level_1_moduli_count].bitsize() && "the product bound exceeds the level 1 moduli product");
+        size_t level_1_moduli_count = level_1_moduli_count_for(bound_bitsize);
+#if DEBUG_MMC || TIME_MMC
+        cerr << " - output bound: " << bound_bitsize << " bits, using " << level_1_moduli_count << " of " << m_level_1_moduli_count << " level 1 moduli" << endl;
 #endif
+        Phase2_Matrix a = matrix_reduce(matrix_a, dim_m, dim_n, level_1_moduli_count);
+        Phase2_Matrix b = matrix_reduce(matrix_b, dim_n, dim_k, level_1_moduli_count);
+        std::vector<Givaro::Integer> c = matrix_recover(phase2_mult(a, b));
 #if DEBUG_MMC || TIME_MMC
-        cerr << "########## phase2_mult ends ##########" << endl;
+        cerr << "########## matrix_product ends ##########" << endl;
 #endif
-        return matrix_c;
+        return c;
     }
 
-    Phase2_Matrix phase2_matrix_fgemm(
-        const Phase2_RNS_Int_Ptr &matrix_a,
-        const Phase2_RNS_Int_Ptr &matrix_b,
-        size_t dim_m, size_t dim_n, size_t dim_k) const
+    /*
+        use this method to multiply two LimbMatrix, as matrix_product on vectors of integers,
+        both with nonnegative entries
+    */
+    LimbMatrix matrix_product(const LimbMatrix &matrix_a, const LimbMatrix &matrix_b) const
     {
-        return Phase2_Matrix(*this, fflas_new_fgemm(matrix_a, matrix_b, dim_m, dim_n, dim_k), dim_m, dim_k);
+        assert(matrix_a.dim_n == matrix_b.dim_m && "input matrix dimension is incorrect");
+        assert(matrix_a.nonnegative() && matrix_b.nonnegative() && "matrix_product needs nonnegative entries");
+        size_t bound_bitsize = matrix_a.max_bitsize() + matrix_b.max_bitsize() + Givaro::Integer(uint64_t(matrix_a.dim_n)).bitsize();
+        assert(bound_bitsize < m_level_1_prefix_products[m_level_1_moduli_count].bitsize() && "the product bound exceeds the level 1 moduli product");
+        size_t level_1_moduli_count = level_1_moduli_count_for(bound_bitsize);
+        Phase2_Matrix a = matrix_reduce(matrix_a, level_1_moduli_count);
+        Phase2_Matrix b = matrix_reduce(matrix_b, level_1_moduli_count);
+        return matrix_recover_limbs(phase2_mult(a, b));
     }
 
-    Phase2_RNS_Int_Ptr fflas_new_fgemm(
-        const Phase2_RNS_Int_Ptr &matrix_a,
-        const Phase2_RNS_Int_Ptr &matrix_b,
-        size_t dim_m, size_t dim_n, size_t dim_k) const
+    /*
+        use this method to get the smallest number of level 1 moduli whose product
+        exceeds every integer of the given bitsize, capped at the number of level 1 moduli
+    */
+    size_t level_1_moduli_count_for(size_t bitsize) const
     {
+        for (size_t n = min_level_1_moduli_count(); n < m_level_1_moduli_count; n++)
+        {
+            if (m_level_1_prefix_products[n].bitsize() > bitsize)
+            {
+                return n;
+            }
+        }
+        return m_level_1_moduli_count;
+    }
 
-        assert(dim_m && dim_n && dim_k);
-        // create matrix_c to return
-        Phase2_RNS_Int_Ptr matrix_c = FFLAS::fflas_new(*m_phase2_rns_field, m_level_1_moduli_count * dim_m * dim_k);
-        matrix_c._stride = dim_m * dim_k;
+    /*
+        use this method to get the shape of a product of dim_m x dim_n by dim_n x dim_k matrices
+        with entries of input_bitsize bits, using as many level 1 moduli as matrix_product would
+    */
+    TwoPhaseShape shape(size_t dim_m, size_t dim_n, size_t dim_k, uint_fast64_t input_bitsize) const
+    {
+        TwoPhaseShape s;
+        s.dim_m = dim_m;
+        s.dim_n = dim_n;
+        s.dim_k = dim_k;
+        s.input_bitsize = input_bitsize;
+        s.level_1_moduli_count = level_1_moduli_count_for(2 * input_bitsize + Givaro::Integer(uint64_t(dim_n)).bitsize());
+        s.level_1_moduli_bitsize = m_level_1_moduli->max_bitsize();
+        s.level_2_moduli_count = m_level_2_moduli_count;
+        return s;
+    }
 
-        // assert(m_phase2_rns_field->size() == m_level_2_moduli_count * m_level_1_moduli_count);
+    /*
+        use this method to predict the time in seconds of matrix_product with the given cost model
+    */
+    double predict_cost(const TwoPhaseCostModel &model, size_t dim_m, size_t dim_n, size_t dim_k, uint_fast64_t input_bitsize) const
+    {
+        return model.predict(shape(dim_m, dim_n, dim_k, input_bitsize));
+    }
+
+  protected:
+    // schemes whose first level 1 moduli are special cased may need more than one of them
+    virtual size_t min_level_1_moduli_count() const
+    {
+        return 1;
+    }
+
+    // bitsize of the largest of the first level_1_moduli_count level 1 moduli
+    size_t max_level_1_moduli_bitsize(size_t level_1_moduli_count) const
+    {
+        size_t bitsize = 0;
+        for (size_t f = 0; f < level_1_moduli_count; f++)
+        {
+            bitsize = std::max(bitsize, (size_t)m_level_1_moduli->val(f).bitsize());
+        }
+        return bitsize;
+    }
+
+    static size_t max_bitsize(const std::vector<Givaro::Integer> &matrix)
+    {
+        size_t bitsize = 0;
+        for (const auto &e : matrix)
+        {
+            bitsize = std::max(bitsize, (size_t)e.bitsize());
+        }
+        return bitsize;
+    }
+
+    static bool nonnegative(const std::vector<Givaro::Integer> &matrix)
+    {
+        for (const auto &e : matrix)
+        {
+            if (e < 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  public:
+    /* 
+        use this method to multiply two reduced matrices,
+        with lazy = true the product may be left unreduced (see Phase2_Matrix::reduced),
+        which is cheaper when it is only fed to another phase2_mult or matrix_recover
+    */
+    Phase2_Matrix phase2_mult(const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b, bool lazy = false) const
+    {
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_mult ##########" << endl;
+#endif
+#if DEBUG_MMC
+        cerr << " - matrix_a: " << endl;
+        cerr << matrix_a << endl;
+        cerr << " - matrix_b: " << endl;
+        cerr << matrix_b << endl;
+#endif
+        assert(matrix_a.dim_n == matrix_b.dim_m);
+        assert(matrix_a.m_level_1_moduli_count == matrix_b.m_level_1_moduli_count && "matrices must be reduced with the same level 1 moduli");
+        size_t level_1_moduli_count = matrix_a.m_level_1_moduli_count;
+        TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_PHASE_2_MULT, matrix_a.dim_m * matrix_b.dim_n * level_1_moduli_count * m_level_2_moduli_count);
+        size_t value_bitsize = matrix_a.value_bitsize + matrix_b.value_bitsize + Givaro::Integer(uint64_t(matrix_a.dim_n)).bitsize();
+#if CHECK_MMC
+        assert(value_bitsize < m_level_2_moduli->product_bitsize() && "level 2 moduli product is too small to hold this product, see phase2_chain_mult");
+#endif
+        Phase2_Matrix matrix_c;
+        if (batched_fgemm_eligible(matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_n))
+        {
+            // the batched kernel accepts unreduced inputs and can leave its output unreduced
+            matrix_c = Phase2_Matrix(*this, matrix_a.dim_m, matrix_b.dim_n, level_1_moduli_count);
+            std::vector<double> moduli = phase2_slice_moduli(level_1_moduli_count);
+            matrix_c.residue_bound = SIM_RNS::batched_fgemm(moduli.size(), moduli.data(),
+                                                            matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_n,
+                                                            NULL,
+                                                            matrix_a.data()._ptr, matrix_a.count, matrix_a.residue_bound,
+                                                            matrix_b.data()._ptr, matrix_b.count, matrix_b.residue_bound,
+                                                            NULL,
+                                                            matrix_c.data()._ptr, matrix_c.count,
+                                                            !lazy);
+            matrix_c.reduced = !lazy;
+        }
+        else
+        {
+            matrix_c = phase2_matrix_fgemm(phase2_reduce(matrix_a).data(), phase2_reduce(matrix_b).data(), matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_n, level_1_moduli_count);
+        }
+        matrix_c.value_bitsize = value_bitsize;
+        if (m_verify_slices)
+        {
+            phase2_verify(matrix_a, matrix_b, matrix_c);
+        }
+        if (m_verify_check_prime)
+        {
+            matrix_c.check_left = matrix_a.check_image;
+            matrix_c.check_right = matrix_b.check_image;
+        }
+#if DEBUG_MMC
+        cerr << " - matrix product:" << endl;
+        cerr << matrix_c;
+#endif
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_mult ends ##########" << endl;
+#endif
+        return matrix_c;
+    }
+
+  public:
+    /*
+        use this method to record the time, residues and GMP allocations of every stage
+        of the following reductions, products and recoveries into metrics (see TwoPhaseMetrics),
+        NULL detaches it; metrics must outlive its use here
+    */
+    void attach_metrics(TwoPhaseMetrics *metrics) { m_metrics = metrics; }
+    TwoPhaseMetrics *metrics() const { return m_metrics; }
+
+    /*
+        use this method to switch the level 2 reduction and CRT from FFLAS' finit_rns / fconvert_rns
+        to the BLAS matrix products of BlasCRT, or back with enable = false
+    */
+    void enable_blas_crt(bool enable = true)
+    {
+        if (enable && !m_blas_crt)
+        {
+            m_blas_crt.reset(new BlasCRT(*m_level_2_moduli, m_level_1_moduli->max_bitsize()));
+        }
+        else if (!enable)
+        {
+            m_blas_crt.reset();
+        }
+    }
+
+    bool blas_crt_enabled() const { return bool(m_blas_crt); }
+
+    /*
+        use this method to verify every phase2_mult with Freivalds' algorithm on num_slices
+        random residue slices (0 turns it off), and with use_check_prime, to also verify
+        the recovered product modulo an extra prime whose images of the inputs are taken
+        by matrix_reduce; both cost O(n^2) per check, failures are counted
+        (see verification_failures)
+    */
+    void enable_verification(size_t num_slices, bool use_check_prime = false)
+    {
+        m_verify_slices = std::min(num_slices, m_level_1_moduli_count * m_level_2_moduli_count);
+        m_verify_check_prime = use_check_prime;
+#if !PSEUDO_RANDOM_MMC
+        m_verify_rng.seed(std::random_device()());
+#endif
+    }
+
+    size_t verification_failures() const
+    {
+        return m_verify_failures;
+    }
+
+    /*
+        use this method to check matrix_c == matrix_a * matrix_b on m_verify_slices random slices
+    */
+    bool phase2_verify(const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b, const Phase2_Matrix &matrix_c) const
+    {
+        assert(matrix_a.dim_n == matrix_b.dim_m);
+        assert(matrix_c.dim_m == matrix_a.dim_m && matrix_c.dim_n == matrix_b.dim_n);
+        size_t num_slices = matrix_c.m_level_1_moduli_count * m_level_2_moduli_count;
+        size_t num_checks = std::min(std::max(m_verify_slices, (size_t)1), num_slices);
+        // draw the slices without replacement
+        std::vector<size_t> slices(num_slices);
+        for (size_t i = 0; i < num_slices; i++)
+        {
+            slices[i] = i;
+        }
+        std::vector<uint64_t> x(matrix_c.dim_n);
+        for (size_t t = 0; t < num_checks; t++)
+        {
+            std::swap(slices[t], slices[std::uniform_int_distribution<size_t>(t, num_slices - 1)(m_verify_rng)]);
+            size_t i = slices[t];
+            uint64_t p = (uint64_t)m_phase2_rns_field->rns()._basis[i % m_level_2_moduli_count];
+            // nonzero coordinates, so that a single wrong entry is always caught
+            std::uniform_int_distribution<uint64_t> dist(1, p - 1);
+            for (auto &e : x)
+            {
+                e = dist(m_verify_rng);
+            }
+            if (!SIM_RNS::freivalds(p, matrix_a.dim_m, matrix_a.dim_n, matrix_b.dim_n,
+                                    matrix_a.data()._ptr + i * matrix_a.count,
+                                    matrix_b.data()._ptr + i * matrix_b.count,
+                                    matrix_c.data()._ptr + i * matrix_c.count,
+                                    x.data()))
+            {
+                m_verify_failures++;
+#if DEBUG_MMC
+                cerr << "phase2_verify: residue slice " << i << " of the product is wrong" << endl;
+#endif
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+        use this method to check a recovered product modulo the check prime,
+        only meaningful if the product is smaller than the level 1 moduli product
+    */
+    bool verify_check_prime(const Check_Image &image_a, const Check_Image &image_b, const std::vector<Givaro::Integer> &product) const
+    {
+        std::vector<uint64_t> image_c(product.size());
+        for (size_t i = 0; i < product.size(); i++)
+        {
+            image_c[i] = mpz_fdiv_ui(product[i].get_mpz(), SIM_RNS::FREIVALDS_CHECK_PRIME);
+        }
+        return verify_check_prime(image_a, image_b, image_c);
+    }
+
+    bool verify_check_prime(const Check_Image &image_a, const Check_Image &image_b, const LimbMatrix &product) const
+    {
+        std::vector<uint64_t> image_c(product.count());
+        mpz_t v;
+        for (size_t i = 0; i < product.count(); i++)
+        {
+            image_c[i] = mpz_fdiv_ui(product.view(v, i), SIM_RNS::FREIVALDS_CHECK_PRIME);
+        }
+        return verify_check_prime(image_a, image_b, image_c);
+    }
+
+    bool verify_check_prime(const Check_Image &image_a, const Check_Image &image_b, const std::vector<uint64_t> &image_c) const
+    {
+        assert(image_a.dim_n == image_b.dim_m);
+        assert(image_c.size() == image_a.dim_m * image_b.dim_n);
+        const uint64_t q = SIM_RNS::FREIVALDS_CHECK_PRIME;
+        std::uniform_int_distribution<uint64_t> dist(0, q - 1);
+        std::vector<uint64_t> x(image_b.dim_n);
+        for (auto &e : x)
+        {
+            e = dist(m_verify_rng);
+        }
+        if (!SIM_RNS::freivalds(q, image_a.dim_m, image_a.dim_n, image_b.dim_n,
+                                image_a.val.data(), image_b.val.data(), image_c.data(), x.data()))
+        {
+            m_verify_failures++;
+#if DEBUG_MMC
+            cerr << "verify_check_prime: recovered product is wrong" << endl;
+#endif
+            return false;
+        }
+        return true;
+    }
+
+  public:
+    /*
+        use this method to multiply a chain of reduced matrices A0 * A1 * ... * An,
+        eg. the outputs of matrix_reduce(matrices, dimensions)
+        the multiplication order is chosen from the dimension chain and intermediate
+        products are kept unreduced, the returned product is reduced
+    */
+    Phase2_Matrix phase2_chain_mult(const std::vector<Phase2_Matrix> &matrices) const
+    {
+        size_t num_matrices = matrices.size();
+        assert(num_matrices >= 1 && "need at least 1 matrix");
+        std::vector<size_t> dimensions(num_matrices + 1);
+        dimensions[0] = matrices[0].dim_m;
+        for (size_t i = 0; i < num_matrices; i++)
+        {
+            assert((i == 0 || matrices[i].dim_m == matrices[i - 1].dim_n) && "matrix dimensions don't chain");
+            dimensions[i + 1] = matrices[i].dim_n;
+        }
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_chain_mult (" << num_matrices << ") ##########" << endl;
+#endif
+        std::vector<size_t> split = matrix_chain_order(dimensions);
+        Phase2_Matrix product = phase2_chain_mult(matrices, split, 0, num_matrices - 1, false);
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_chain_mult ends ##########" << endl;
+#endif
+        return phase2_reduce(product);
+    }
+
+  public:
+    /*
+        use this method to add two reduced matrices without leaving the residues
+    */
+    Phase2_Matrix phase2_add(const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b) const
+    {
+        assert(matrix_a.dim_m == matrix_b.dim_m && matrix_a.dim_n == matrix_b.dim_n);
+        assert(matrix_a.m_level_1_moduli_count == matrix_b.m_level_1_moduli_count && "matrices must be reduced with the same level 1 moduli");
+        Phase2_Matrix a = phase2_reduce(phase2_fit(matrix_a, 1));
+        Phase2_Matrix b = phase2_reduce(phase2_fit(matrix_b, 1));
+        Phase2_Matrix out(*this, a.dim_m, a.dim_n, a.m_level_1_moduli_count);
+        std::vector<double> moduli = phase2_slice_moduli(a.m_level_1_moduli_count);
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            const double *x = a.data()._ptr + i * a.count;
+            const double *y = b.data()._ptr + i * b.count;
+            double *o = out.data()._ptr + i * out.count;
+            for (size_t j = 0; j < a.count; j++)
+            {
+                double v = x[j] + y[j];
+                o[j] = (v >= moduli[i]) ? v - moduli[i] : v;
+            }
+        }
+        out.value_bitsize = std::max(a.value_bitsize, b.value_bitsize) + 1;
+        return out;
+    }
+
+    /*
+        use this method to subtract two reduced matrices without leaving the residues,
+        the integers behind the residues must stay nonnegative, so a multiple of each
+        level 1 moduli larger than the integers behind matrix_b is added to the difference
+    */
+    Phase2_Matrix phase2_sub(const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b) const
+    {
+        assert(matrix_a.dim_m == matrix_b.dim_m && matrix_a.dim_n == matrix_b.dim_n);
+        assert(matrix_a.m_level_1_moduli_count == matrix_b.m_level_1_moduli_count && "matrices must be reduced with the same level 1 moduli");
+        // the difference is below max(a, offset) + 1 with an offset up to 2 bits above b or the level 1 moduli
+        Phase2_Matrix a = phase2_reduce(phase2_fit(matrix_a, 1));
+        Phase2_Matrix b = phase2_reduce(phase2_fit(matrix_b, 2));
+        Phase2_Matrix out(*this, a.dim_m, a.dim_n, a.m_level_1_moduli_count);
+        std::vector<double> moduli = phase2_slice_moduli(a.m_level_1_moduli_count);
+        // offset_f = ceil(2^bitsize(b) / M_f) * M_f
+        std::vector<double> offsets(moduli.size());
+        Givaro::Integer bound = Givaro::Integer(1) << b.value_bitsize;
+        for (size_t f = 0; f < a.m_level_1_moduli_count; f++)
+        {
+            const Givaro::Integer &modulus = m_level_1_moduli->val(f);
+            Givaro::Integer offset;
+            mpz_cdiv_q(offset.get_mpz(), bound.get_mpz(), modulus.get_mpz());
+            offset *= modulus;
+            for (size_t m = 0; m < m_level_2_moduli_count; m++)
+            {
+                offsets[f * m_level_2_moduli_count + m] = mpz_fdiv_ui(offset.get_mpz(), (unsigned long)moduli[m]);
+            }
+        }
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            const double *x = a.data()._ptr + i * a.count;
+            const double *y = b.data()._ptr + i * b.count;
+            double *o = out.data()._ptr + i * out.count;
+            // offset - y is in (-p, p), x + offset - y is in (-p, 2p)
+            for (size_t j = 0; j < a.count; j++)
+            {
+                double v = x[j] + offsets[i] - y[j];
+                if (v < 0)
+                {
+                    v += moduli[i];
+                }
+                else if (v >= moduli[i])
+                {
+                    v -= moduli[i];
+                }
+                o[j] = v;
+            }
+        }
+        // the offset is below 2^bitsize(b) + M_f
+        size_t offset_bitsize = std::max(b.value_bitsize, (size_t)m_level_1_moduli->max_bitsize()) + 1;
+        out.value_bitsize = std::max(a.value_bitsize, offset_bitsize) + 1;
+        return out;
+    }
+
+    /*
+        use this method to multiply a reduced matrix by an integer, a negative alpha is
+        applied as 0 - |alpha| * matrix_a (see phase2_sub), since -|alpha| modulo the level 1
+        moduli is as large as them; matrix_a is renormalized first if the product would not
+        fit in the level 2 moduli
+    */
+    Phase2_Matrix phase2_scale(const Givaro::Integer &alpha, const Phase2_Matrix &matrix_a) const
+    {
+        if (alpha < 0)
+        {
+            return phase2_sub(phase2_zero(matrix_a), phase2_scale(-alpha, matrix_a));
+        }
+        std::vector<double> alphas;
+        size_t alpha_bitsize = phase2_slice_scalars(alpha, matrix_a.m_level_1_moduli_count, alphas);
+        Phase2_Matrix a = phase2_reduce(phase2_fit(matrix_a, alpha_bitsize));
+        Phase2_Matrix out(*this, a.dim_m, a.dim_n, a.m_level_1_moduli_count);
+        std::vector<double> moduli = phase2_slice_moduli(a.m_level_1_moduli_count);
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            const double *x = a.data()._ptr + i * a.count;
+            double *o = out.data()._ptr + i * out.count;
+            double inv_p = 1.0 / moduli[i];
+            for (size_t j = 0; j < a.count; j++)
+            {
+                o[j] = SIM_RNS::batched_reduce(alphas[i] * x[j], moduli[i], inv_p);
+            }
+        }
+        out.value_bitsize = a.value_bitsize + alpha_bitsize;
+        return out;
+    }
+
+    /*
+        use this method to compute matrix_y = alpha * matrix_x + matrix_y in place,
+        a negative alpha is applied as matrix_y - |alpha| * matrix_x (see phase2_scale),
+        note that copies of a Phase2_Matrix share their residues
+    */
+    void phase2_axpy(const Givaro::Integer &alpha, const Phase2_Matrix &matrix_x, Phase2_Matrix &matrix_y) const
+    {
+        assert(matrix_x.dim_m == matrix_y.dim_m && matrix_x.dim_n == matrix_y.dim_n);
+        assert(matrix_x.m_level_1_moduli_count == matrix_y.m_level_1_moduli_count && "matrices must be reduced with the same level 1 moduli");
+        if (alpha < 0)
+        {
+            Phase2_Matrix difference = phase2_sub(matrix_y, phase2_scale(-alpha, matrix_x));
+            std::copy(difference.data()._ptr, difference.data()._ptr + difference.m_level_1_moduli_count * m_level_2_moduli_count * difference.count,
+                      matrix_y.data()._ptr);
+            matrix_y.reduced = true;
+            matrix_y.residue_bound = difference.residue_bound;
+            matrix_y.value_bitsize = difference.value_bitsize;
+            drop_check_images(matrix_y);
+            return;
+        }
+        std::vector<double> alphas;
+        size_t alpha_bitsize = phase2_slice_scalars(alpha, matrix_x.m_level_1_moduli_count, alphas);
+        Phase2_Matrix x = phase2_reduce(phase2_fit(matrix_x, alpha_bitsize + 1));
+        if (!matrix_y.reduced || matrix_y.value_bitsize + 1 >= m_level_2_moduli->product_bitsize())
+        {
+            matrix_y = phase2_reduce(phase2_fit(matrix_y, 1));
+        }
+        std::vector<double> moduli = phase2_slice_moduli(x.m_level_1_moduli_count);
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            const double *xi = x.data()._ptr + i * x.count;
+            double *yi = matrix_y.data()._ptr + i * matrix_y.count;
+            double inv_p = 1.0 / moduli[i];
+            for (size_t j = 0; j < x.count; j++)
+            {
+                yi[j] = SIM_RNS::batched_reduce(alphas[i] * xi[j] + yi[j], moduli[i], inv_p);
+            }
+        }
+        matrix_y.value_bitsize = std::max(x.value_bitsize + alpha_bitsize, matrix_y.value_bitsize) + 1;
+        drop_check_images(matrix_y);
+    }
+
+    /*
+        use this method to compute matrix_c = alpha * matrix_a * matrix_b + beta * matrix_c
+        in place, beta is taken modulo each level 1 moduli so it may be negative, it then counts
+        with the full bitsize of the level 1 moduli; a negative alpha, or one too wide to scale
+        the product in the same pass, is applied to the product afterwards (see phase2_axpy);
+        the operands are renormalized first if the result would not fit in the level 2 moduli,
+        note that copies of a Phase2_Matrix share their residues
+    */
+    void phase2_gemm(const Givaro::Integer &alpha, const Phase2_Matrix &matrix_a, const Phase2_Matrix &matrix_b,
+                     const Givaro::Integer &beta, Phase2_Matrix &matrix_c) const
+    {
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_gemm ##########" << endl;
+#endif
+        assert(matrix_a.dim_n == matrix_b.dim_m);
+        assert(matrix_c.dim_m == matrix_a.dim_m && matrix_c.dim_n == matrix_b.dim_n);
+        assert(matrix_a.m_level_1_moduli_count == matrix_b.m_level_1_moduli_count &&
+               matrix_a.m_level_1_moduli_count == matrix_c.m_level_1_moduli_count && "matrices must be reduced with the same level 1 moduli");
+        size_t level_1_moduli_count = matrix_c.m_level_1_moduli_count;
+        std::vector<double> moduli = phase2_slice_moduli(level_1_moduli_count);
+        std::vector<double> alphas, betas;
+        size_t alpha_bitsize = phase2_slice_scalars(alpha, level_1_moduli_count, alphas);
+        size_t beta_bitsize = phase2_slice_scalars(beta, level_1_moduli_count, betas);
+        size_t dim_m = matrix_a.dim_m, dim_n = matrix_a.dim_n, dim_k = matrix_b.dim_n;
+        size_t level_2_bitsize = m_level_2_moduli->product_bitsize();
+        // -|alpha| modulo the level 1 moduli is as large as them, and even renormalized factors
+        // leave no room for a wide alpha
+        bool scale_after = alpha < 0 ||
+                           alpha_bitsize + 2 * max_level_1_moduli_bitsize(level_1_moduli_count) + Givaro::Integer(uint64_t(dim_n)).bitsize() + 1 >= level_2_bitsize;
+        size_t product_growth = (scale_after ? 0 : alpha_bitsize) + Givaro::Integer(uint64_t(dim_n)).bitsize() + 1;
+        // renormalize the larger factor first, as phase2_chain_mult does
+        Phase2_Matrix a = matrix_a, b = matrix_b;
+        if (a.value_bitsize + b.value_bitsize + product_growth >= level_2_bitsize && a.value_bitsize >= b.value_bitsize)
+        {
+            a = phase2_renormalize(a);
+        }
+        b = phase2_fit(b, a.value_bitsize + product_growth);
+        a = phase2_fit(a, b.value_bitsize + product_growth);
+        if (scale_after)
+        {
+            Phase2_Matrix result = phase2_scale(beta, matrix_c);
+            phase2_axpy(alpha, phase2_mult(a, b), result);
+            std::copy(result.data()._ptr, result.data()._ptr + level_1_moduli_count * m_level_2_moduli_count * result.count,
+                      matrix_c.data()._ptr);
+            matrix_c.reduced = true;
+            matrix_c.residue_bound = result.residue_bound;
+            matrix_c.value_bitsize = result.value_bitsize;
+            drop_check_images(matrix_c);
+#if DEBUG_MMC || TIME_MMC
+            cerr << "########## phase2_gemm ends ##########" << endl;
+#endif
+            return;
+        }
+        if (!matrix_c.reduced || beta_bitsize + matrix_c.value_bitsize + 1 >= level_2_bitsize)
+        {
+            matrix_c = phase2_reduce(phase2_fit(matrix_c, beta_bitsize + 1));
+        }
+        size_t value_bitsize = std::max(alpha_bitsize + a.value_bitsize + b.value_bitsize + Givaro::Integer(uint64_t(dim_n)).bitsize(),
+                                        beta_bitsize + matrix_c.value_bitsize) +
+                               1;
+        assert(value_bitsize < level_2_bitsize && "level 2 moduli product is too small to hold this product");
+        if (batched_fgemm_eligible(dim_m, dim_n, dim_k))
+        {
+            TwoPhaseMetrics::Scope fgemm_scope(m_metrics, TWO_PHASE_STAGE_SLICE_FGEMM, moduli.size() * dim_m * dim_k);
+            SIM_RNS::batched_fgemm(moduli.size(), moduli.data(),
+                                   dim_m, dim_n, dim_k,
+                                   alphas.data(),
+                                   a.data()._ptr, a.count, a.residue_bound,
+                                   b.data()._ptr, b.count, b.residue_bound,
+                                   betas.data(),
+                                   matrix_c.data()._ptr, matrix_c.count,
+                                   true);
+        }
+        else
+        {
+            a = phase2_reduce(a);
+            b = phase2_reduce(b);
+            TwoPhaseMetrics::Scope fgemm_scope(m_metrics, TWO_PHASE_STAGE_SLICE_FGEMM, moduli.size() * dim_m * dim_k);
+            for (size_t i = 0; i < moduli.size(); i++)
+            {
+                auto field = m_phase2_rns_field->rns()._field_rns[i % m_level_2_moduli_count];
+                FFLAS::fgemm(field, FFLAS::FflasNoTrans, FFLAS::FflasNoTrans,
+                             dim_m, dim_k, dim_n,
+                             alphas[i],
+                             a.data()._ptr + i * a.count, dim_n,
+                             b.data()._ptr + i * b.count, dim_k,
+                             betas[i],
+                             matrix_c.data()._ptr + i * matrix_c.count, dim_k);
+            }
+        }
+        matrix_c.reduced = true;
+        matrix_c.residue_bound = m_level_2_moduli->max() - 1;
+        matrix_c.value_bitsize = value_bitsize;
+        drop_check_images(matrix_c);
+#if DEBUG_MMC || TIME_MMC
+        cerr << "########## phase2_gemm ends ##########" << endl;
+#endif
+    }
+
+  public:
+    /*
+        use this method to bring the residues of a lazy product back to [0, p)
+    */
+    Phase2_Matrix phase2_reduce(const Phase2_Matrix &mat) const
+    {
+        if (mat.reduced)
+        {
+            return mat;
+        }
+        Phase2_Matrix out(*this, mat.dim_m, mat.dim_n, mat.m_level_1_moduli_count);
+        out.value_bitsize = mat.value_bitsize;
+        out.check_image = mat.check_image;
+        out.check_left = mat.check_left;
+        out.check_right = mat.check_right;
+        std::vector<double> moduli = phase2_slice_moduli(mat.m_level_1_moduli_count);
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            const double *in = mat.data()._ptr + i * mat.count;
+            double *o = out.data()._ptr + i * out.count;
+            double inv_p = 1.0 / moduli[i];
+            for (size_t j = 0; j < mat.count; j++)
+            {
+                o[j] = SIM_RNS::batched_reduce(in[j], moduli[i], inv_p);
+            }
+        }
+        return out;
+    }
+
+  protected:
+    /*
+        the integers behind the residues grow with every product, when the level 2
+        moduli cannot hold the next product they are recovered from level 2, taken
+        modulo their level 1 moduli and reduced to level 2 again, which brings them
+        back to level 1 size without a level 1 recovery
+    */
+    Phase2_Matrix phase2_renormalize(const Phase2_Matrix &mat) const
+    {
+        size_t level_1_moduli_count = mat.m_level_1_moduli_count;
+        std::vector<Phase1_Int> residues;
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_LEVEL_2_RECOVER, mat.count * level_1_moduli_count);
+            residues = matrix_recover_phase_2(mat);
+        }
+        {
+            TwoPhaseMetrics::Scope metrics_scope(m_metrics, TWO_PHASE_STAGE_PHASE_1_REDUCE, mat.count * level_1_moduli_count);
+            for (size_t i = 0; i < mat.count; i++)
+            {
+                for (size_t f = 0; f < level_1_moduli_count; f++)
+                {
+                    mpz_ptr r = residues[i * level_1_moduli_count + f].get_mpz();
+                    mpz_fdiv_r(r, r, m_level_1_moduli->val(f).get_mpz());
+                }
+            }
+        }
+        Phase2_Matrix out = matrix_reduce_phase_2(residues, mat.dim_m, mat.dim_n, level_1_moduli_count);
+        // the integer behind out is the one behind mat, so is its check prime image
+        out.check_image = mat.check_image;
+        if (!out.check_image && mat.check_left && mat.check_right)
+        {
+            out.check_image = multiply_check_images(*mat.check_left, *mat.check_right);
+        }
+        return out;
+    }
+
+    /*
+        mat, renormalized if the integers behind it cannot grow by growth_bitsize
+        within the level 2 moduli product
+    */
+    Phase2_Matrix phase2_fit(const Phase2_Matrix &mat, size_t growth_bitsize) const
+    {
+        if (mat.value_bitsize + growth_bitsize >= m_level_2_moduli->product_bitsize())
+        {
+            return phase2_renormalize(mat);
+        }
+        return mat;
+    }
+
+    // a zero matrix of the shape of mat
+    Phase2_Matrix phase2_zero(const Phase2_Matrix &mat) const
+    {
+        Phase2_Matrix out(*this, mat.dim_m, mat.dim_n, mat.m_level_1_moduli_count);
+        std::fill(out.data()._ptr, out.data()._ptr + out.m_level_1_moduli_count * m_level_2_moduli_count * out.count, 0.);
+        out.value_bitsize = 0;
+        return out;
+    }
+
+    Phase2_Matrix phase2_chain_mult(const std::vector<Phase2_Matrix> &matrices, const std::vector<size_t> &split,
+                                    size_t first, size_t last, bool lazy) const
+    {
+        if (first == last)
+        {
+            return matrices[first];
+        }
+        size_t s = split[first * matrices.size() + last];
+        Phase2_Matrix left = phase2_chain_mult(matrices, split, first, s, true);
+        Phase2_Matrix right = phase2_chain_mult(matrices, split, s + 1, last, true);
+        size_t level_2_bitsize = m_level_2_moduli->product_bitsize();
+        size_t inner_bitsize = Givaro::Integer(uint64_t(left.dim_n)).bitsize();
+        if (left.value_bitsize + right.value_bitsize + inner_bitsize >= level_2_bitsize && left.value_bitsize >= right.value_bitsize)
+        {
+            left = phase2_renormalize(left);
+        }
+        if (left.value_bitsize + right.value_bitsize + inner_bitsize >= level_2_bitsize)
+        {
+            right = phase2_renormalize(right);
+        }
+        if (left.value_bitsize + right.value_bitsize + inner_bitsize >= level_2_bitsize)
+        {
+            left = phase2_renormalize(left);
+        }
+        return phase2_mult(left, right, lazy);
+    }
+
+    /*
+        classic matrix-chain ordering on the dimension chain d0 x d1, d1 x d2, ...
+        returns split[i * n + j] = the last matrix of the left factor of Ai...Aj
+    */
+    static std::vector<size_t> matrix_chain_order(const std::vector<size_t> &dimensions)
+    {
+        size_t n = dimensions.size() - 1;
+        std::vector<double> cost(n * n, 0);
+        std::vector<size_t> split(n * n, 0);
+        for (size_t len = 2; len <= n; len++)
+        {
+            for (size_t i = 0; i + len <= n; i++)
+            {
+                size_t j = i + len - 1;
+                cost[i * n + j] = -1;
+                for (size_t k = i; k < j; k++)
+                {
+                    double c = cost[i * n + k] + cost[(k + 1) * n + j] +
+                               double(dimensions[i]) * double(dimensions[k + 1]) * double(dimensions[j + 1]);
+                    if (cost[i * n + j] < 0 || c < cost[i * n + j])
+                    {
+                        cost[i * n + j] = c;
+                        split[i * n + j] = k;
+                    }
+                }
+            }
+        }
+        return split;
+    }
+
+    // residues of alpha modulo each level 1 moduli then modulo each level 2 moduli, one per
+    // slice of a Phase2_Matrix, returns the bitsize of the largest level 1 residue
+    size_t phase2_slice_scalars(const Givaro::Integer &alpha, size_t level_1_moduli_count, std::vector<double> &out) const
+    {
+        out.resize(level_1_moduli_count * m_level_2_moduli_count);
+        size_t bitsize = 0;
+        Givaro::Integer r;
+        for (size_t f = 0; f < level_1_moduli_count; f++)
+        {
+            mpz_fdiv_r(r.get_mpz(), alpha.get_mpz(), m_level_1_moduli->val(f).get_mpz());
+            bitsize = std::max(bitsize, (size_t)r.bitsize());
+            for (size_t m = 0; m < m_level_2_moduli_count; m++)
+            {
+                out[f * m_level_2_moduli_count + m] = mpz_fdiv_ui(r.get_mpz(), (unsigned long)m_phase2_rns_field->rns()._basis[m]);
+            }
+        }
+        return bitsize;
+    }
+
+    // the check prime images of a matrix no longer describe it once it is updated in place,
+    // matrix_recover then skips its check
+    static void drop_check_images(Phase2_Matrix &mat)
+    {
+        mat.check_image.reset();
+        mat.check_left.reset();
+        mat.check_right.reset();
+    }
+
+    std::shared_ptr<const Check_Image> make_check_image(const std::vector<Givaro::Integer> &inputs, size_t offset,
+                                                        size_t dim_m, size_t dim_n) const
+    {
+        auto image = std::make_shared<Check_Image>();
+        image->dim_m = dim_m;
+        image->dim_n = dim_n;
+        image->val.resize(dim_m * dim_n);
+        for (size_t i = 0; i < image->val.size(); i++)
+        {
+            image->val[i] = mpz_fdiv_ui(inputs[offset + i].get_mpz(), SIM_RNS::FREIVALDS_CHECK_PRIME);
+        }
+        return image;
+    }
+
+    // the check prime image of a product, from the images of its factors
+    std::shared_ptr<const Check_Image> multiply_check_images(const Check_Image &image_a, const Check_Image &image_b) const
+    {
+        assert(image_a.dim_n == image_b.dim_m);
+        const uint64_t q = SIM_RNS::FREIVALDS_CHECK_PRIME;
+        auto image = std::make_shared<Check_Image>();
+        image->dim_m = image_a.dim_m;
+        image->dim_n = image_b.dim_n;
+        image->val.assign(image->dim_m * image->dim_n, 0);
+        for (size_t r = 0; r < image_a.dim_m; r++)
+        {
+            for (size_t k = 0; k < image_a.dim_n; k++)
+            {
+                uint64_t a = image_a.val[r * image_a.dim_n + k];
+                for (size_t c = 0; c < image_b.dim_n; c++)
+                {
+                    uint64_t &v = image->val[r * image->dim_n + c];
+                    v = (uint64_t)((v + (unsigned __int128)a * image_b.val[k * image_b.dim_n + c]) % q);
+                }
+            }
+        }
+        return image;
+    }
+
+    std::shared_ptr<const Check_Image> make_check_image(const LimbMatrix &inputs) const
+    {
+        auto image = std::make_shared<Check_Image>();
+        image->dim_m = inputs.dim_m;
+        image->dim_n = inputs.dim_n;
+        image->val.resize(inputs.count());
+        mpz_t v;
+        for (size_t i = 0; i < image->val.size(); i++)
+        {
+            image->val[i] = mpz_fdiv_ui(inputs.view(v, i), SIM_RNS::FREIVALDS_CHECK_PRIME);
+        }
+        return image;
+    }
+
+    // level 2 moduli of each (level 1, level 2) slice of a Phase2_Matrix
+    std::vector<double> phase2_slice_moduli(size_t level_1_moduli_count) const
+    {
+        std::vector<double> moduli(level_1_moduli_count * m_level_2_moduli_count);
+        for (size_t i = 0; i < moduli.size(); i++)
+        {
+            moduli[i] = m_phase2_rns_field->rns()._basis[i % m_level_2_moduli_count];
+        }
+        return moduli;
+    }
+
+    inline bool batched_fgemm_eligible(size_t dim_m, size_t dim_n, size_t dim_k) const
+    {
+        return dim_m <= BATCHED_FGEMM_MAX_DIM && dim_n <= BATCHED_FGEMM_MAX_DIM && dim_k <= BATCHED_FGEMM_MAX_DIM;
+    }
+
+  public:
+    Phase2_Matrix phase2_matrix_fgemm(
+        const Phase2_RNS_Int_Ptr &matrix_a,
+        const Phase2_RNS_Int_Ptr &matrix_b,
+        size_t dim_m, size_t dim_n, size_t dim_k,
+        size_t level_1_moduli_count = 0) const
+    {
+        if (!level_1_moduli_count)
+        {
+            level_1_moduli_count = m_level_1_moduli_count;
+        }
+        return Phase2_Matrix(*this, fflas_new_fgemm(matrix_a, matrix_b, dim_m, dim_n, dim_k, level_1_moduli_count), dim_m, dim_k, level_1_moduli_count);
+    }
+
+    Phase2_RNS_Int_Ptr fflas_new_fgemm(
+        const Phase2_RNS_Int_Ptr &matrix_a,
+        const Phase2_RNS_Int_Ptr &matrix_b,
+        size_t dim_m, size_t dim_n, size_t dim_k,
+        size_t level_1_moduli_count) const
+    {
+
+        assert(dim_m && dim_n && dim_k);
+        // create matrix_c to return
+        Phase2_RNS_Int_Ptr matrix_c = FFLAS::fflas_new(*m_phase2_rns_field, level_1_moduli_count * dim_m * dim_k);
+        matrix_c._stride = dim_m * dim_k;
+
+        // assert(m_phase2_rns_field->size() == m_level_2_moduli_count * m_level_1_moduli_count);
         assert(matrix_a._stride == dim_m * dim_n);
         assert(matrix_b._stride == dim_n * dim_k);
         assert(matrix_c._stride == dim_m * dim_k);
@@ -561,7 +1834,8 @@ class TwoPhaseAbstract
             m_phase2_rns_field->zero, // constant matrix to add
             matrix_c,
             dim_k, // row length of matrix_c
-            tag);
+            tag,
+            level_1_moduli_count);
 #if DEBUG_MMC || TIME_MMC
         cerr << ".......... fgemm ends .........." << endl;
 #endif
@@ -580,27 +1854,59 @@ class TwoPhaseAbstract
           typename FFPACK::RNSInteger<RNS>::ConstElement_ptr Bd, const size_t ldb,
           const typename FFPACK::RNSInteger<RNS>::Element beta,
           typename FFPACK::RNSInteger<RNS>::Element_ptr Cd, const size_t ldc,
-          FFLAS::MMHelper<FFPACK::RNSInteger<RNS>, FFLAS::MMHelperAlgo::Classic, FFLAS::ModeCategories::DefaultTag, FFLAS::ParSeqHelper::Sequential> &H) const
+          FFLAS::MMHelper<FFPACK::RNSInteger<RNS>, FFLAS::MMHelperAlgo::Classic, FFLAS::ModeCategories::DefaultTag, FFLAS::ParSeqHelper::Sequential> &H,
+          const size_t level_1_moduli_count) const
     {
-        // compute each fgemm componentwise
+        // matrix_a is dim_m x dim_n, matrix_b is dim_n x dim_k, one slice per (level 1, level 2) moduli pair
 #ifdef PROFILE_FGEMM_MP
         Givaro::Timer t;
         t.start();
 #endif
-        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+#if CHECK_MMC
+        assert(dim_m * dim_n == Ad._stride);
+        assert(dim_n * dim_k == Bd._stride);
+        assert(dim_m * dim_k == Cd._stride);
+#endif
+        size_t num_slices = level_1_moduli_count * F.size();
+        if (ta == FFLAS::FflasNoTrans && tb == FFLAS::FflasNoTrans &&
+            lda == dim_n && ldb == dim_k && ldc == dim_k &&
+            batched_fgemm_eligible(dim_m, dim_n, dim_k))
+        {
+            // small matrices: pack all slices once and run them through the interleaved kernel
+            // instead of paying for one FFLAS::fgemm call (and its packing) per slice
+            std::vector<double> moduli(num_slices), alphas(num_slices), betas(num_slices);
+            for (size_t i = 0; i < num_slices; i++)
+            {
+                size_t m = i % F.size();
+                moduli[i] = F.rns()._basis[m];
+                alphas[i] = alpha._ptr[m * alpha._stride];
+                betas[i] = beta._ptr[m * beta._stride];
+            }
+            TwoPhaseMetrics::Scope fgemm_scope(m_metrics, TWO_PHASE_STAGE_SLICE_FGEMM, num_slices * dim_m * dim_k);
+            SIM_RNS::batched_fgemm(num_slices, moduli.data(),
+                                   dim_m, dim_n, dim_k,
+                                   alphas.data(),
+                                   Ad._ptr, Ad._stride,
+                                   Bd._ptr, Bd._stride,
+                                   betas.data(),
+                                   Cd._ptr, Cd._stride);
+        }
+        else
         {
-            for (size_t m = 0; m < F.size(); m++)
+            // compute each fgemm componentwise, the slices are independent and spread over the
+            // OpenMP threads unless the BLAS under FFLAS::fgemm already runs its own threads;
+            // one scope covers them all, as the process CPU time of overlapping scopes would add up
+            TwoPhaseMetrics::Scope fgemm_scope(m_metrics, TWO_PHASE_STAGE_SLICE_FGEMM, num_slices * dim_m * dim_k);
+#pragma omp parallel for schedule(dynamic) if (!blas_crt_blas_threaded())
+            for (long slice = 0; slice < long(num_slices); slice++)
             {
-                size_t i = f * F.size() + m;
+                size_t i = slice;
+                size_t m = i % F.size();
                 auto field = F.rns()._field_rns[m];
                 FFLAS::MMHelper<typename RNS::ModField, FFLAS::MMHelperAlgo::Winograd> H2(field, H.recLevel, H.parseq);
-#if CHECK_MMC
-                assert(dim_m * dim_n == Ad._stride);
-                assert(dim_n * dim_k == Bd._stride);
-                assert(dim_m * dim_k == Cd._stride);
-#endif
+                // FFLAS takes (rows of C, columns of C, inner dimension)
                 FFLAS::fgemm(field, ta, tb,
-                             dim_m, dim_n, dim_k,
+                             dim_m, dim_k, dim_n,
                              alpha._ptr[m * alpha._stride],
                              Ad._ptr + i * Ad._stride, lda,
                              Bd._ptr + i * Bd._stride, ldb,
@@ -613,7 +1919,7 @@ class TwoPhaseAbstract
 
         std::cerr << "==========================================" << std::endl
                   << "Pointwise fgemm : " << t.realtime()
-                  << " (" << m_level_1_moduli_count * m_level_2_moduli_count << ") moduli " << std::endl
+                  << " (" << level_1_moduli_count * m_level_2_moduli_count << ") moduli " << std::endl
                   << "==========================================" << std::endl;
 #endif
         return Cd;
@@ -0,0 +1,121 @@
+#if !defined(H_TWO_PHASE_COST_MODEL)
+#define H_TWO_PHASE_COST_MODEL
+
+#include "plan_cache.h"
+#include <gmp++/gmp++.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the parameters of one two phase product that its cost depends on
+struct TwoPhaseShape
+{
+    size_t dim_m, dim_n, dim_k;            // A is dim_m x dim_n, B is dim_n x dim_k
+    uint_fast64_t input_bitsize;           // max bitsize of the entries of A and B
+    size_t level_1_moduli_count;           // level 1 moduli used for this product
+    uint_fast64_t level_1_moduli_bitsize;  // bitsize of the largest of them
+    size_t level_2_moduli_count;           // primes of the phase 2 rns basis
+};
+
+/*
+    A linear cost model of the three phases of a two phase product, with one coefficient
+    (seconds per unit of work) per phase:
+     - reduce: every input entry is reduced by each level 1 modulus (linear in its bitsize),
+       then each residue is split over the level 2 basis
+     - phase 2: one dgemm of dim_m x dim_n x dim_k per pair of level 1 and level 2 moduli
+     - recover: every output entry is recovered over the level 2 basis for each level 1
+       modulus, then Garner's recovery over the level 1 moduli is quadratic in their count
+    The coefficients are fitted once per machine (see TwoPhaseTuner::cost_model) and can be
+    persisted in a PlanCache, a prediction is then a handful of multiplications.
+*/
+class TwoPhaseCostModel
+{
+  public:
+    double m_reduce = 0;
+    double m_gemm = 0;
+    double m_recover = 0;
+
+    static double reduce_work(const TwoPhaseShape &s)
+    {
+        double entries = double(s.dim_m) * s.dim_n + double(s.dim_n) * s.dim_k;
+        return entries * s.level_1_moduli_count * (double(s.input_bitsize) + double(s.level_2_moduli_count) * s.level_1_moduli_bitsize);
+    }
+
+    static double gemm_work(const TwoPhaseShape &s)
+    {
+        return double(s.level_1_moduli_count) * s.level_2_moduli_count * s.dim_m * s.dim_n * s.dim_k;
+    }
+
+    static double recover_work(const TwoPhaseShape &s)
+    {
+        double entries = double(s.dim_m) * s.dim_k;
+        return entries * s.level_1_moduli_count * double(s.level_2_moduli_count + s.level_1_moduli_count) * s.level_1_moduli_bitsize;
+    }
+
+    // the level 2 basis of a level 1 modulus of the given bitsize, as generated by TwoPhaseAbstract
+    static size_t level_2_moduli_count_for(uint_fast64_t level_1_moduli_bitsize)
+    {
+        // primes of 21 bits, at least 20 bits each towards a product of 2 * bitsize + 10 bits
+        return (2 * level_1_moduli_bitsize + 10 + 19) / 20;
+    }
+
+    inline bool calibrated() const { return m_reduce > 0 && m_gemm > 0 && m_recover > 0; }
+
+    inline double predict_reduce(const TwoPhaseShape &s) const { return m_reduce * reduce_work(s); }
+    inline double predict_gemm(const TwoPhaseShape &s) const { return m_gemm * gemm_work(s); }
+    inline double predict_recover(const TwoPhaseShape &s) const { return m_recover * recover_work(s); }
+    inline double predict(const TwoPhaseShape &s) const { return predict_reduce(s) + predict_gemm(s) + predict_recover(s); }
+
+    /*
+        use this method to fit the coefficients to measured phase times,
+        each is the least squares fit through the origin over all samples
+    */
+    void fit(const std::vector<TwoPhaseShape> &shapes,
+             const std::vector<double> &reduce_seconds,
+             const std::vector<double> &gemm_seconds,
+             const std::vector<double> &recover_seconds)
+    {
+        assert(shapes.size() == reduce_seconds.size() && shapes.size() == gemm_seconds.size() && shapes.size() == recover_seconds.size());
+        double rw = 0, rt = 0, gw = 0, gt = 0, cw = 0, ct = 0;
+        for (size_t i = 0; i < shapes.size(); i++)
+        {
+            double r = reduce_work(shapes[i]), g = gemm_work(shapes[i]), c = recover_work(shapes[i]);
+            rw += r * r;
+            rt += r * reduce_seconds[i];
+            gw += g * g;
+            gt += g * gemm_seconds[i];
+            cw += c * c;
+            ct += c * recover_seconds[i];
+        }
+        m_reduce = rw > 0 ? rt / rw : 0;
+        m_gemm = gw > 0 ? gt / gw : 0;
+        m_recover = cw > 0 ? ct / cw : 0;
+    }
+
+    // the coefficients are persisted as a single section of attoseconds per unit of work
+    bool load(const PlanCache &plan_cache, const std::string &key)
+    {
+        PlanCache::Entry entry;
+        if (!plan_cache.lookup(key, entry) || entry.size() != 1 || entry[0].size() != 3)
+        {
+            return false;
+        }
+        m_reduce = double(uint64_t(entry[0][0])) * 1e-18;
+        m_gemm = double(uint64_t(entry[0][1])) * 1e-18;
+        m_recover = double(uint64_t(entry[0][2])) * 1e-18;
+        return calibrated();
+    }
+
+    void store(PlanCache &plan_cache, const std::string &key) const
+    {
+        PlanCache::Entry entry(1);
+        entry[0].push_back(Givaro::Integer(uint64_t(m_reduce * 1e18)));
+        entry[0].push_back(Givaro::Integer(uint64_t(m_gemm * 1e18)));
+        entry[0].push_back(Givaro::Integer(uint64_t(m_recover * 1e18)));
+        plan_cache.store(key, entry);
+    }
+};
+
+#endif // H_TWO_PHASE_COST_MODEL
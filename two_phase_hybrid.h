@@ -0,0 +1,130 @@
+#if !defined(H_TWO_PHASE_HYBRID)
+#define H_TWO_PHASE_HYBRID
+
+#include "containers.h"
+#include "gen_hybrid.h"
+#include "sim_rns.h"
+#include <iostream>
+#include <gmp++/gmp++.h>
+#include "two_phase_abstract.h"
+
+#include "cnma/marge_num.h"
+#include "cnma/parge_num.h"
+#include "cnma/fixed_limbs.h"
+#include "cnma/reconstruct_hybrid.h"
+
+// Phase 1:
+// the level 1 moduli mix 2^p - 1 and 2^e + 1 numbers (see GenHybrid), each one is
+// reduced and recovered with dc_reduce_minus or dc_reduce_plus according to its sign.
+// Phase 2:
+// as in the other schemes.
+class TwoPhaseHybrid : public TwoPhaseAbstract
+{
+  protected:
+    // the level 1 modulus f is 2^m_level_1_expos[f] + m_level_1_signs[f]
+    std::vector<uint64_t> m_level_1_expos;
+    std::vector<int> m_level_1_signs;
+
+  public:
+    TwoPhaseHybrid(uint_fast64_t level_1_product_bitsize,
+                   uint_fast64_t level_1_moduli_bitsize,
+                   PlanCache *plan_cache = NULL)
+        : TwoPhaseAbstract(plan_level_1_moduli(plan_cache, plan_key("hybrid", level_1_product_bitsize, level_1_moduli_bitsize),
+                                               [&]() { return new GenHybrid(level_1_product_bitsize, level_1_moduli_bitsize); }),
+                           NULL, plan_cache, plan_key("hybrid", level_1_product_bitsize, level_1_moduli_bitsize))
+    {
+        assert(level_1_product_bitsize > level_1_moduli_bitsize * 2 && "Level 1 moduli size cannot be too large for the two-phase algorithm to be beneficial.");
+        // the moduli may come from a PlanCache, so the signs are read back from their values
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            const Givaro::Integer &m = m_level_1_moduli->val(f);
+            Givaro::Integer m_minus_1 = m - 1;
+            if (mpz_popcount(m_minus_1.get_mpz()) == 1)
+            {
+                m_level_1_expos.push_back(m_minus_1.bitsize() - 1);
+                m_level_1_signs.push_back(+1);
+            }
+            else
+            {
+                m_level_1_expos.push_back((m + 1).bitsize() - 1);
+                m_level_1_signs.push_back(-1);
+            }
+        }
+    }
+
+    TwoPhaseHybrid(const TwoPhaseHybrid &) = delete;
+    TwoPhaseHybrid &operator=(const TwoPhaseHybrid &) = delete;
+
+    ///////////////////////////////////////////////////////////////////////////////////////////
+
+    /*
+        this helper method is used by matrix_product(...)
+    */
+  protected:
+    virtual void reduce_phase_1_entry(mpz_srcptr input, Phase1_Int *out, size_t level_1_moduli_count) const override
+    {
+        // inputs of moderate size are reduced on fixed size limb arrays, the others by the mpz kernels
+        if (CNMA::fixed_reduce_dispatch(out, input, level_1_moduli_count, m_level_1_expos.data(), m_level_1_signs.data()))
+        {
+            return;
+        }
+        for (size_t f = 0; f < level_1_moduli_count; f++)
+        {
+            mpz_set(out[f].get_mpz(), input);
+            CNMA::dc_reduce_hybrid(out[f].get_mpz(), m_level_1_expos[f], m_level_1_signs[f]);
+        }
+    }
+
+  protected:
+    /*
+        use this method to recover from a single reduced matrix to phase 1 representations
+    */
+    virtual void matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered, size_t level_1_moduli_count, Phase1_Output &out) const override
+    {
+        // phase 1 recovery begins
+        size_t out_len = out.size();
+        assert(phase2_recovered.size() == out_len * level_1_moduli_count);
+
+        // initialization, every temporary is allocated once to the size it reaches:
+        // the residues to that of a level 2 product, the work array, the Garner temporaries
+        // and the outputs to that of the level 1 product
+        const mp_bitcnt_t moduli_bitsize = max_level_1_moduli_bitsize(level_1_moduli_count);
+        const mp_bitcnt_t product_bitsize = m_level_1_prefix_products[level_1_moduli_count].bitsize() + 2 * moduli_bitsize;
+        GmpScratch moduli(level_1_moduli_count, moduli_bitsize);
+        GmpScratch residues(level_1_moduli_count, 2 * moduli_bitsize + GMP_NUMB_BITS);
+        GmpScratch work(level_1_moduli_count, product_bitsize);
+        GmpScratch garner_scratch(2, product_bitsize);
+        mpz_t *input_f = moduli.get();
+        mpz_t *input_r = residues.get();
+        mpz_t *input_work = work.get();
+        for (size_t i = 0; i < level_1_moduli_count; i++)
+        {
+            mpz_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
+        }
+        // recover
+        for (size_t i = 0; i < out_len; i++)
+        {
+            for (size_t f = 0; f < level_1_moduli_count; f++)
+            {
+                const Phase1_Int &in = phase2_recovered[i * level_1_moduli_count + f];
+                mpz_set(input_r[f], in.get_mpz());
+                CNMA::dc_reduce_hybrid(input_r[f], m_level_1_expos[f], m_level_1_signs[f], garner_scratch[0]);
+            }
+            mpz_ptr t = out.entry(i, product_bitsize);
+            CNMA::garner_hybrid(t, level_1_moduli_count, input_r, m_level_1_expos.data(), m_level_1_signs.data(), input_f, m_level_1_Mi, input_work, garner_scratch.get());
+            mpz_mod(t, t, m_level_1_prefix_products[level_1_moduli_count].get_mpz());
+            out.commit(i);
+#if TIME_MMC
+            if (i % 100 == 0)
+            {
+                cerr << ".";
+            }
+#endif
+        }
+#if TIME_MMC
+        cerr << endl;
+#endif
+    }
+};
+
+#endif // H_TWO_PHASE_HYBRID
@@ -11,6 +11,7 @@
 
 #include "cnma/marge_num.h"
 #include "cnma/reconstruct_marge.h"
+#include "cnma/fixed_limbs.h"
 
 // Phase 1:
 // m_level_1_moduli_count is the number of co-primes moduli, each of bit length 2^B_F.
@@ -21,10 +22,24 @@
 // The following relation must be true: N_M * B_M > 2^B_F
 class TwoPhaseMargeAbstract : public TwoPhaseAbstract
 {
+  protected:
+    // the level 1 modulus f is 2^m_level_1_expos[f] - 1, m_level_1_signs feeds the CNMA::fixed_reduce kernels
+    std::vector<uint64_t> m_level_1_expos;
+    std::vector<int> m_level_1_signs;
+
   public:
     TwoPhaseMargeAbstract(const GenCoprimeAbstract<Givaro::Integer> *m_level_1_moduli,
-                          const GenCoprimeAbstract<double> *m_level_2_moduli)
-        : TwoPhaseAbstract(m_level_1_moduli, m_level_2_moduli) {}
+                          const GenCoprimeAbstract<double> *m_level_2_moduli,
+                          PlanCache *plan_cache = NULL,
+                          const std::string &plan_key = "")
+        : TwoPhaseAbstract(m_level_1_moduli, m_level_2_moduli, plan_cache, plan_key)
+    {
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            m_level_1_expos.push_back((m_level_1_moduli->val(f) + 1).bitsize() - 1);
+            m_level_1_signs.push_back(-1);
+        }
+    }
     TwoPhaseMargeAbstract(const TwoPhaseMargeAbstract &) = delete;
     TwoPhaseMargeAbstract &operator=(const TwoPhaseMargeAbstract &) = delete;
 
@@ -34,73 +49,63 @@ class TwoPhaseMargeAbstract : public TwoPhaseAbstract
         this helper method is used by matrix_product(...)
     */
   protected:
-    virtual const vector<Phase1_Int> matrix_reduce_phase_1(const vector<Givaro::Integer> &inputs) const override
+    virtual void reduce_phase_1_entry(mpz_srcptr input, Phase1_Int *out, size_t level_1_moduli_count) const override
     {
-        size_t len_inputs = inputs.size();
-        // phase 1 begins
-        // p1_reduced stores multi-moduli representation of each input
-        vector<Phase1_Int> p1_reduced(len_inputs * m_level_1_moduli_count);
-        for (size_t i = 0; i < len_inputs; i++)
+        // inputs of moderate size are reduced on fixed size limb arrays, the others by the mpz kernels
+        if (CNMA::fixed_reduce_dispatch(out, input, level_1_moduli_count, m_level_1_expos.data(), m_level_1_signs.data()))
         {
-            for (size_t f = 0; f < m_level_1_moduli_count; f++)
-            {
-                Phase1_Int &t = p1_reduced[i * m_level_1_moduli_count + f];
-                t = inputs[i];
-                CNMA::dc_reduce_minus(t.get_mpz(), (m_level_1_moduli->val(f) + 1).bitsize() - 1);
-            }
-#if TIME_MMC
-            // print a dot for every 100 entries
-            if (i % 100 == 0)
-            {
-                cerr << ".";
-            }
-#endif
+            return;
+        }
+        for (size_t f = 0; f < level_1_moduli_count; f++)
+        {
+            mpz_set(out[f].get_mpz(), input);
+            CNMA::dc_reduce_minus(out[f].get_mpz(), m_level_1_expos[f]);
         }
-#if TIME_MMC
-        cerr << endl;
-#endif
-        return p1_reduced;
     }
 
   protected:
     /* 
         use this method to recover from a single reduced matrix to phase 1 representations
     */
-    virtual const vector<Givaro::Integer> matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered) const override
+    virtual void matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered, size_t level_1_moduli_count, Phase1_Output &out) const override
     {
         // phase 1 recovery begins
-        size_t out_len = phase2_recovered.size() / m_level_1_moduli_count;
-        vector<Givaro::Integer> phase1_recovered(out_len);
+        size_t out_len = out.size();
+        assert(phase2_recovered.size() == out_len * level_1_moduli_count);
 
-        // initialization
-        mpz_t input_Mi[m_level_1_moduli_count]; // tmp
-        mpz_t input_f[m_level_1_moduli_count];
-        mpz_t input_r[m_level_1_moduli_count];
-        mpz_t input_work[m_level_1_moduli_count];
-        uint64_t input_f_expo[m_level_1_moduli_count];
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
+        // initialization, every temporary is allocated once to the size it reaches:
+        // the residues to that of a level 2 product, the work array, the Garner temporaries
+        // and the outputs to that of the level 1 product
+        const mp_bitcnt_t moduli_bitsize = max_level_1_moduli_bitsize(level_1_moduli_count);
+        const mp_bitcnt_t product_bitsize = m_level_1_prefix_products[level_1_moduli_count].bitsize() + 2 * moduli_bitsize;
+        GmpScratch moduli(level_1_moduli_count, moduli_bitsize);
+        GmpScratch residues(level_1_moduli_count, 2 * moduli_bitsize + GMP_NUMB_BITS);
+        GmpScratch work(level_1_moduli_count, product_bitsize);
+        GmpScratch garner_scratch(2, product_bitsize);
+        mpz_t *input_f = moduli.get();
+        mpz_t *input_r = residues.get();
+        mpz_t *input_work = work.get();
+        uint64_t input_f_expo[level_1_moduli_count];
+        for (size_t i = 0; i < level_1_moduli_count; i++)
         {
-            mpz_init(input_Mi[i]);
-            mpz_init(input_r[i]);
-            mpz_init(input_work[i]);
-            mpz_init_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
+            mpz_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
             input_f_expo[i] = (m_level_1_moduli->val(i) + 1).bitsize() - 1;
         }
-        CNMA::precompute_Mi_marge(input_Mi, input_f, m_level_1_moduli_count);
         // recover
         for (size_t i = 0; i < out_len; i++)
         {
-            for (size_t f = 0; f < m_level_1_moduli_count; f++)
+            for (size_t f = 0; f < level_1_moduli_count; f++)
             {
-                const Phase1_Int &in = phase2_recovered[i * m_level_1_moduli_count + f];
+                const Phase1_Int &in = phase2_recovered[i * level_1_moduli_count + f];
                 mpz_mod(input_r[f], in.get_mpz(), m_level_1_moduli->val(f).get_mpz());
                 // mpz_set(input_r[f], in.get_mpz());
                 // CNMA::dc_reduce_minus(input_r[f], (m_level_1_moduli->val(f) + 1).bitsize() - 1);
             }
-            Givaro::Integer &t = phase1_recovered[i];
-            CNMA::garner_marge(t.get_mpz(), m_level_1_moduli_count, input_r, input_f_expo, input_f, input_Mi, input_work);
-            // CNMA::garner_simple_marge(t.get_mpz(), m_level_1_moduli_count, input_r, input_f, input_Mi);
-            mpz_mod(t.get_mpz(), t.get_mpz(), m_level_1_moduli->product().get_mpz());
+            mpz_ptr t = out.entry(i, product_bitsize);
+            CNMA::garner_marge(t, level_1_moduli_count, input_r, input_f_expo, input_f, m_level_1_Mi, input_work, garner_scratch.get());
+            // CNMA::garner_simple_marge(t, level_1_moduli_count, input_r, input_f, m_level_1_Mi);
+            mpz_mod(t, t, m_level_1_prefix_products[level_1_moduli_count].get_mpz());
+            out.commit(i);
 #if TIME_MMC
             if (i % 100 == 0)
             {
@@ -108,17 +113,9 @@ class TwoPhaseMargeAbstract : public TwoPhaseAbstract
             }
 #endif
         }
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
-        {
-            mpz_clear(input_Mi[i]);
-            mpz_clear(input_r[i]);
-            mpz_clear(input_f[i]);
-            mpz_clear(input_work[i]);
-        }
 #if TIME_MMC
         cerr << endl;
 #endif
-        return phase1_recovered;
     }
 };
 
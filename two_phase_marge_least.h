@@ -25,8 +25,11 @@ class TwoPhaseMargeLeast : public TwoPhaseMargeAbstract
 {
   public:
     TwoPhaseMargeLeast(uint_fast64_t level_1_product_bitsize,
-                       uint_fast64_t level_1_moduli_bitsize)
-        : TwoPhaseMargeAbstract(new GenMargeLeast(level_1_product_bitsize, level_1_moduli_bitsize), NULL)
+                       uint_fast64_t level_1_moduli_bitsize,
+                       PlanCache *plan_cache = NULL)
+        : TwoPhaseMargeAbstract(plan_level_1_moduli(plan_cache, plan_key("marge_least", level_1_product_bitsize, level_1_moduli_bitsize),
+                                                    [&]() { return new GenMargeLeast(level_1_product_bitsize, level_1_moduli_bitsize); }),
+                                NULL, plan_cache, plan_key("marge_least", level_1_product_bitsize, level_1_moduli_bitsize))
     {
       assert(level_1_product_bitsize > level_1_moduli_bitsize * 2 && "Level 1 moduli size cannot be too large for the two-phase algorithm to be beneficial.");
     }
@@ -0,0 +1,294 @@
+#if !defined(H_TWO_PHASE_METRICS)
+#define H_TWO_PHASE_METRICS
+
+#include "perf_counters.h"
+#include <gmp++/gmp++.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <time.h>
+
+// the stages of a two phase product, as recorded by TwoPhaseMetrics
+enum TwoPhaseStage
+{
+    TWO_PHASE_STAGE_PHASE_1_REDUCE = 0, // level 1 residues of the inputs
+    TWO_PHASE_STAGE_LEVEL_2_REDUCE,     // level 2 residues of the level 1 residues
+    TWO_PHASE_STAGE_PHASE_2_MULT,       // the fgemm over every (level 1, level 2) slice
+    TWO_PHASE_STAGE_LEVEL_2_RECOVER,    // level 1 residues from the level 2 ones
+    TWO_PHASE_STAGE_PHASE_1_RECOVER,    // outputs from the level 1 residues (Garner)
+    // finer stages, their time is also counted in the ones above
+    TWO_PHASE_STAGE_REDUCE_LAYOUT,  // shuffle of the level 2 residues into a Phase2_Matrix (part of matrix_reduce)
+    TWO_PHASE_STAGE_RECOVER_LAYOUT, // shuffle of a Phase2_Matrix back into FFLAS' layout (part of level 2 recover)
+    TWO_PHASE_STAGE_SLICE_FGEMM,    // the FFLAS::fgemm over every slice, or one batched fgemm over all (part of phase 2 mult)
+    TWO_PHASE_STAGE_COUNT
+};
+
+/*
+    A collector of per stage metrics of a TwoPhaseAbstract, attached at runtime with
+    TwoPhaseAbstract::attach_metrics and free of any output until it is queried or exported.
+    Each stage keeps the totals over all calls and the figures of its last call:
+     - wall and process CPU time (the latter includes the OpenMP threads)
+     - residues produced (or, for the recovery, integers recovered)
+     - GMP allocations and bytes, once install_gmp_hooks has wrapped GMP's memory functions;
+       those counters are process wide, so other threads allocating at the same time are counted
+     - cycles, instructions, LLC and branch misses of the calling thread, once enable_perf_counters
+       succeeded (see PerfCounters); threads spawned by FFLAS or OpenMP inside a stage are not counted
+    A collector may be shared by several algorithms and threads.
+*/
+class TwoPhaseMetrics
+{
+  public:
+    struct Stage
+    {
+        size_t calls = 0;
+        double wall_seconds = 0;
+        double cpu_seconds = 0;
+        uint64_t residues = 0;
+        uint64_t gmp_allocations = 0;
+        uint64_t gmp_bytes = 0;
+        PerfCounts perf;
+    };
+
+  protected:
+    Stage m_total[TWO_PHASE_STAGE_COUNT];
+    Stage m_last[TWO_PHASE_STAGE_COUNT];
+    mutable std::mutex m_lock;
+    std::atomic<bool> m_perf_enabled;
+
+  public:
+    TwoPhaseMetrics() : m_perf_enabled(false) {}
+
+    static const char *stage_name(TwoPhaseStage stage)
+    {
+        static const char *names[] = {"phase_1_reduce", "level_2_reduce", "phase_2_mult", "level_2_recover", "phase_1_recover",
+                                      "reduce_layout", "recover_layout", "slice_fgemm"};
+        return names[stage];
+    }
+
+    /*
+        use this method to also read the hardware counters around every stage,
+        returns false (and leaves them off) where this machine does not provide them
+    */
+    bool enable_perf_counters(bool enable = true)
+    {
+        m_perf_enabled = enable && PerfCounters::for_this_thread().available();
+        return m_perf_enabled;
+    }
+
+    inline bool perf_counters_enabled() const { return m_perf_enabled; }
+
+    void record(TwoPhaseStage stage, const Stage &call)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        Stage &total = m_total[stage];
+        total.calls += call.calls;
+        total.wall_seconds += call.wall_seconds;
+        total.cpu_seconds += call.cpu_seconds;
+        total.residues += call.residues;
+        total.gmp_allocations += call.gmp_allocations;
+        total.gmp_bytes += call.gmp_bytes;
+        total.perf += call.perf;
+        m_last[stage] = call;
+    }
+
+    Stage total(TwoPhaseStage stage) const
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_total[stage];
+    }
+
+    Stage last(TwoPhaseStage stage) const
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_last[stage];
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (size_t s = 0; s < TWO_PHASE_STAGE_COUNT; s++)
+        {
+            m_total[s] = Stage();
+            m_last[s] = Stage();
+        }
+    }
+
+    /*
+        use this method to export the totals as a JSON object keyed by stage
+    */
+    void write_json(std::ostream &out) const
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        out << "{";
+        for (size_t s = 0; s < TWO_PHASE_STAGE_COUNT; s++)
+        {
+            const Stage &t = m_total[s];
+            out << (s ? ", " : "") << "\"" << stage_name(TwoPhaseStage(s)) << "\": {"
+                << "\"calls\": " << t.calls << ", \"wall_seconds\": " << t.wall_seconds << ", \"cpu_seconds\": " << t.cpu_seconds
+                << ", \"residues\": " << t.residues << ", \"gmp_allocations\": " << t.gmp_allocations << ", \"gmp_bytes\": " << t.gmp_bytes
+                << ", \"cycles\": " << t.perf.val[PERF_EVENT_CYCLES] << ", \"instructions\": " << t.perf.val[PERF_EVENT_INSTRUCTIONS]
+                << ", \"llc_misses\": " << t.perf.val[PERF_EVENT_LLC_MISSES] << ", \"branch_misses\": " << t.perf.val[PERF_EVENT_BRANCH_MISSES]
+                << ", \"ipc\": " << t.perf.ipc() << "}";
+        }
+        out << "}" << std::endl;
+    }
+
+    // the same as CSV with a header line, one row per stage
+    void write_csv(std::ostream &out) const
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        out << "stage,calls,wall_seconds,cpu_seconds,residues,gmp_allocations,gmp_bytes,cycles,instructions,llc_misses,branch_misses,ipc" << std::endl;
+        for (size_t s = 0; s < TWO_PHASE_STAGE_COUNT; s++)
+        {
+            const Stage &t = m_total[s];
+            out << stage_name(TwoPhaseStage(s)) << "," << t.calls << "," << t.wall_seconds << "," << t.cpu_seconds << ","
+                << t.residues << "," << t.gmp_allocations << "," << t.gmp_bytes << "," << t.perf.val[PERF_EVENT_CYCLES] << ","
+                << t.perf.val[PERF_EVENT_INSTRUCTIONS] << "," << t.perf.val[PERF_EVENT_LLC_MISSES] << ","
+                << t.perf.val[PERF_EVENT_BRANCH_MISSES] << "," << t.perf.ipc() << std::endl;
+        }
+    }
+
+    ///////////////////////////////////////////////////////////////////////////////////////////
+
+    /*
+        use this method to count GMP's allocations from now on, it wraps the current memory
+        functions so it can be called at any time, later calls do nothing
+    */
+    static void install_gmp_hooks()
+    {
+        static std::once_flag once;
+        std::call_once(once, []() {
+            mp_get_memory_functions(&previous_alloc(), &previous_realloc(), &previous_free());
+            mp_set_memory_functions(counting_alloc, counting_realloc, previous_free());
+            hooks_installed() = true;
+        });
+    }
+
+    static bool gmp_hooks_enabled() { return hooks_installed(); }
+    static uint64_t gmp_allocations() { return allocation_counter().load(std::memory_order_relaxed); }
+    static uint64_t gmp_bytes() { return byte_counter().load(std::memory_order_relaxed); }
+
+    /*
+        Records one call of a stage into metrics from its construction to its destruction
+        (or to stop), does nothing when metrics is NULL
+    */
+    class Scope
+    {
+        TwoPhaseMetrics *m_metrics;
+        TwoPhaseStage m_stage;
+        uint64_t m_residues;
+        std::chrono::steady_clock::time_point m_wall;
+        double m_cpu;
+        uint64_t m_allocations;
+        uint64_t m_bytes;
+        PerfCounts m_perf;
+
+      public:
+        Scope(TwoPhaseMetrics *metrics, TwoPhaseStage stage, uint64_t residues = 0)
+            : m_metrics(metrics), m_stage(stage), m_residues(residues), m_cpu(0), m_allocations(0), m_bytes(0)
+        {
+            if (m_metrics)
+            {
+                m_wall = std::chrono::steady_clock::now();
+                m_cpu = cpu_seconds();
+                m_allocations = gmp_allocations();
+                m_bytes = gmp_bytes();
+                if (m_metrics->perf_counters_enabled())
+                {
+                    m_perf = PerfCounters::for_this_thread().read();
+                }
+            }
+        }
+
+        ~Scope() { stop(); }
+
+        // use this method to end the call before the scope does
+        void stop()
+        {
+            if (m_metrics)
+            {
+                Stage call;
+                call.calls = 1;
+                call.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_wall).count();
+                call.cpu_seconds = cpu_seconds() - m_cpu;
+                call.residues = m_residues;
+                call.gmp_allocations = gmp_allocations() - m_allocations;
+                call.gmp_bytes = gmp_bytes() - m_bytes;
+                if (m_metrics->perf_counters_enabled())
+                {
+                    call.perf = PerfCounters::for_this_thread().read() - m_perf;
+                }
+                m_metrics->record(m_stage, call);
+                m_metrics = NULL;
+            }
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+  protected:
+    static double cpu_seconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    typedef void *(*Alloc)(size_t);
+    typedef void *(*Realloc)(void *, size_t, size_t);
+    typedef void (*Free)(void *, size_t);
+
+    static Alloc &previous_alloc()
+    {
+        static Alloc f = NULL;
+        return f;
+    }
+    static Realloc &previous_realloc()
+    {
+        static Realloc f = NULL;
+        return f;
+    }
+    static Free &previous_free()
+    {
+        static Free f = NULL;
+        return f;
+    }
+    static bool &hooks_installed()
+    {
+        static bool installed = false;
+        return installed;
+    }
+    static std::atomic<uint64_t> &allocation_counter()
+    {
+        static std::atomic<uint64_t> counter(0);
+        return counter;
+    }
+    static std::atomic<uint64_t> &byte_counter()
+    {
+        static std::atomic<uint64_t> counter(0);
+        return counter;
+    }
+
+    static void *counting_alloc(size_t size)
+    {
+        allocation_counter().fetch_add(1, std::memory_order_relaxed);
+        byte_counter().fetch_add(size, std::memory_order_relaxed);
+        return previous_alloc()(size);
+    }
+
+    static void *counting_realloc(void *p, size_t old_size, size_t new_size)
+    {
+        allocation_counter().fetch_add(1, std::memory_order_relaxed);
+        if (new_size > old_size)
+        {
+            byte_counter().fetch_add(new_size - old_size, std::memory_order_relaxed);
+        }
+        return previous_realloc()(p, old_size, new_size);
+    }
+};
+
+#endif // H_TWO_PHASE_METRICS
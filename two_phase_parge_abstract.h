@@ -6,14 +6,28 @@
 #include <gmp++/gmp++.h>
 
 #include "cnma/parge_num.h"
+#include "cnma/fixed_limbs.h"
 
 class TwoPhasePargeAbstract : public TwoPhaseAbstract
 {
+  protected:
+    // the level 1 modulus f is 2^m_level_1_expos[f] + 1, m_level_1_signs feeds the CNMA::fixed_reduce kernels
+    std::vector<uint64_t> m_level_1_expos;
+    std::vector<int> m_level_1_signs;
 
   public:
     TwoPhasePargeAbstract(const GenCoprimeAbstract<Givaro::Integer> *m_level_1_moduli,
-                          const GenCoprimeAbstract<double> *m_level_2_moduli)
-        : TwoPhaseAbstract(m_level_1_moduli, m_level_2_moduli) {}
+                          const GenCoprimeAbstract<double> *m_level_2_moduli,
+                          PlanCache *plan_cache = NULL,
+                          const std::string &plan_key = "")
+        : TwoPhaseAbstract(m_level_1_moduli, m_level_2_moduli, plan_cache, plan_key)
+    {
+        for (size_t f = 0; f < m_level_1_moduli_count; f++)
+        {
+            m_level_1_expos.push_back((m_level_1_moduli->val(f) - 1).bitsize() - 1);
+            m_level_1_signs.push_back(+1);
+        }
+    }
     TwoPhasePargeAbstract(const TwoPhasePargeAbstract &) = delete;
     TwoPhasePargeAbstract &operator=(const TwoPhasePargeAbstract &) = delete;
 
@@ -23,32 +37,18 @@ class TwoPhasePargeAbstract : public TwoPhaseAbstract
         this helper method is used by matrix_product(...)
     */
   protected:
-    virtual const vector<Phase1_Int> matrix_reduce_phase_1(const vector<Givaro::Integer> &inputs) const override
+    virtual void reduce_phase_1_entry(mpz_srcptr input, Phase1_Int *out, size_t level_1_moduli_count) const override
     {
-        size_t len_inputs = inputs.size();
-        // phase 1 begins
-        // p1_reduced stores multi-moduli representation of each input
-        vector<Phase1_Int> p1_reduced(len_inputs * m_level_1_moduli_count);
-        for (size_t i = 0; i < len_inputs; i++)
+        // inputs of moderate size are reduced on fixed size limb arrays, the others by the mpz kernels
+        if (CNMA::fixed_reduce_dispatch(out, input, level_1_moduli_count, m_level_1_expos.data(), m_level_1_signs.data()))
+        {
+            return;
+        }
+        for (size_t f = 0; f < level_1_moduli_count; f++)
         {
-            for (size_t f = 0; f < m_level_1_moduli_count; f++)
-            {
-                Phase1_Int &t = p1_reduced[i * m_level_1_moduli_count + f];
-                t = inputs[i];
-                CNMA::dc_reduce_plus(t.get_mpz(), (m_level_1_moduli->val(f) - 1).bitsize() - 1);
-            }
-#if TIME_MMC
-            // print a dot for every 100 entries
-            if (i % 100 == 0)
-            {
-                cerr << ".";
-            }
-#endif
+            mpz_set(out[f].get_mpz(), input);
+            CNMA::dc_reduce_plus(out[f].get_mpz(), m_level_1_expos[f]);
         }
-#if TIME_MMC
-        cerr << endl;
-#endif
-        return p1_reduced;
     }
 };
 
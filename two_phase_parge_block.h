@@ -13,8 +13,11 @@ class TwoPhasePargeBlock : public TwoPhasePargeAbstract
   public:
     TwoPhasePargeBlock(uint_fast64_t level_1_product_bitsize,
                        uint_fast64_t level_1_moduli_bitsize,
-                       uint_fast64_t block_size)
-        : TwoPhasePargeAbstract(new GenPargeBlock(level_1_product_bitsize, level_1_moduli_bitsize, block_size), NULL)
+                       uint_fast64_t block_size,
+                       PlanCache *plan_cache = NULL)
+        : TwoPhasePargeAbstract(plan_level_1_moduli(plan_cache, plan_key("parge_block", level_1_product_bitsize, level_1_moduli_bitsize, block_size),
+                                                    [&]() { return new GenPargeBlock(level_1_product_bitsize, level_1_moduli_bitsize, block_size); }),
+                                NULL, plan_cache, plan_key("parge_block", level_1_product_bitsize, level_1_moduli_bitsize, block_size))
     {
         assert(level_1_product_bitsize > level_1_moduli_bitsize * 2 && "Level 1 moduli size cannot be too large for the two-phase algorithm to be beneficial.");
     }
@@ -23,39 +26,43 @@ class TwoPhasePargeBlock : public TwoPhasePargeAbstract
     /* 
         use this method to recover from a single reduced matrix to phase 1 representations
     */
-    virtual const vector<Givaro::Integer> matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered) const override
+    virtual void matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered, size_t level_1_moduli_count, Phase1_Output &out) const override
     {
         // phase 1 recovery begins
-        size_t out_len = phase2_recovered.size() / m_level_1_moduli_count;
-        vector<Givaro::Integer> phase1_recovered(out_len);
+        size_t out_len = out.size();
+        assert(phase2_recovered.size() == out_len * level_1_moduli_count);
 
-        // initialization
-        mpz_t input_Mi[m_level_1_moduli_count];
-        mpz_t input_f[m_level_1_moduli_count];
-        uint64_t input_f_expo[m_level_1_moduli_count];
-        mpz_t input_work[m_level_1_moduli_count];
-        mpz_t input_r[m_level_1_moduli_count];
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
+        // initialization, every temporary is allocated once to the size it reaches:
+        // the residues to that of a level 2 product, the work array, the Garner temporaries
+        // and the outputs to that of the level 1 product
+        const mp_bitcnt_t moduli_bitsize = max_level_1_moduli_bitsize(level_1_moduli_count);
+        const mp_bitcnt_t product_bitsize = m_level_1_prefix_products[level_1_moduli_count].bitsize() + 2 * moduli_bitsize;
+        GmpScratch moduli(level_1_moduli_count, moduli_bitsize);
+        GmpScratch residues(level_1_moduli_count, 2 * moduli_bitsize + GMP_NUMB_BITS);
+        GmpScratch work(level_1_moduli_count, product_bitsize);
+        GmpScratch garner_scratch(2, product_bitsize);
+        mpz_t *input_f = moduli.get();
+        mpz_t *input_r = residues.get();
+        mpz_t *input_work = work.get();
+        uint64_t input_f_expo[level_1_moduli_count];
+        for (size_t i = 0; i < level_1_moduli_count; i++)
         {
-            mpz_init(input_Mi[i]);
-            mpz_init(input_r[i]);
-            mpz_init(input_work[i]);
-            mpz_init_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
+            mpz_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
             input_f_expo[i] = (m_level_1_moduli->val(i) - 1).bitsize() - 1;
         }
-        CNMA::precompute_Mi_parge_block(input_Mi, input_f, m_level_1_moduli_count);
         // recover
         for (size_t i = 0; i < out_len; i++)
         {
-            Givaro::Integer &t = phase1_recovered[i];
-            for (size_t f = 0; f < m_level_1_moduli_count; f++)
+            mpz_ptr t = out.entry(i, product_bitsize);
+            for (size_t f = 0; f < level_1_moduli_count; f++)
             {
-                const Phase1_Int &in = phase2_recovered[i * m_level_1_moduli_count + f];
+                const Phase1_Int &in = phase2_recovered[i * level_1_moduli_count + f];
                 mpz_set(input_r[f], in.get_mpz());
-                CNMA::dc_reduce_plus(input_r[f], (m_level_1_moduli->val(f) - 1).bitsize() - 1);
+                CNMA::dc_reduce_plus(input_r[f], (m_level_1_moduli->val(f) - 1).bitsize() - 1, garner_scratch[0]);
             }
-            CNMA::garner_parge_block(t.get_mpz(), m_level_1_moduli_count, input_r, input_f_expo, input_f, input_Mi, input_work);
-            mpz_mod(t.get_mpz(), t.get_mpz(), m_level_1_moduli->product().get_mpz());
+            CNMA::garner_parge_block(t, level_1_moduli_count, input_r, input_f_expo, input_f, m_level_1_Mi, input_work, garner_scratch.get());
+            mpz_mod(t, t, m_level_1_prefix_products[level_1_moduli_count].get_mpz());
+            out.commit(i);
 #if TIME_MMC
             if (i % 100 == 0)
             {
@@ -63,17 +70,9 @@ class TwoPhasePargeBlock : public TwoPhasePargeAbstract
             }
 #endif
         }
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
-        {
-            mpz_clear(input_Mi[i]);
-            mpz_clear(input_r[i]);
-            mpz_clear(input_f[i]);
-            mpz_clear(input_work[i]);
-        }
 #if TIME_MMC
         cerr << endl;
 #endif
-        return phase1_recovered;
     }
 };
 
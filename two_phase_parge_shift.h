@@ -11,111 +11,115 @@
 class TwoPhasePargeShift : public TwoPhasePargeAbstract
 {
     uint_fast64_t m_level_1_moduli_bitsize_coefficient;
+    // the third level 1 modulus fits a word
+    unsigned long m_small_prime;
+    // the powers 3^(2^j) folding an entry of up to the level 1 product size modulo 2^n + 3
+    GmpScratch m_pow3;
 
   public:
     TwoPhasePargeShift(uint_fast64_t level_1_product_bitsize,
                        uint_fast64_t level_1_moduli_bitsize,
-                       uint_fast64_t level_1_moduli_bitsize_coefficient)
-        : TwoPhasePargeAbstract(new GenPargeShift(level_1_product_bitsize, level_1_moduli_bitsize, level_1_moduli_bitsize_coefficient), NULL),
-          m_level_1_moduli_bitsize_coefficient(level_1_moduli_bitsize_coefficient)
+                       uint_fast64_t level_1_moduli_bitsize_coefficient,
+                       PlanCache *plan_cache = NULL)
+        : TwoPhasePargeAbstract(plan_level_1_moduli(plan_cache, plan_key("parge_shift", level_1_product_bitsize, level_1_moduli_bitsize, level_1_moduli_bitsize_coefficient),
+                                                    [&]() { return new GenPargeShift(level_1_product_bitsize, level_1_moduli_bitsize, level_1_moduli_bitsize_coefficient); }),
+                                NULL, plan_cache, plan_key("parge_shift", level_1_product_bitsize, level_1_moduli_bitsize, level_1_moduli_bitsize_coefficient)),
+          m_level_1_moduli_bitsize_coefficient(level_1_moduli_bitsize_coefficient),
+          m_small_prime(mpz_get_ui(m_level_1_moduli->val(2).get_mpz())),
+          m_pow3(CNMA::pow3_squares_count(level_1_product_bitsize, m_level_1_moduli->val(0).bitsize() - 1), GMP_NUMB_BITS)
     {
+        CNMA::pow3_squares(m_pow3.get(), m_pow3.size());
+        // the first modulus is 2^n rather than 2^n + 1
+        m_level_1_expos[0] = m_level_1_moduli->val(0).bitsize() - 1;
         assert(level_1_product_bitsize > level_1_moduli_bitsize * 2 && "Level 1 moduli size cannot be too large for the two-phase algorithm to be beneficial.");
     }
 
 
+  protected:
+    // the first three level 1 moduli (2^n, 2^n + 3 and a prime) are always used
+    virtual size_t min_level_1_moduli_count() const override
+    {
+        return 3;
+    }
+
     /*
         this helper method is used by matrix_product(...)
     */
   protected:
-    virtual const vector<Phase1_Int> matrix_reduce_phase_1(const vector<Givaro::Integer> &inputs) const override
+    virtual void reduce_phase_1_entry(mpz_srcptr input, Phase1_Int *out, size_t level_1_moduli_count) const override
     {
-        size_t len_inputs = inputs.size();
-        // phase 1 begins
-        // p1_reduced stores multi-moduli representation of each input
-        vector<Phase1_Int> p1_reduced(len_inputs * m_level_1_moduli_count);
-        for (size_t i = 0; i < len_inputs; i++)
+        const uint64_t shift_expo = m_level_1_expos[0];
+        // second moduli is 2^n+3, folded first with the last residue as the temporary,
+        // as this runs on several threads and that residue is overwritten below anyway
+        mpz_set(out[1].get_mpz(), input);
+        CNMA::dc_reduce_plus3(out[1].get_mpz(), m_level_1_moduli->val(1).get_mpz(), shift_expo, m_pow3.get(), m_pow3.size(), out[level_1_moduli_count - 1].get_mpz());
+        // first moduli is 2^n
+        CNMA::reduce_pow2(out[0].get_mpz(), input, shift_expo);
+        // third moduli is a random prime
+        CNMA::reduce_word(out[2].get_mpz(), input, m_small_prime);
+        // rest moduli are 2^i+1
+        for (size_t f = 3; f < level_1_moduli_count; f++)
         {
-            // first moduli is 2^n
-            Phase1_Int &t0 = p1_reduced[i * m_level_1_moduli_count + 0];
-            t0 = inputs[i];
-            t0 %= m_level_1_moduli->val(0); // could be slightly better here!
-            // second moduli is 2^n+3
-            Phase1_Int &t1 = p1_reduced[i * m_level_1_moduli_count + 1];
-            t1 = inputs[i];
-            t1 %= m_level_1_moduli->val(1);
-            // third moduli is a random prime
-            Phase1_Int &t2 = p1_reduced[i * m_level_1_moduli_count + 2];
-            t2 = inputs[i];
-            t2 %= m_level_1_moduli->val(2);
-            // rest moduli are 2^i+1
-            for (size_t f = 3; f < m_level_1_moduli_count; f++)
-            {
-                Phase1_Int &t = p1_reduced[i * m_level_1_moduli_count + f];
-                t = inputs[i];
-                CNMA::dc_reduce_plus(t.get_mpz(), (m_level_1_moduli->val(f) - 1).bitsize() - 1);
-            }
-#if TIME_MMC
-            // print a dot for every 100 entries
-            if (i % 100 == 0)
-            {
-                cerr << ".";
-            }
-#endif
+            mpz_set(out[f].get_mpz(), input);
+            CNMA::dc_reduce_plus(out[f].get_mpz(), m_level_1_expos[f]);
         }
-#if TIME_MMC
-        cerr << endl;
-#endif
-        return p1_reduced;
     }
 
   protected:
     /* 
         use this method to recover from a single reduced matrix to phase 1 representations
     */
-    virtual const vector<Givaro::Integer> matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered) const override
+    virtual void matrix_recover_phase_1(const vector<Phase1_Int> &phase2_recovered, size_t level_1_moduli_count, Phase1_Output &out) const override
     {
         // phase 1 recovery begins
-        size_t out_len = phase2_recovered.size() / m_level_1_moduli_count;
-        vector<Givaro::Integer> phase1_recovered(out_len);
+        size_t out_len = out.size();
+        assert(phase2_recovered.size() == out_len * level_1_moduli_count);
 
 
-        // initialization
-        mpz_t input_Mi[m_level_1_moduli_count];
-        mpz_t input_f[m_level_1_moduli_count];
-        uint64_t input_f_expo[m_level_1_moduli_count];
-        mpz_t input_work[m_level_1_moduli_count];
-        mpz_t input_r[m_level_1_moduli_count];
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
+        // initialization, every temporary is allocated once to the size it reaches:
+        // the residues to that of a level 2 product, the work array, the Garner temporaries
+        // and the outputs to that of the level 1 product
+        const mp_bitcnt_t moduli_bitsize = max_level_1_moduli_bitsize(level_1_moduli_count);
+        const mp_bitcnt_t product_bitsize = m_level_1_prefix_products[level_1_moduli_count].bitsize() + 2 * moduli_bitsize;
+        GmpScratch moduli(level_1_moduli_count, moduli_bitsize);
+        GmpScratch residues(level_1_moduli_count, 2 * moduli_bitsize + GMP_NUMB_BITS);
+        GmpScratch work(level_1_moduli_count, product_bitsize);
+        GmpScratch garner_scratch(2, product_bitsize);
+        mpz_t *input_f = moduli.get();
+        mpz_t *input_r = residues.get();
+        mpz_t *input_work = work.get();
+        uint64_t input_f_expo[level_1_moduli_count];
+        for (size_t i = 0; i < level_1_moduli_count; i++)
         {
-            mpz_init(input_Mi[i]);
-            mpz_init(input_r[i]);
-            mpz_init(input_work[i]);
-            mpz_init_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
+            mpz_set(input_f[i], m_level_1_moduli->val(i).get_mpz());
             input_f_expo[i] = m_level_1_moduli->val(i).bitsize() - 1;
         }
-        CNMA::precompute_Mi_parge_block(input_Mi, input_f, m_level_1_moduli_count);
+        const uint64_t shift_expo = input_f_expo[0];
+        const unsigned long small_prime = mpz_get_ui(input_f[2]);
         // recover
         for (size_t i = 0; i < out_len; i++)
         {
             // first moduli is 2^n
-            const Phase1_Int &in0 = phase2_recovered[i * m_level_1_moduli_count + 0];
-            mpz_mod(input_r[0], in0.get_mpz(), m_level_1_moduli->val(0).get_mpz());
+            const Phase1_Int &in0 = phase2_recovered[i * level_1_moduli_count + 0];
+            CNMA::reduce_pow2(input_r[0], in0.get_mpz(), shift_expo);
             // second moduli is 2^n + 3
-            const Phase1_Int &in1 = phase2_recovered[i * m_level_1_moduli_count + 1];
-            mpz_mod(input_r[1], in1.get_mpz(), m_level_1_moduli->val(1).get_mpz());
+            const Phase1_Int &in1 = phase2_recovered[i * level_1_moduli_count + 1];
+            mpz_set(input_r[1], in1.get_mpz());
+            CNMA::dc_reduce_plus3(input_r[1], input_f[1], shift_expo, m_pow3.get(), m_pow3.size(), garner_scratch[0]);
             // third moduli is a random prime
-            const Phase1_Int &in2 = phase2_recovered[i * m_level_1_moduli_count + 2];
-            mpz_mod(input_r[2], in2.get_mpz(), m_level_1_moduli->val(2).get_mpz());
+            const Phase1_Int &in2 = phase2_recovered[i * level_1_moduli_count + 2];
+            CNMA::reduce_word(input_r[2], in2.get_mpz(), small_prime);
             // rest moduli are 2^i + 1
-            for (size_t f = 3; f < m_level_1_moduli_count; f++)
+            for (size_t f = 3; f < level_1_moduli_count; f++)
             {
-                const Phase1_Int &in = phase2_recovered[i * m_level_1_moduli_count + f];
+                const Phase1_Int &in = phase2_recovered[i * level_1_moduli_count + f];
                 mpz_set(input_r[f], in.get_mpz());
-                CNMA::dc_reduce_plus(input_r[f], m_level_1_moduli->val(f).bitsize() - 1);
+                CNMA::dc_reduce_plus(input_r[f], m_level_1_moduli->val(f).bitsize() - 1, garner_scratch[0]);
             }
-            Givaro::Integer &t = phase1_recovered[i];
-            CNMA::garner_parge_shift_mixed(t.get_mpz(), m_level_1_moduli_count, input_r, input_f_expo, input_f, input_Mi, m_level_1_moduli_bitsize_coefficient, input_work);
-            mpz_mod(t.get_mpz(), t.get_mpz(), m_level_1_moduli->product().get_mpz());
+            mpz_ptr t = out.entry(i, product_bitsize);
+            CNMA::garner_parge_shift_mixed(t, level_1_moduli_count, input_r, input_f_expo, input_f, m_level_1_Mi, m_level_1_moduli_bitsize_coefficient, input_work, garner_scratch.get());
+            mpz_mod(t, t, m_level_1_prefix_products[level_1_moduli_count].get_mpz());
+            out.commit(i);
 #if TIME_MMC
             if (i % 100 == 0)
             {
@@ -123,17 +127,9 @@ class TwoPhasePargeShift : public TwoPhasePargeAbstract
             }
 #endif
         }
-        for (size_t i = 0; i < m_level_1_moduli_count; i++)
-        {
-            mpz_clear(input_Mi[i]);
-            mpz_clear(input_r[i]);
-            mpz_clear(input_f[i]);
-            mpz_clear(input_work[i]);
-        }
 #if TIME_MMC
         cerr << endl;
 #endif
-        return phase1_recovered;
     }
 };
 
@@ -0,0 +1,456 @@
+#if !defined(H_TWO_PHASE_TUNER)
+#define H_TWO_PHASE_TUNER
+
+#include "two_phase_marge_most.h"
+#include "two_phase_marge_least.h"
+#include "two_phase_parge_block.h"
+#include "two_phase_parge_shift.h"
+#include "two_phase_hybrid.h"
+#include "plan_cache.h"
+#include "two_phase_cost_model.h"
+#include "gen_prime_table.h"
+#include <gmp++/gmp++.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+enum TwoPhaseScheme
+{
+    TWO_PHASE_MARGE_MOST = 0,
+    TWO_PHASE_MARGE_LEAST = 1,
+    TWO_PHASE_PARGE_BLOCK = 2,
+    TWO_PHASE_PARGE_SHIFT = 3,
+    TWO_PHASE_HYBRID = 4,
+    TWO_PHASE_SCHEME_COUNT = 5
+};
+
+// the block size and coefficient used for the parge schemes, as in the benchmark
+const uint_fast64_t TWO_PHASE_PARGE_BLOCK_SIZE = 4;
+const uint_fast64_t TWO_PHASE_PARGE_SHIFT_COEFFICIENT = 1;
+// with a calibrated cost model only candidates predicted within this factor of the best are timed
+const double TWO_PHASE_TUNER_PRUNE_FACTOR = 2.0;
+
+// a scheme and its level 1 parameters, as picked by TwoPhaseTuner
+struct TwoPhasePlan
+{
+    TwoPhaseScheme scheme;
+    uint_fast64_t product_bitsize; // level 1 product bound
+    uint_fast64_t moduli_bitsize;  // level 1 moduli bound (the minimum for marge least)
+    double seconds;                // measured time of one product, 0 if not measured
+
+    static const char *scheme_name(TwoPhaseScheme scheme)
+    {
+        static const char *names[] = {"marge_most", "marge_least", "parge_block", "parge_shift", "hybrid"};
+        return names[scheme];
+    }
+
+    /*
+        use this method to get the exponents (bitsizes) of the level 1 moduli the scheme would
+        generate, without constructing it, returns false if it runs out of moduli
+        (the generators abort in that case)
+    */
+    bool level_1_exponents(std::vector<uint64_t> &expos) const
+    {
+        expos.clear();
+        uint64_t bits = 0;
+        switch (scheme)
+        {
+        case TWO_PHASE_MARGE_MOST:
+        {
+            // the primes below moduli_bitsize, largest first
+            std::vector<uint64_t> primes = PrimeTable::small_primes(moduli_bitsize);
+            for (size_t i = primes.size(); i-- > 0 && bits < product_bitsize;)
+            {
+                expos.push_back(primes[i]);
+                bits += primes[i];
+            }
+            return bits >= product_bitsize;
+        }
+        case TWO_PHASE_MARGE_LEAST:
+            // the primes above moduli_bitsize, smallest first
+            for (uint64_t p = PrimeTable::next_prime(moduli_bitsize); bits < product_bitsize; p = PrimeTable::next_prime(p))
+            {
+                expos.push_back(p);
+                bits += p;
+            }
+            return true;
+        case TWO_PHASE_PARGE_BLOCK:
+        {
+            uint_fast64_t block_size = TWO_PHASE_PARGE_BLOCK_SIZE;
+            return GenPargeBlock::exponents_for(product_bitsize, moduli_bitsize, block_size, expos);
+        }
+        case TWO_PHASE_PARGE_SHIFT:
+        {
+            if (moduli_bitsize & (moduli_bitsize - 1))
+            {
+                return false; // must be a power of two
+            }
+            // 2^n, 2^n + 3, 2039 and then 2^n + 1, 2^(n/2) + 1, ..., 3
+            expos.push_back(TWO_PHASE_PARGE_SHIFT_COEFFICIENT * moduli_bitsize);
+            expos.push_back(TWO_PHASE_PARGE_SHIFT_COEFFICIENT * moduli_bitsize);
+            expos.push_back(11);
+            bits = expos[0] + expos[1] + expos[2];
+            for (uint64_t n = moduli_bitsize; n >= 1 && bits < product_bitsize; n >>= 1)
+            {
+                expos.push_back(TWO_PHASE_PARGE_SHIFT_COEFFICIENT * n);
+                bits += expos.back();
+            }
+            return bits >= product_bitsize;
+        }
+        case TWO_PHASE_HYBRID:
+        {
+            std::vector<std::pair<uint64_t, int>> signed_expos;
+            bool enough = moduli_bitsize >= 3 && GenHybrid::exponents_for(product_bitsize, moduli_bitsize, signed_expos);
+            for (size_t i = 0; i < signed_expos.size(); i++)
+            {
+                expos.push_back(signed_expos[i].first);
+            }
+            return enough;
+        }
+        default:
+            return false;
+        }
+    }
+
+    /*
+        use this method to check if the scheme can generate enough level 1 moduli
+    */
+    bool feasible() const
+    {
+        std::vector<uint64_t> expos;
+        return product_bitsize > 2 * moduli_bitsize && moduli_bitsize >= 2 && level_1_exponents(expos);
+    }
+
+    /*
+        use this method to estimate the shape of a dim x dim product with this plan without
+        constructing it, for TwoPhaseCostModel::predict
+    */
+    TwoPhaseShape shape(size_t dim, uint_fast64_t input_bitsize) const
+    {
+        std::vector<uint64_t> expos;
+        level_1_exponents(expos);
+        TwoPhaseShape s;
+        s.dim_m = s.dim_n = s.dim_k = dim;
+        s.input_bitsize = input_bitsize;
+        s.level_1_moduli_count = expos.size();
+        s.level_1_moduli_bitsize = expos.empty() ? 0 : *std::max_element(expos.begin(), expos.end()) + 1;
+        s.level_2_moduli_count = TwoPhaseCostModel::level_2_moduli_count_for(s.level_1_moduli_bitsize);
+        return s;
+    }
+
+    /*
+        use this method to construct the algorithm of this plan, the caller owns it
+    */
+    TwoPhaseAbstract *make(PlanCache *plan_cache = NULL) const
+    {
+        switch (scheme)
+        {
+        case TWO_PHASE_MARGE_MOST:
+            return new TwoPhaseMargeMost(product_bitsize, moduli_bitsize, plan_cache);
+        case TWO_PHASE_MARGE_LEAST:
+            return new TwoPhaseMargeLeast(product_bitsize, moduli_bitsize, plan_cache);
+        case TWO_PHASE_PARGE_BLOCK:
+            return new TwoPhasePargeBlock(product_bitsize, moduli_bitsize, TWO_PHASE_PARGE_BLOCK_SIZE, plan_cache);
+        case TWO_PHASE_PARGE_SHIFT:
+            return new TwoPhasePargeShift(product_bitsize, moduli_bitsize, TWO_PHASE_PARGE_SHIFT_COEFFICIENT, plan_cache);
+        case TWO_PHASE_HYBRID:
+            return new TwoPhaseHybrid(product_bitsize, moduli_bitsize, plan_cache);
+        default:
+            assert(false && "unknown two phase scheme");
+            return NULL;
+        }
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const TwoPhasePlan &plan)
+    {
+        return out << scheme_name(plan.scheme) << "(" << plan.product_bitsize << ", " << plan.moduli_bitsize << ") " << plan.seconds << "s";
+    }
+};
+
+/*
+    Picks the scheme and level 1 moduli bitsize for a problem shape (dimension, input bitsize,
+    thread count) by timing one product of random inputs for every feasible candidate.
+    The level 1 moduli bitsizes tried are powers of two below the input bitsize, the time against it is
+    U-shaped so a scheme stops being explored once it got slower twice in a row.
+    With a PlanCache the winner is persisted under "tune/<dim>/<input bitsize>/<threads>/<schemes>",
+    and the plans (moduli and Garner constants) of the candidates are cached as well.
+    Once a cost model is calibrated (see cost_model) only the candidates it predicts to be
+    close to the best of their scheme are timed, and predict picks a plan without any trial
+    product. The model is fitted on marge most products, whose reduce and recover kernels cost
+    differently from the other schemes', so it never prunes one scheme against another.
+*/
+class TwoPhaseTuner
+{
+  protected:
+    PlanCache *m_plan_cache;
+    size_t m_iters;
+    TwoPhaseCostModel m_cost_model;
+
+  public:
+    TwoPhaseTuner(PlanCache *plan_cache = NULL, size_t iters = 1)
+        : m_plan_cache(plan_cache), m_iters(iters > 0 ? iters : 1) {}
+
+    TwoPhaseTuner(const TwoPhaseTuner &) = delete;
+    TwoPhaseTuner &operator=(const TwoPhaseTuner &) = delete;
+
+    // the level 1 product bound for square products of the given shape
+    static uint_fast64_t product_bitsize_for(size_t dim, uint_fast64_t input_bitsize)
+    {
+        return 2 * input_bitsize + Givaro::Integer(uint64_t(dim)).bitsize() + 1;
+    }
+
+    /*
+        use this method to get the fastest plan over all schemes into best,
+        a persisted winner is returned without benchmarking,
+        returns false if no scheme is feasible for this shape (see candidates)
+    */
+    bool tune(size_t dim, uint_fast64_t input_bitsize, int threads, TwoPhasePlan &best)
+    {
+        return tune(dim, input_bitsize, threads, std::vector<TwoPhaseScheme>{TWO_PHASE_MARGE_MOST, TWO_PHASE_MARGE_LEAST, TWO_PHASE_PARGE_BLOCK, TWO_PHASE_PARGE_SHIFT, TWO_PHASE_HYBRID}, best);
+    }
+
+    /*
+        use this method to get the fastest plan among the given schemes into best,
+        returns false if none of them is feasible for this shape
+    */
+    bool tune(size_t dim, uint_fast64_t input_bitsize, int threads, const std::vector<TwoPhaseScheme> &schemes, TwoPhasePlan &best)
+    {
+        std::string key = "tune/" + std::to_string(dim) + "/" + std::to_string(input_bitsize) + "/" + std::to_string(threads);
+        for (size_t s = 0; s < schemes.size(); s++)
+        {
+            key += "/" + std::string(TwoPhasePlan::scheme_name(schemes[s]));
+        }
+        if (lookup(key, best))
+        {
+#if DEBUG_MMC || TIME_MMC
+            cerr << "TwoPhaseTuner: cached " << key << " -> " << best << endl;
+#endif
+            return true;
+        }
+        std::vector<TwoPhasePlan> plans = candidates(dim, input_bitsize, schemes);
+        if (plans.empty())
+        {
+#if DEBUG_MMC || TIME_MMC
+            cerr << "TwoPhaseTuner: no feasible scheme for " << key << endl;
+#endif
+            return false;
+        }
+#ifdef _OPENMP
+        int saved_threads = omp_get_max_threads();
+        if (threads > 0)
+        {
+            omp_set_num_threads(threads);
+        }
+#endif
+        std::vector<Givaro::Integer> a(dim * dim), b(dim * dim);
+        for (size_t i = 0; i < dim * dim; i++)
+        {
+            a[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+            b[i] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+        }
+        best = plans[0];
+        best.seconds = std::numeric_limits<double>::infinity();
+        // one cutoff per scheme, see the class comment
+        std::vector<double> cutoffs(TWO_PHASE_SCHEME_COUNT, std::numeric_limits<double>::infinity());
+        if (m_cost_model.calibrated())
+        {
+            for (size_t i = 0; i < plans.size(); i++)
+            {
+                double &cutoff = cutoffs[plans[i].scheme];
+                cutoff = std::min(cutoff, TWO_PHASE_TUNER_PRUNE_FACTOR * m_cost_model.predict(plans[i].shape(dim, input_bitsize)));
+            }
+        }
+        double previous = std::numeric_limits<double>::infinity();
+        int slower = 0;
+        for (size_t i = 0; i < plans.size(); i++)
+        {
+            TwoPhasePlan &plan = plans[i];
+            if (i > 0 && plan.scheme != plans[i - 1].scheme)
+            {
+                previous = std::numeric_limits<double>::infinity();
+                slower = 0;
+            }
+            if (slower >= 2 || m_cost_model.predict(plan.shape(dim, input_bitsize)) > cutoffs[plan.scheme])
+            {
+                continue;
+            }
+            plan.seconds = measure(plan, a, b, dim);
+#if DEBUG_MMC || TIME_MMC
+            cerr << "TwoPhaseTuner: " << plan << endl;
+#endif
+            slower = plan.seconds > previous ? slower + 1 : 0;
+            previous = plan.seconds;
+            if (plan.seconds < best.seconds)
+            {
+                best = plan;
+            }
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(saved_threads);
+#endif
+        store(key, best);
+        return true;
+    }
+
+    /*
+        use this method to get the plan with the lowest predicted cost, no product is run,
+        the cost model must be calibrated (see cost_model); across schemes this only
+        compares the work of the plans, their kernels are priced as marge most's
+    */
+    TwoPhasePlan predict(size_t dim, uint_fast64_t input_bitsize, const std::vector<TwoPhaseScheme> &schemes) const
+    {
+        assert(m_cost_model.calibrated() && "the cost model must be calibrated before predicting");
+        std::vector<TwoPhasePlan> plans = candidates(dim, input_bitsize, schemes);
+        assert(!plans.empty() && "no feasible scheme");
+        TwoPhasePlan best = plans[0];
+        best.seconds = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < plans.size(); i++)
+        {
+            plans[i].seconds = m_cost_model.predict(plans[i].shape(dim, input_bitsize));
+            if (plans[i].seconds < best.seconds)
+            {
+                best = plans[i];
+            }
+        }
+        return best;
+    }
+
+    /*
+        use this method to get the cost model of this machine, it is loaded from the PlanCache
+        or calibrated by timing the phases of a few marge most products (and then persisted)
+    */
+    const TwoPhaseCostModel &cost_model(int threads = 1)
+    {
+        std::string key = "cost_model/" + std::to_string(threads);
+        if (m_cost_model.calibrated() || (m_plan_cache && m_cost_model.load(*m_plan_cache, key)))
+        {
+            return m_cost_model;
+        }
+#ifdef _OPENMP
+        int saved_threads = omp_get_max_threads();
+        if (threads > 0)
+        {
+            omp_set_num_threads(threads);
+        }
+#endif
+        std::vector<TwoPhaseShape> shapes;
+        std::vector<double> reduce_seconds, gemm_seconds, recover_seconds;
+        const size_t dims[] = {8, 16, 32};
+        const uint_fast64_t input_bitsizes[] = {1 << 9, 1 << 11};
+        for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); d++)
+        {
+            for (size_t i = 0; i < sizeof(input_bitsizes) / sizeof(input_bitsizes[0]); i++)
+            {
+                size_t dim = dims[d];
+                uint_fast64_t input_bitsize = input_bitsizes[i];
+                std::vector<Givaro::Integer> a(dim * dim), b(dim * dim);
+                for (size_t j = 0; j < dim * dim; j++)
+                {
+                    a[j] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                    b[j] = Givaro::Integer::random_lessthan_2exp(input_bitsize);
+                }
+                TwoPhaseMargeMost algo(product_bitsize_for(dim, input_bitsize), input_bitsize / 4, m_plan_cache);
+                TwoPhaseShape shape = algo.shape(dim, dim, dim, input_bitsize);
+                std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+                TwoPhaseAbstract::Phase2_Matrix ra = algo.matrix_reduce(a, dim, dim, shape.level_1_moduli_count);
+                TwoPhaseAbstract::Phase2_Matrix rb = algo.matrix_reduce(b, dim, dim, shape.level_1_moduli_count);
+                std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+                TwoPhaseAbstract::Phase2_Matrix rc = algo.phase2_mult(ra, rb);
+                std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+                std::vector<Givaro::Integer> c = algo.matrix_recover(rc);
+                std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+                shapes.push_back(shape);
+                reduce_seconds.push_back(std::chrono::duration<double>(t1 - t0).count());
+                gemm_seconds.push_back(std::chrono::duration<double>(t2 - t1).count());
+                recover_seconds.push_back(std::chrono::duration<double>(t3 - t2).count());
+            }
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(saved_threads);
+#endif
+        m_cost_model.fit(shapes, reduce_seconds, gemm_seconds, recover_seconds);
+#if DEBUG_MMC || TIME_MMC
+        cerr << "TwoPhaseTuner: cost model reduce " << m_cost_model.m_reduce << " gemm " << m_cost_model.m_gemm << " recover " << m_cost_model.m_recover << endl;
+#endif
+        if (m_plan_cache && m_cost_model.calibrated())
+        {
+            m_cost_model.store(*m_plan_cache, key);
+        }
+        return m_cost_model;
+    }
+
+    // the feasible plans for a shape, grouped by scheme with increasing level 1 moduli bitsize
+    static std::vector<TwoPhasePlan> candidates(size_t dim, uint_fast64_t input_bitsize, const std::vector<TwoPhaseScheme> &schemes)
+    {
+        std::vector<TwoPhasePlan> plans;
+        uint_fast64_t product_bitsize = product_bitsize_for(dim, input_bitsize);
+        for (size_t s = 0; s < schemes.size(); s++)
+        {
+            // level 1 moduli as large as the inputs are never worth it
+            for (uint_fast64_t moduli_bitsize = 16; moduli_bitsize < input_bitsize; moduli_bitsize <<= 1)
+            {
+                TwoPhasePlan plan = {schemes[s], product_bitsize, moduli_bitsize, 0};
+                if (plan.feasible())
+                {
+                    plans.push_back(plan);
+                }
+            }
+        }
+        return plans;
+    }
+
+  protected:
+    // the best of m_iters timed products, the construction is not timed
+    double measure(const TwoPhasePlan &plan, const std::vector<Givaro::Integer> &a, const std::vector<Givaro::Integer> &b, size_t dim) const
+    {
+        TwoPhaseAbstract *algo = plan.make(m_plan_cache);
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < m_iters; i++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::vector<Givaro::Integer> c = algo->matrix_product(a, b, dim, dim, dim);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        delete algo;
+        return best;
+    }
+
+    // a persisted plan is a single section {scheme, product bitsize, moduli bitsize, nanoseconds}
+    bool lookup(const std::string &key, TwoPhasePlan &plan) const
+    {
+        PlanCache::Entry entry;
+        if (!m_plan_cache || !m_plan_cache->lookup(key, entry) || entry.size() != 1 || entry[0].size() != 4 ||
+            entry[0][0] >= uint64_t(TWO_PHASE_SCHEME_COUNT))
+        {
+            return false;
+        }
+        plan.scheme = TwoPhaseScheme(uint64_t(entry[0][0]));
+        plan.product_bitsize = uint64_t(entry[0][1]);
+        plan.moduli_bitsize = uint64_t(entry[0][2]);
+        plan.seconds = double(uint64_t(entry[0][3])) * 1e-9;
+        return true;
+    }
+
+    void store(const std::string &key, const TwoPhasePlan &plan)
+    {
+        if (!m_plan_cache)
+        {
+            return;
+        }
+        PlanCache::Entry entry(1);
+        entry[0].push_back(Givaro::Integer(uint64_t(plan.scheme)));
+        entry[0].push_back(Givaro::Integer(uint64_t(plan.product_bitsize)));
+        entry[0].push_back(Givaro::Integer(uint64_t(plan.moduli_bitsize)));
+        entry[0].push_back(Givaro::Integer(uint64_t(plan.seconds * 1e9)));
+        m_plan_cache->store(key, entry);
+    }
+};
+
+#endif // H_TWO_PHASE_TUNER